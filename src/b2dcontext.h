@@ -266,14 +266,11 @@ namespace waavs {
         bool findFont(PSVirtualMachine &vm, const PSName& faceName, PSObject& outObj) override
         {
             auto& ostk = vm.opStack();
-            auto& estk = vm.execStack();
 
             ostk.pushLiteralName(faceName);
             ostk.pushLiteralName("Font");
-            estk.pushExecName("findresource");
 
-
-            if (!vm.run())
+            if (!vm.runObject(PSObject::fromExecName("findresource")))
                 return false;
 
             ostk.pop(outObj);
@@ -361,16 +358,20 @@ namespace waavs {
             BLImageData imgData;
             blimg.getData(&imgData);
 
-            // got pixel by pixel setting each value according to the grayscale
-            // values in the PSImage
+            // go row by row, setting each pixel according to the grayscale
+            // values in the PSImage, as the file lends them, a chunk at a time
             for (int y = 0; y < img.height; ++y) {
-                for (int x = 0; x < img.width; ++x) {
-                    uint8_t grayValue = 0;
-                    if (!src->readByte(grayValue))
+                uint32_t* row = ((uint32_t*)(imgData.pixelData)) + (img.height - 1 - y) * img.width;
+                int x = 0;
+                while (x < img.width) {
+                    OctetCursor chunk = src->readChunk(static_cast<size_t>(img.width - x));
+                    if (chunk.empty())
                         return false;
-                    //uint8_t grayValue = img.data[y * img.width + x];
-                    uint32_t pixelValue = (255 << 24) | (grayValue << 16) | (grayValue << 8) | grayValue;
-                    ((uint32_t*)(imgData.pixelData))[(img.height-1-y)*img.width+x] = pixelValue;
+
+                    for (const uint8_t* p = chunk.begin(); p < chunk.end(); ++p, ++x) {
+                        uint32_t grayValue = *p;
+                        row[x] = (255u << 24) | (grayValue << 16) | (grayValue << 8) | grayValue;
+                    }
                 }
             }
 
@@ -8,25 +8,81 @@
 
 
 namespace waavs {
+    // How well the lookup cache of a dictionary stack is doing
+    struct PSLookupStats {
+        uint64_t fHits = 0;
+        uint64_t fMisses = 0;
+
+        uint64_t lookups() const noexcept { return fHits + fMisses; }
+        double hitRate() const noexcept { return lookups() ? double(fHits) / double(lookups()) : 0.0; }
+    };
+
     struct PSDictionaryStack {
     private:
         std::vector<PSDictionaryHandle> stack;
 
+        // Lookup cache
+        // A name that was resolved through the stack remembers where its 
+        // value lives, along with the binding generation at the time.  As 
+        // long as the generation has not moved, the same lookup is a pointer 
+        // compare, rather than a hash probe of every dictionary on the stack.
+        // Direct mapped, indexed by the hash of the name.
+        struct LookupCacheEntry {
+            const char* fName = nullptr;
+            uint64_t fGeneration = 0;
+            const PSObject* fValue = nullptr;
+        };
+
+        static constexpr size_t kLookupCacheSize = 1024;    // power of 2
+
+        mutable LookupCacheEntry fLookupCache[kLookupCacheSize];
+        mutable PSLookupStats fLookupStats;
+
+        static size_t lookupCacheIndex(const PSName& key) noexcept {
+            return static_cast<size_t>(key.hash()) & (kLookupCacheSize - 1);
+        }
+
+        static void enter(const PSDictionaryHandle& dict) {
+            if (dict)
+                dict->enterStack();
+            PSDictionary::bumpBindingGeneration();
+        }
+
+        static void leave(const PSDictionaryHandle& dict) {
+            if (dict)
+                dict->leaveStack();
+            PSDictionary::bumpBindingGeneration();
+        }
+
     public:
         PSDictionaryStack() {}
 
+        ~PSDictionaryStack() {
+            for (auto& dict : stack)
+                leave(dict);
+        }
+
+        PSDictionaryStack(const PSDictionaryStack&) = delete;
+        PSDictionaryStack& operator=(const PSDictionaryStack&) = delete;
+
         bool push(PSDictionaryHandle dict) {
+            enter(dict);
             stack.push_back(dict);
             return true;
         }
 
         bool pop() {
-            if (stack.size() > 1) // don't remove global
+            if (stack.size() > 1) { // don't remove global
+                leave(stack.back());
                 stack.pop_back();
+            }
 
             return true;
         }
 
+        const PSLookupStats& lookupStats() const noexcept { return fLookupStats; }
+        void resetLookupStats() noexcept { fLookupStats = PSLookupStats(); }
+
         PSDictionaryHandle currentdict() const {
             if (stack.empty())
                 return nullptr;
@@ -51,6 +107,11 @@ namespace waavs {
 
         void setStack(const std::vector<PSDictionaryHandle>& newStack)
         {
+            for (auto& dict : newStack)
+                enter(dict);
+            for (auto& dict : stack)
+                leave(dict);
+
             stack = newStack;
         }
 
@@ -64,9 +125,27 @@ namespace waavs {
         }
 
         bool load(const PSName &key, PSObject& out) const {
+            const uint64_t generation = PSDictionary::bindingGeneration();
+            LookupCacheEntry& cached = fLookupCache[lookupCacheIndex(key)];
+
+            if (cached.fName == key.c_str() && cached.fGeneration == generation) {
+                fLookupStats.fHits++;
+                out = *cached.fValue;
+                return true;
+            }
+
+            fLookupStats.fMisses++;
+
             for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
-                if ((*it)->get(key, out))
+                const PSObject* value = (*it)->find(key);
+                if (value) {
+                    cached.fName = key.c_str();
+                    cached.fGeneration = generation;
+                    cached.fValue = value;
+
+                    out = *value;
                     return true;
+                }
             }
             return false;
         }
@@ -97,6 +176,7 @@ namespace waavs {
                 return false;
 
             while (stack.size() > 1) {
+                leave(stack.back());
                 stack.pop_back();
             }
 
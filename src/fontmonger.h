@@ -114,7 +114,6 @@ namespace waavs {
             BLFontFace face;
 
             auto& s = vm.opStack();
-            auto& estk = vm.execStack();
 
             // pop the path from the stack
             if (s.size() < 1) {
@@ -178,9 +177,7 @@ namespace waavs {
             s.pushLiteralName("Font");
             s.push(PSObject::fromFontFace(psface));
 
-            estk.pushExecName("defineresource");
-
-            vm.run();
+            vm.runObject(PSObject::fromExecName("defineresource"));
 
 
             // value left on stack, so pop that, we don't need it
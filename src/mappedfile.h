@@ -2,20 +2,30 @@
 
 /*
 	mmap is the rough equivalent of the mmap() function on Linux
-	This basically allows you to memory map a file, which means you 
-	can access a pointer to the file's contents without having to 
+	This basically allows you to memory map a file, which means you
+	can access a pointer to the file's contents without having to
 	go through IO routines.
 
 	Usage:
 	local m = MappedFile::create_shared(filename)
 
 	local bs = binstream(m:getPointer(), #m)
+
+	On Windows the file is mapped with CreateFileMapping/MapViewOfFile,
+	everywhere else with open/mmap.
 */
+#if defined(_WIN32)
 #include <SDKDDKVer.h>
 
 #define WIN32_LEAN_AND_MEAN
 #define NOMINMAX
 #include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include <cstdio>
 #include <string>
@@ -25,12 +35,30 @@
 
 namespace waavs
 {
+    // How a mapped file is going to be read.  These are hints, a platform
+    // does what it can with them, and ignores the rest.
+    enum MappedFileHints : uint32_t {
+        MAPPED_HINT_NONE        = 0,
+        MAPPED_HINT_SEQUENTIAL  = 1 << 0,   // front to back, once; run, interpret
+        MAPPED_HINT_RANDOM      = 1 << 1,   // here and there; a page out of a DSC document
+        MAPPED_HINT_POPULATE    = 1 << 2,   // all of it, right away; small prologs
+        MAPPED_HINT_HUGEPAGES   = 1 << 3,   // on huge pages; very large spool files
+    };
+
     struct MappedFile
     {
+        // Files up to this size are read in whole when asked to populate,
+        // bigger ones are left to read ahead
+        static constexpr size_t kPopulateLimit = 1024 * 1024;
+
+        // Huge pages are only worth it for files at least this big
+        static constexpr size_t kHugePageMinimum = 64 * 1024 * 1024;
+
         void* fData{};
         size_t fSize{};
         bool fIsValid{};
 
+#if defined(_WIN32)
         HANDLE fFileHandle{};
         HANDLE fMapHandle{};
 
@@ -52,6 +80,19 @@ namespace waavs
             , fFileHandle(nullptr)
             , fMapHandle(nullptr)
         {}
+#else
+    public:
+        // The descriptor is closed once the file is mapped, the mapping
+        // is all that is kept
+        MappedFile(void* data, size_t length) noexcept
+            : fData(data)
+            , fSize(length)
+        {
+            fIsValid = true;
+        }
+
+        MappedFile() noexcept = default;
+#endif
 
         virtual ~MappedFile() noexcept { close(); }
 
@@ -59,6 +100,7 @@ namespace waavs
         void* data() const noexcept { return fData; }
         size_t size() const noexcept { return fSize; }
 
+#if defined(_WIN32)
         bool close() noexcept
         {
             if (fData != nullptr) {
@@ -79,18 +121,26 @@ namespace waavs
             return true;
         }
 
-
+        // The cache manager takes its read ahead from how the file was
+        // opened, there is nothing to change once it is mapped
+        bool advise(uint32_t hints) noexcept
+        {
+            (void)hints;
+            return false;
+        }
 
         // factory method
-        // desiredAccess - GENERIC_READ, GENERIC_WRITE, GENERIC_EXECUTE
-        // shareMode - FILE_SHARE_READ, FILE_SHARE_WRITE
-        // creationDisposition - CREATE_ALWAYS, CREATE_NEW, OPEN_ALWAYS, OPEN_EXISTING, TRUNCATE_EXISTING
+        // hints - MAPPED_HINT_SEQUENTIAL opens the file for a sequential
+        // scan, anything else for random access.  The other hints have
+        // nothing to map to here.
         static std::shared_ptr<MappedFile> create_shared(const std::string& filename,
-            uint32_t desiredAccess = GENERIC_READ,
-            uint32_t shareMode = FILE_SHARE_READ,
-            uint32_t disposition = OPEN_EXISTING) noexcept
+            uint32_t hints = MAPPED_HINT_NONE) noexcept
         {
-            uint32_t flagsAndAttributes = (FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS);
+            uint32_t desiredAccess = GENERIC_READ;
+            uint32_t shareMode = FILE_SHARE_READ;
+            uint32_t disposition = OPEN_EXISTING;
+            uint32_t flagsAndAttributes = FILE_ATTRIBUTE_NORMAL |
+                ((hints & MAPPED_HINT_SEQUENTIAL) ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS);
 
             const char* fname = filename.c_str();
             HANDLE filehandle = ::CreateFileA(fname,
@@ -111,7 +161,7 @@ namespace waavs
 
             // BUGBUG
             // Need to check whether we're opening for writing or not
-            // if we're opening for writing, then we don't want to 
+            // if we're opening for writing, then we don't want to
             // limit the size in CreateFileMappingA
             LARGE_INTEGER psize;
             ::GetFileSizeEx(filehandle, &psize);
@@ -146,5 +196,82 @@ namespace waavs
 
             return std::make_shared<MappedFile>(filehandle, maphandle, data, size);
         }
+#else
+        bool close() noexcept
+        {
+            if (fData != nullptr) {
+                ::munmap(fData, fSize);
+                fData = nullptr;
+            }
+
+            fIsValid = false;
+            return true;
+        }
+
+        // Tell the kernel how the pages are going to be read, from now on
+        bool advise(uint32_t hints) noexcept
+        {
+            if (fData == nullptr)
+                return false;
+
+            bool ok = true;
+
+            if (hints & MAPPED_HINT_SEQUENTIAL)
+                ok = ::madvise(fData, fSize, MADV_SEQUENTIAL) == 0 && ok;
+            else if (hints & MAPPED_HINT_RANDOM)
+                ok = ::madvise(fData, fSize, MADV_RANDOM) == 0 && ok;
+
+#if defined(MADV_HUGEPAGE)
+            if ((hints & MAPPED_HINT_HUGEPAGES) && fSize >= kHugePageMinimum)
+                ok = ::madvise(fData, fSize, MADV_HUGEPAGE) == 0 && ok;
+#endif
+
+            return ok;
+        }
+
+        // factory method
+        // hints - MAPPED_HINT_xxx, how the file is going to be read
+        static std::shared_ptr<MappedFile> create_shared(const std::string& filename,
+            uint32_t hints = MAPPED_HINT_NONE) noexcept
+        {
+            const char* fname = filename.c_str();
+            int fd = ::open(fname, O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                printf("Could not open file for mmap: %s\n", fname);
+                return {};
+            }
+
+            struct stat st;
+            if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+                ::close(fd);
+                return {};
+            }
+
+            // There is nothing to map in an empty file, but it is still
+            // a file, with nothing in it
+            size_t size = static_cast<size_t>(st.st_size);
+            if (size == 0) {
+                ::close(fd);
+                return std::make_shared<MappedFile>(nullptr, 0);
+            }
+
+            int flags = MAP_PRIVATE;
+#if defined(MAP_POPULATE)
+            if ((hints & MAPPED_HINT_POPULATE) && size <= kPopulateLimit)
+                flags |= MAP_POPULATE;
+#endif
+
+            void* data = ::mmap(nullptr, size, PROT_READ, flags, fd, 0);
+            ::close(fd);
+
+            if (data == MAP_FAILED)
+                return {};
+
+            auto mf = std::make_shared<MappedFile>(data, size);
+            mf->advise(hints);
+
+            return mf;
+        }
+#endif
     };
-}
\ No newline at end of file
+}
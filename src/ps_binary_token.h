@@ -0,0 +1,380 @@
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "pscore.h"
+
+//
+// Binary tokens and binary object sequences, PLRM 3.14
+//
+// Bytes 128 to 159 start a binary token when they begin a token.  The
+// lexer (scanBinaryTokenLexeme) only works out how long the token is,
+// the functions here turn the bytes of one token straight into a PSObject,
+// with no text parsing at all.
+//
+//   128-131    binary object sequence
+//   132-136    integers, 32, 16, and 8 bit
+//   137        16 or 32 bit fixed point number
+//   138-140    32 bit IEEE real
+//   141        boolean
+//   142-144    string, 8 or 16 bit length
+//   145-148    name from the system or user name table
+//   149        homogeneous number array
+//
+// The user name table (defineusername) is not supported, tokens that
+// refer to it fail to decode.
+//
+
+namespace waavs
+{
+    // The system name table, PLRM Appendix F.  The index of a name in
+    // this table is what a binary token carries instead of its text.
+    // Only the operator names, 0 to 198, are here; a token that uses a
+    // later index, FontDirectory and on, decodes to an executable name
+    // that gives an 'undefined' error naming the index (binarySystemName).
+    // The writer only uses names from this table, so never writes one.
+    static const char* const kBinarySystemNames[] = {
+        "abs", "add", "aload", "anchorsearch", "and", "arc", "arcn", "arct",
+        "arcto", "array", "ashow", "astore", "awidthshow", "begin", "bind", "bitshift",
+        "ceiling", "charpath", "clear", "cleartomark", "clip", "clippath", "closepath", "concat",
+        "concatmatrix", "copy", "copypage", "cos", "count", "counttomark", "currentcmykcolor", "currentdash",
+        "currentdict", "currentfile", "currentfont", "currentgray", "currentgstate", "currenthsbcolor", "currentlinecap", "currentlinejoin",
+        "currentlinewidth", "currentmatrix", "currentpoint", "currentrgbcolor", "currentshared", "curveto", "cvi", "cvlit",
+        "cvn", "cvr", "cvrs", "cvs", "cvx", "def", "defineusername", "dict",
+        "div", "dtransform", "dup", "end", "eoclip", "eofill", "eoviewclip", "eq",
+        "exch", "exec", "exit", "file", "fill", "findfont", "flattenpath", "floor",
+        "flush", "flushfile", "for", "forall", "ge", "get", "getinterval", "grestore",
+        "gsave", "gstate", "gt", "identmatrix", "idiv", "idtransform", "if", "ifelse",
+        "image", "imagemask", "index", "ineofill", "infill", "initviewclip", "inueofill", "inufill",
+        "invertmatrix", "itransform", "known", "le", "length", "lineto", "load", "loop",
+        "lt", "makefont", "matrix", "maxlength", "mod", "moveto", "mul", "ne",
+        "neg", "newpath", "not", "null", "or", "pathbbox", "pathforall", "pop",
+        "print", "printobject", "put", "putinterval", "rcurveto", "read", "readhexstring", "readline",
+        "readstring", "rectclip", "rectfill", "rectstroke", "rectviewclip", "repeat", "restore", "rlineto",
+        "rmoveto", "roll", "rotate", "round", "save", "scale", "scalefont", "search",
+        "selectfont", "setbbox", "setcachedevice", "setcachedevice2", "setcharwidth", "setcmykcolor", "setdash", "setfont",
+        "setgray", "setgstate", "sethsbcolor", "setlinecap", "setlinejoin", "setlinewidth", "setmatrix", "setrgbcolor",
+        "setshared", "shareddict", "show", "showpage", "stop", "stopped", "store", "string",
+        "stringwidth", "stroke", "strokepath", "sub", "systemdict", "token", "transform", "translate",
+        "truncate", "type", "uappend", "ucache", "ueofill", "ufill", "undef", "upath",
+        "userdict", "ustroke", "viewclip", "viewclippath", "where", "widthshow", "write", "writehexstring",
+        "writeobject", "writestring", "wtranslation", "xor", "xshow", "xyshow", "yshow"
+    };
+
+    static constexpr size_t kBinarySystemNameCount = sizeof(kBinarySystemNames) / sizeof(kBinarySystemNames[0]);
+
+    // Object types within a binary object sequence
+    enum class PSBinaryObjectType : uint8_t {
+        Null = 0,
+        Integer = 1,
+        Real = 2,
+        Name = 3,
+        Boolean = 4,
+        String = 5,
+        ImmediateName = 6,
+        Array = 9,
+        Mark = 10
+    };
+
+    static INLINE uint16_t binaryReadU16(const uint8_t* p, bool lowFirst) noexcept
+    {
+        return lowFirst ? uint16_t(p[0] | (p[1] << 8)) : uint16_t((p[0] << 8) | p[1]);
+    }
+
+    static INLINE uint32_t binaryReadU32(const uint8_t* p, bool lowFirst) noexcept
+    {
+        return lowFirst
+            ? (uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24))
+            : ((uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]));
+    }
+
+    static INLINE float binaryReadReal(const uint8_t* p, bool lowFirst) noexcept
+    {
+        uint32_t bits = binaryReadU32(p, lowFirst);
+        float f;
+        std::memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+
+    // A fixed point number with 'scale' bits of fraction.  With no
+    // fraction at all it is an integer.
+    static INLINE bool binaryFixedToObject(int32_t raw, uint32_t scale, PSObject& obj) noexcept
+    {
+        if (scale == 0)
+            return obj.resetFromInt(raw);
+
+        return obj.resetFromReal(std::ldexp(static_cast<double>(raw), -static_cast<int>(scale)));
+    }
+
+    // The number representation byte of tokens 137 and 149.  Tells how
+    // many bytes each number takes, 0 if the representation is not valid.
+    //   0-31   32 bit fixed point, scale r
+    //   32-47  16 bit fixed point, scale r-32
+    //   48     32 bit IEEE real
+    //   49     32 bit native real
+    //   +128   the same, low-order byte first
+    static INLINE size_t binaryNumberSize(uint8_t r) noexcept
+    {
+        uint8_t rep = r & 0x7f;
+        if (rep < 32) return 4;
+        if (rep < 48) return 2;
+        if (rep < 50) return 4;
+        return 0;
+    }
+
+    // Read one number in representation 'r', from 'p'
+    static INLINE bool binaryReadNumber(const uint8_t* p, uint8_t r, PSObject& obj) noexcept
+    {
+        bool lowFirst = (r & 0x80) != 0;
+        uint8_t rep = r & 0x7f;
+
+        if (rep < 32)
+            return binaryFixedToObject(static_cast<int32_t>(binaryReadU32(p, lowFirst)), rep, obj);
+
+        if (rep < 48)
+            return binaryFixedToObject(static_cast<int16_t>(binaryReadU16(p, lowFirst)), rep - 32, obj);
+
+        if (rep < 50)
+            return obj.resetFromReal(binaryReadReal(p, lowFirst));
+
+        return false;
+    }
+
+    // The system names, interned once, so decoding one is a table lookup
+    static inline const PSName* binarySystemNameTable() noexcept
+    {
+        static const std::vector<PSName> sNames(kBinarySystemNames, kBinarySystemNames + kBinarySystemNameCount);
+        return sNames.data();
+    }
+
+    static INLINE bool binarySystemName(uint32_t index, bool executable, PSObject& obj) noexcept
+    {
+        if (index >= kBinarySystemNameCount) {
+            // Not in the table; executing it says which index it was
+            char text[32];
+            std::snprintf(text, sizeof(text), "system name index %u", index);
+            obj.resetFromName(PSName(text));
+            obj.setExecutable(true);
+            return true;
+        }
+
+        obj.resetFromName(binarySystemNameTable()[index]);
+        obj.setExecutable(executable);
+        return true;
+    }
+
+    // decodeBinaryToken
+    // A single binary token, 132 to 149.  'span' is exactly the bytes of
+    // the token, as the lexer found them.
+    static bool decodeBinaryToken(const OctetCursor& span, PSObject& obj)
+    {
+        const uint8_t* p = span.data();
+        size_t len = span.size();
+
+        if (len < 2)
+            return false;
+
+        switch (p[0]) {
+        case 132: case 133:     // 32 bit integer
+            return len >= 5 && obj.resetFromInt(static_cast<int32_t>(binaryReadU32(p + 1, p[0] == 133)));
+
+        case 134: case 135:     // 16 bit integer
+            return len >= 3 && obj.resetFromInt(static_cast<int16_t>(binaryReadU16(p + 1, p[0] == 135)));
+
+        case 136:               // 8 bit integer
+            return obj.resetFromInt(static_cast<int8_t>(p[1]));
+
+        case 137: {             // fixed point
+            uint8_t r = p[1];
+            size_t size = binaryNumberSize(r);
+            if ((r & 0x7f) >= 48 || len < 2 + size)
+                return false;
+            return binaryReadNumber(p + 2, r, obj);
+        }
+
+        case 138: case 139: case 140:   // 32 bit real
+            return len >= 5 && obj.resetFromReal(binaryReadReal(p + 1, p[0] == 139));
+
+        case 141:               // boolean
+            return obj.resetFromBool(p[1] != 0);
+
+        case 142: {             // string, 8 bit length
+            size_t n = p[1];
+            return len >= 2 + n && obj.resetFromString(PSString::fromSpan(p + 2, n));
+        }
+
+        case 143: case 144: {   // string, 16 bit length
+            if (len < 3) return false;
+            size_t n = binaryReadU16(p + 1, p[0] == 144);
+            return len >= 3 + n && obj.resetFromString(PSString::fromSpan(p + 3, n));
+        }
+
+        case 145: case 146:     // system name, literal or executable
+            return binarySystemName(p[1], p[0] == 146, obj);
+
+        case 149: {             // homogeneous number array
+            if (len < 4) return false;
+            uint8_t r = p[1];
+            size_t size = binaryNumberSize(r);
+            size_t count = binaryReadU16(p + 2, (r & 0x80) != 0);
+            if (size == 0 || len < 4 + count * size)
+                return false;
+
+            auto arr = PSArray::create(count);
+            const uint8_t* q = p + 4;
+            for (size_t i = 0; i < count; ++i, q += size) {
+                if (!binaryReadNumber(q, r, arr->elements[i]))
+                    return false;
+            }
+            return obj.resetFromArray(arr);
+        }
+
+        default:                // user names, and the unassigned codes
+            return false;
+        }
+    }
+
+    // One object of a binary object sequence.  'base' is the start of the
+    // top level array, which all offsets are relative to, and 'size' the
+    // number of bytes from there to the end of the sequence.
+    static bool decodeBinaryObject(const uint8_t* base, size_t size, const uint8_t* p, bool lowFirst, int depth, PSObject& obj)
+    {
+        bool executable = (p[0] & 0x80) != 0;
+        auto type = static_cast<PSBinaryObjectType>(p[0] & 0x7f);
+        uint16_t length = binaryReadU16(p + 2, lowFirst);
+        uint32_t value = binaryReadU32(p + 4, lowFirst);
+
+        switch (type) {
+        case PSBinaryObjectType::Null:
+            obj.reset();
+            break;
+
+        case PSBinaryObjectType::Integer:
+            obj.resetFromInt(static_cast<int32_t>(value));
+            break;
+
+        case PSBinaryObjectType::Real:
+            // length is the scale of a fixed point number, 0 for a real
+            if (length == 0) {
+                float f;
+                std::memcpy(&f, &value, sizeof(f));
+                obj.resetFromReal(f);
+            }
+            else if (length < 32) {
+                binaryFixedToObject(static_cast<int32_t>(value), length, obj);
+            }
+            else
+                return false;
+            break;
+
+        case PSBinaryObjectType::Boolean:
+            obj.resetFromBool(value != 0);
+            break;
+
+        case PSBinaryObjectType::String:
+            if (value > size || length > size - value)
+                return false;
+            obj.resetFromString(PSString::fromSpan(base + value, length));
+            break;
+
+        case PSBinaryObjectType::Name:
+        case PSBinaryObjectType::ImmediateName:
+            // length 0xffff (-1) is an index into the system name table, 0 the
+            // user name table, anything else is the length of the text at 'value'
+            if (length == 0xffff) {
+                binarySystemName(value, true, obj);
+                if (value >= kBinarySystemNameCount)
+                    return true;
+            }
+            else if (length == 0) {
+                return false;
+            }
+            else {
+                if (value > size || length > size - value)
+                    return false;
+                obj.resetFromName(PSName(reinterpret_cast<const char*>(base + value), length));
+            }
+
+            // An immediately evaluated name is //name
+            if (type == PSBinaryObjectType::ImmediateName) {
+                obj.setExecutable(true);
+                obj.setSystemOp(true);
+                return true;
+            }
+            break;
+
+        case PSBinaryObjectType::Array: {
+            if (depth > 32 || value > size || size_t(length) * 8 > size - value)
+                return false;
+
+            auto arr = PSArray::create(length);
+            for (size_t i = 0; i < length; ++i) {
+                if (!decodeBinaryObject(base, size, base + value + i * 8, lowFirst, depth + 1, arr->elements[i]))
+                    return false;
+            }
+            obj.resetFromArray(arr);
+            break;
+        }
+
+        case PSBinaryObjectType::Mark:
+            obj.resetFromMark(PSMark());
+            break;
+
+        default:
+            return false;
+        }
+
+        obj.setExecutable(executable);
+        return true;
+    }
+
+    // decodeBinaryObjectSequence
+    // A whole binary object sequence, 128 to 131, becomes an executable
+    // array of its top level objects.
+    //   128, 130   high-order byte first
+    //   129, 131   low-order byte first
+    // The header is 4 bytes; the token, the number of top level objects,
+    // and the length of the whole sequence.  When there are more than
+    // 255 top level objects, the count byte is 0 and the header is 8 bytes
+    // with a 16 bit count and a 32 bit length.
+    static bool decodeBinaryObjectSequence(const OctetCursor& span, PSObject& obj)
+    {
+        const uint8_t* p = span.data();
+        size_t len = span.size();
+
+        if (len < 4 || p[0] < 128 || p[0] > 131)
+            return false;
+
+        bool lowFirst = (p[0] & 1) != 0;
+        size_t headerSize = 4;
+        size_t count = p[1];
+        size_t total = binaryReadU16(p + 2, lowFirst);
+
+        if (count == 0) {
+            if (len < 8)
+                return false;
+            headerSize = 8;
+            count = binaryReadU16(p + 2, lowFirst);
+            total = binaryReadU32(p + 4, lowFirst);
+        }
+
+        if (total > len || total < headerSize + count * 8)
+            return false;
+
+        const uint8_t* base = p + headerSize;
+        size_t size = total - headerSize;
+
+        auto arr = PSArray::create(count);
+        for (size_t i = 0; i < count; ++i) {
+            if (!decodeBinaryObject(base, size, base + i * 8, lowFirst, 0, arr->elements[i]))
+                return false;
+        }
+
+        obj.resetFromArray(arr);
+        obj.setExecutable(true);
+        return true;
+    }
+}
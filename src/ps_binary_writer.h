@@ -0,0 +1,236 @@
+#pragma once
+
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+
+#include "ps_binary_token.h"
+#include "ps_scanner.h"
+#include "typeconv.h"
+
+//
+// Turn ASCII PostScript into its binary token equivalent (PLRM 3.14.2).
+// Numbers, strings, booleans and the names in the system name table
+// become binary tokens.  Everything else; other names, braces, brackets,
+// is kept as text, which the scanner reads mixed in with binary tokens.
+// Comments are dropped, except for '%!' and the DSC '%%' lines, so the
+// document structure is kept.
+//
+// Data that the program reads for itself cannot be told apart from
+// program text, so once 'currentfile' is seen, the rest of the document
+// is copied exactly as it is.  The same goes for an eexec section.
+//
+// Reals are written as 32 bit IEEE numbers, the precision PostScript
+// gives reals, so a real with more than 7 significant digits is rounded.
+//
+
+namespace waavs
+{
+    struct PSBinaryWriter
+    {
+        std::vector<uint8_t>& fOut;
+
+        explicit PSBinaryWriter(std::vector<uint8_t>& out) : fOut(out) {}
+
+        // Index of a name in the system name table, -1 if it is not there
+        static int systemNameIndex(const PSName& name)
+        {
+            static const std::unordered_map<const char*, int> sIndex = [] {
+                std::unordered_map<const char*, int> m;
+                for (size_t i = 0; i < kBinarySystemNameCount; ++i)
+                    m[PSName(kBinarySystemNames[i]).c_str()] = static_cast<int>(i);
+                return m;
+            }();
+
+            auto it = sIndex.find(name.c_str());
+            return it == sIndex.end() ? -1 : it->second;
+        }
+
+        void putByte(uint8_t b) { fOut.push_back(b); }
+
+        void putBytes(const uint8_t* p, size_t n) { fOut.insert(fOut.end(), p, p + n); }
+
+        void putU16(uint32_t v) { putByte(uint8_t(v >> 8)); putByte(uint8_t(v)); }
+
+        void putU32(uint32_t v) { putU16(v >> 16); putU16(v & 0xffff); }
+
+        // Text that has to be kept as text, with a space after it, so
+        // it does not run into whatever comes next
+        void putText(const OctetCursor& text)
+        {
+            putBytes(text.data(), text.size());
+            putByte(' ');
+        }
+
+        // A line of its own, for comments that have to be kept
+        void putLine(const OctetCursor& text)
+        {
+            if (!fOut.empty() && fOut.back() != '\n' && fOut.back() != '\r')
+                putByte('\n');
+            putBytes(text.data(), text.size());
+            putByte('\n');
+        }
+
+        void putInteger(int32_t v)
+        {
+            if (v >= INT8_MIN && v <= INT8_MAX) {
+                putByte(136);
+                putByte(static_cast<uint8_t>(v));
+            }
+            else if (v >= INT16_MIN && v <= INT16_MAX) {
+                putByte(134);
+                putU16(static_cast<uint16_t>(v));
+            }
+            else {
+                putByte(132);
+                putU32(static_cast<uint32_t>(v));
+            }
+        }
+
+        void putReal(double v)
+        {
+            float f = static_cast<float>(v);
+            uint32_t bits;
+            std::memcpy(&bits, &f, sizeof(bits));
+            putByte(138);
+            putU32(bits);
+        }
+
+        // Strings longer than a 16 bit length can hold stay as hex text
+        void putString(const PSString& str)
+        {
+            size_t n = str.length();
+            if (n <= 255) {
+                putByte(142);
+                putByte(static_cast<uint8_t>(n));
+            }
+            else if (n <= 0xffff) {
+                putByte(143);
+                putU16(static_cast<uint32_t>(n));
+            }
+            else {
+                static const char* kHex = "0123456789abcdef";
+                putByte('<');
+                for (size_t i = 0; i < n; ++i) {
+                    putByte(kHex[str.get(static_cast<uint32_t>(i)) >> 4]);
+                    putByte(kHex[str.get(static_cast<uint32_t>(i)) & 0x0f]);
+                }
+                putByte('>');
+                return;
+            }
+            putBytes(str.data(), n);
+        }
+
+        // A name, literal or executable; from the system name table when
+        // it is there, as text otherwise
+        void putName(const OctetCursor& text, bool executable)
+        {
+            int index = systemNameIndex(PSName(text));
+            if (index >= 0) {
+                putByte(executable ? 146 : 145);
+                putByte(static_cast<uint8_t>(index));
+                return;
+            }
+
+            if (!executable)
+                putByte('/');
+            putText(text);
+        }
+
+        // Write the binary equivalent of everything in 'src'
+        bool encode(const OctetCursor& src)
+        {
+            auto file = PSMemoryFile::create(src);
+            PSLexeme lex;
+
+            while (nextPSLexeme(file, lex)) {
+                switch (lex.type) {
+                case PSLexType::Whitespace:
+                    break;
+
+                case PSLexType::Comment:
+                    if (lex.span.size() >= 2 && lex.span.data()[1] == '!')
+                        putLine(lex.span);
+                    break;
+
+                case PSLexType::DSCComment:
+                    putLine(lex.span);
+                    break;
+
+                case PSLexType::Number: {
+                    PSObject num;
+                    if (!objectFromLex(lex, num) || !num.isNumber())
+                        putText(lex.span);
+                    else if (num.type == PSObjectType::Int)
+                        putInteger(num.asInt());
+                    else
+                        putReal(num.asReal());
+                    break;
+                }
+
+                case PSLexType::String:
+                case PSLexType::HexString: {
+                    PSObject str;
+                    if (!objectFromLex(lex, str))
+                        return false;
+                    putString(str.asString());
+                    break;
+                }
+
+                case PSLexType::LiteralName:
+                    putName(lex.span, false);
+                    break;
+
+                case PSLexType::Name:
+                    if (lex.span == "true" || lex.span == "false") {
+                        putByte(141);
+                        putByte(lex.span == "true" ? 1 : 0);
+                    }
+                    else if (lex.span == "currentfile") {
+                        // What follows may be data, copy it all as it is
+                        putName(lex.span, true);
+                        const OctetCursor& rest = file->getCursor();
+                        putBytes(rest.data(), rest.size());
+                        return true;
+                    }
+                    else {
+                        putName(lex.span, true);
+                    }
+                    break;
+
+                case PSLexType::SystemName:
+                    putByte('/');
+                    putByte('/');
+                    putText(lex.span);
+                    break;
+
+                case PSLexType::UnterminatedString: {
+                    // Not something that can be encoded, keep the rest as text
+                    putByte(lex.span.data()[-1]);
+                    putBytes(lex.span.data(), lex.span.size());
+                    return true;
+                }
+
+                case PSLexType::Eof:
+                    return true;
+
+                default:
+                    // brackets, braces, delimiters, and binary tokens
+                    // that were already there, stay as they are
+                    putBytes(lex.span.data(), lex.span.size());
+                    break;
+                }
+            }
+
+            return true;
+        }
+    };
+
+    // encodeBinaryTokens
+    // The binary token encoding of the ASCII program in 'src'
+    static inline bool encodeBinaryTokens(const OctetCursor& src, std::vector<uint8_t>& out)
+    {
+        PSBinaryWriter writer(out);
+        return writer.encode(src);
+    }
+}
@@ -0,0 +1,339 @@
+#pragma once
+
+#include "definitions.h"
+#include "ps_charcats.h"
+
+//
+// Character class scanning
+//
+// The scanner spends most of its time stepping over runs of one class of
+// character: whitespace between tokens, the characters of a name, the body
+// of a comment.  The functions here find the end of such a run, 16 or 32
+// bytes at a time where the processor can, and a byte at a time through the
+// PSCharClass table where it can not, and for the last few bytes.
+//
+// The kernel is picked when compiling:
+//   AVX2   32 bytes a step, when compiled with AVX2 enabled (/arch:AVX2, -mavx2)
+//   SSE2   16 bytes a step, any x64 build
+//   NEON   16 bytes a step, ARM64
+// Define WAAVS_CHARSCAN_SCALAR to use the table everywhere.
+//
+// The classes match the table exactly:
+//   whitespace  NUL, tab, newline, formfeed, return, space
+//   name chars  '!' through '~', except the delimiters % ( ) / < > [ ] { }
+//
+
+#if !defined(WAAVS_CHARSCAN_SCALAR)
+    #if defined(__AVX2__)
+        #include <immintrin.h>
+        #define WAAVS_CHARSCAN_AVX2 1
+        #define WAAVS_CHARSCAN_SSE2 1
+    #elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #include <emmintrin.h>
+        #define WAAVS_CHARSCAN_SSE2 1
+    #elif defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+        #include <arm_neon.h>
+        #define WAAVS_CHARSCAN_NEON 1
+    #endif
+#endif
+
+#if defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+namespace waavs {
+
+    // Index of the lowest set bit, 'bits' must not be zero
+    static INLINE uint32_t lowestBitIndex(uint32_t bits) noexcept
+    {
+#if defined(_MSC_VER)
+        unsigned long idx;
+        _BitScanForward(&idx, bits);
+        return static_cast<uint32_t>(idx);
+#else
+        return static_cast<uint32_t>(__builtin_ctz(bits));
+#endif
+    }
+
+    static INLINE uint32_t lowestBitIndex64(uint64_t bits) noexcept
+    {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+        unsigned long idx;
+        _BitScanForward64(&idx, bits);
+        return static_cast<uint32_t>(idx);
+#elif defined(_MSC_VER)
+        uint32_t lo = static_cast<uint32_t>(bits);
+        return lo ? lowestBitIndex(lo) : 32 + lowestBitIndex(static_cast<uint32_t>(bits >> 32));
+#else
+        return static_cast<uint32_t>(__builtin_ctzll(bits));
+#endif
+    }
+
+    // Runs are mostly short, a space between two tokens, a name of a few
+    // letters.  So the first few bytes of a run are looked at one at a time,
+    // and only a run longer than that is handed to the vector loop.
+    static constexpr ptrdiff_t kCharScanHead = 8;
+
+    // --------------------
+    // Scalar, through the table.  These are the reference, and
+    // finish off whatever is too short for a vector step.
+    // --------------------
+    static INLINE const uint8_t* scanWhileClass(const uint8_t* p, const uint8_t* end, uint8_t categoryMask) noexcept
+    {
+        while (p < end && PSCharClass::is(*p, categoryMask))
+            ++p;
+        return p;
+    }
+
+    static INLINE const uint8_t* scanLineEndScalar(const uint8_t* p, const uint8_t* end) noexcept
+    {
+        while (p < end && *p != '\n' && *p != '\r')
+            ++p;
+        return p;
+    }
+
+
+#if defined(WAAVS_CHARSCAN_SSE2)
+    // Each returns 0xFF in the lanes that are in the class
+    static INLINE __m128i wsLanes16(__m128i v) noexcept
+    {
+        __m128i m = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\f')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+        return m;
+    }
+
+    static INLINE __m128i nameLanes16(__m128i v) noexcept
+    {
+        // printable, bytes >= 0x80 are negative, so fall outside
+        __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x20)), _mm_cmplt_epi8(v, _mm_set1_epi8(0x7F)));
+
+        // the delimiters, pairs folded together by setting the bit between them
+        __m128i d = _mm_cmpeq_epi8(v, _mm_set1_epi8('%'));
+        d = _mm_or_si128(d, _mm_cmpeq_epi8(v, _mm_set1_epi8('/')));
+        d = _mm_or_si128(d, _mm_cmpeq_epi8(_mm_or_si128(v, _mm_set1_epi8(0x01)), _mm_set1_epi8(')')));    // ( )
+        d = _mm_or_si128(d, _mm_cmpeq_epi8(_mm_or_si128(v, _mm_set1_epi8(0x02)), _mm_set1_epi8('>')));    // < >
+        __m128i v20 = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        d = _mm_or_si128(d, _mm_cmpeq_epi8(v20, _mm_set1_epi8('{')));                                     // [ {
+        d = _mm_or_si128(d, _mm_cmpeq_epi8(v20, _mm_set1_epi8('}')));                                     // ] }
+
+        return _mm_andnot_si128(d, printable);
+    }
+
+    static INLINE __m128i lineEndLanes16(__m128i v) noexcept
+    {
+        return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+    }
+
+    static INLINE __m128i stringSpecialLanes16(__m128i v) noexcept
+    {
+        __m128i m = _mm_cmpeq_epi8(_mm_or_si128(v, _mm_set1_epi8(0x01)), _mm_set1_epi8(')'));    // ( )
+        return _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+    }
+#endif
+
+#if defined(WAAVS_CHARSCAN_AVX2)
+    static INLINE __m256i wsLanes32(__m256i v) noexcept
+    {
+        __m256i m = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\f')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+        return m;
+    }
+
+    static INLINE __m256i nameLanes32(__m256i v) noexcept
+    {
+        __m256i printable = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(0x20)), _mm256_cmpgt_epi8(_mm256_set1_epi8(0x7F), v));
+
+        __m256i d = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('%'));
+        d = _mm256_or_si256(d, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('/')));
+        d = _mm256_or_si256(d, _mm256_cmpeq_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x01)), _mm256_set1_epi8(')')));
+        d = _mm256_or_si256(d, _mm256_cmpeq_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x02)), _mm256_set1_epi8('>')));
+        __m256i v20 = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        d = _mm256_or_si256(d, _mm256_cmpeq_epi8(v20, _mm256_set1_epi8('{')));
+        d = _mm256_or_si256(d, _mm256_cmpeq_epi8(v20, _mm256_set1_epi8('}')));
+
+        return _mm256_andnot_si256(d, printable);
+    }
+
+    static INLINE __m256i lineEndLanes32(__m256i v) noexcept
+    {
+        return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+    }
+
+    static INLINE __m256i stringSpecialLanes32(__m256i v) noexcept
+    {
+        __m256i m = _mm256_cmpeq_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x01)), _mm256_set1_epi8(')'));
+        return _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+    }
+#endif
+
+#if defined(WAAVS_CHARSCAN_NEON)
+    static INLINE uint8x16_t wsLanes16(uint8x16_t v) noexcept
+    {
+        uint8x16_t m = vceqq_u8(v, vdupq_n_u8(' '));
+        m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8('\n')));
+        m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8('\r')));
+        m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8('\t')));
+        m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8('\f')));
+        m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8(0)));
+        return m;
+    }
+
+    static INLINE uint8x16_t nameLanes16(uint8x16_t v) noexcept
+    {
+        uint8x16_t printable = vandq_u8(vcgeq_u8(v, vdupq_n_u8(0x21)), vcleq_u8(v, vdupq_n_u8(0x7E)));
+
+        uint8x16_t d = vceqq_u8(v, vdupq_n_u8('%'));
+        d = vorrq_u8(d, vceqq_u8(v, vdupq_n_u8('/')));
+        d = vorrq_u8(d, vceqq_u8(vorrq_u8(v, vdupq_n_u8(0x01)), vdupq_n_u8(')')));
+        d = vorrq_u8(d, vceqq_u8(vorrq_u8(v, vdupq_n_u8(0x02)), vdupq_n_u8('>')));
+        uint8x16_t v20 = vorrq_u8(v, vdupq_n_u8(0x20));
+        d = vorrq_u8(d, vceqq_u8(v20, vdupq_n_u8('{')));
+        d = vorrq_u8(d, vceqq_u8(v20, vdupq_n_u8('}')));
+
+        return vbicq_u8(printable, d);
+    }
+
+    static INLINE uint8x16_t lineEndLanes16(uint8x16_t v) noexcept
+    {
+        return vorrq_u8(vceqq_u8(v, vdupq_n_u8('\n')), vceqq_u8(v, vdupq_n_u8('\r')));
+    }
+
+    static INLINE uint8x16_t stringSpecialLanes16(uint8x16_t v) noexcept
+    {
+        uint8x16_t m = vceqq_u8(vorrq_u8(v, vdupq_n_u8(0x01)), vdupq_n_u8(')'));
+        return vorrq_u8(m, vceqq_u8(v, vdupq_n_u8('\\')));
+    }
+
+    // 4 bits for each lane, set for the lanes that are 0xFF
+    static INLINE uint64_t laneBits16(uint8x16_t m) noexcept
+    {
+        return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+    }
+#endif
+
+    // The vector loops.  'LANES' gives the lanes in the class, and 'stopIn'
+    // says whether the run stops at the first lane in the class, or the
+    // first one out of it.
+#if defined(WAAVS_CHARSCAN_AVX2)
+#define WAAVS_CHARSCAN_STEP32(LANES, stopIn)                                                        \
+        while (end - p >= 32) {                                                                     \
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));                    \
+            uint32_t bits = static_cast<uint32_t>(_mm256_movemask_epi8(LANES(v)));                  \
+            if (!(stopIn)) bits = ~bits;                                                            \
+            if (bits) return p + lowestBitIndex(bits);                                              \
+            p += 32;                                                                                \
+        }
+#else
+#define WAAVS_CHARSCAN_STEP32(LANES, stopIn)
+#endif
+
+#if defined(WAAVS_CHARSCAN_SSE2)
+#define WAAVS_CHARSCAN_STEP16(LANES, stopIn)                                                        \
+        while (end - p >= 16) {                                                                     \
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));                       \
+            uint32_t bits = static_cast<uint32_t>(_mm_movemask_epi8(LANES(v)));                     \
+            if (!(stopIn)) bits = ~bits & 0xFFFFu;                                                  \
+            if (bits) return p + lowestBitIndex(bits);                                              \
+            p += 16;                                                                                \
+        }
+#elif defined(WAAVS_CHARSCAN_NEON)
+#define WAAVS_CHARSCAN_STEP16(LANES, stopIn)                                                        \
+        while (end - p >= 16) {                                                                     \
+            uint8x16_t m = LANES(vld1q_u8(p));                                                      \
+            if (!(stopIn)) m = vmvnq_u8(m);                                                         \
+            uint64_t bits = laneBits16(m);                                                          \
+            if (bits) return p + (lowestBitIndex64(bits) >> 2);                                     \
+            p += 16;                                                                                \
+        }
+#else
+#define WAAVS_CHARSCAN_STEP16(LANES, stopIn)
+#endif
+
+    // Looks at the first kCharScanHead bytes one at a time, 'stop' says 
+    // when the run is over
+#define WAAVS_CHARSCAN_HEAD(stop)                                                                   \
+        for (const uint8_t* head = p + (end - p < kCharScanHead ? end - p : kCharScanHead); p < head; ++p) { \
+            if (stop) return p;                                                                     \
+        }
+
+    // The first byte at or after 'p' that is not whitespace
+    static INLINE const uint8_t* scanWhitespace(const uint8_t* p, const uint8_t* end) noexcept
+    {
+        WAAVS_CHARSCAN_HEAD(!PSCharClass::isWhitespace(*p))
+        WAAVS_CHARSCAN_STEP32(wsLanes32, false)
+        WAAVS_CHARSCAN_STEP16(wsLanes16, false)
+        return scanWhileClass(p, end, PS_WHITESPACE);
+    }
+
+    // The first byte at or after 'p' that can not be part of a name
+    static INLINE const uint8_t* scanNameChars(const uint8_t* p, const uint8_t* end) noexcept
+    {
+        WAAVS_CHARSCAN_HEAD(!PSCharClass::isNameChar(*p))
+        WAAVS_CHARSCAN_STEP32(nameLanes32, false)
+        WAAVS_CHARSCAN_STEP16(nameLanes16, false)
+        return scanWhileClass(p, end, PS_NAME_CHAR);
+    }
+
+    // The first '\n' or '\r' at or after 'p'
+    static INLINE const uint8_t* scanLineEnd(const uint8_t* p, const uint8_t* end) noexcept
+    {
+        WAAVS_CHARSCAN_HEAD(*p == '\n' || *p == '\r')
+        WAAVS_CHARSCAN_STEP32(lineEndLanes32, true)
+        WAAVS_CHARSCAN_STEP16(lineEndLanes16, true)
+        return scanLineEndScalar(p, end);
+    }
+
+    static INLINE const uint8_t* scanStringSpecialScalar(const uint8_t* p, const uint8_t* end) noexcept
+    {
+        while (p < end && *p != '(' && *p != ')' && *p != '\\')
+            ++p;
+        return p;
+    }
+
+    // The first byte at or after 'p' that means something inside a 
+    // string literal: '(', ')' or '\\'
+    static INLINE const uint8_t* scanStringSpecial(const uint8_t* p, const uint8_t* end) noexcept
+    {
+        WAAVS_CHARSCAN_HEAD(*p == '(' || *p == ')' || *p == '\\')
+        WAAVS_CHARSCAN_STEP32(stringSpecialLanes32, true)
+        WAAVS_CHARSCAN_STEP16(stringSpecialLanes16, true)
+        return scanStringSpecialScalar(p, end);
+    }
+
+#undef WAAVS_CHARSCAN_HEAD
+#undef WAAVS_CHARSCAN_STEP32
+#undef WAAVS_CHARSCAN_STEP16
+
+    // Scan for a run of the given category.  Whitespace and name runs
+    // go through the vector kernels, anything else through the table.
+    static INLINE const uint8_t* scanWhile(const uint8_t* p, const uint8_t* end, uint8_t categoryMask) noexcept
+    {
+        if (categoryMask == PS_WHITESPACE)
+            return scanWhitespace(p, end);
+        if (categoryMask == PS_NAME_CHAR)
+            return scanNameChars(p, end);
+        return scanWhileClass(p, end, categoryMask);
+    }
+
+    // Which kernel this build uses
+    static constexpr const char* charScanKernel() noexcept
+    {
+#if defined(WAAVS_CHARSCAN_AVX2)
+        return "AVX2";
+#elif defined(WAAVS_CHARSCAN_SSE2)
+        return "SSE2";
+#elif defined(WAAVS_CHARSCAN_NEON)
+        return "NEON";
+#else
+        return "scalar";
+#endif
+    }
+}
@@ -0,0 +1,548 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+//
+// Deflate
+//
+// Compression into zlib streams (RFC 1950) of deflate data (RFC 1951),
+// for the FlateEncode filter.  The other half of ps_inflate.h.
+//
+// Data is taken a block at a time.  Matches are found through a hash of
+// the next three bytes, and a chain of earlier places with the same hash,
+// reaching back over the last 32K, which is kept from block to block.
+// Each block goes out with Huffman codes made for it, or stored as it
+// is, if that is smaller, as it is for data that does not compress.
+//
+
+namespace waavs {
+
+    class PSDeflater
+    {
+    public:
+        static constexpr size_t kWindowSize = 32 * 1024;
+        static constexpr size_t kBlockSize = 64 * 1024;     // input per deflate block
+
+        PSDeflater()
+            : fData(kWindowSize + kBlockSize)
+            , fPrev(kWindowSize + kBlockSize)
+            , fHead(kHashSize, -1)
+        {
+            fSymbols.reserve(kBlockSize);
+        }
+
+        // Compress 'count' bytes, appending the compressed data to 'out'.
+        // 'last' ends the stream; the final block, and the checksum.
+        void compress(const uint8_t* data, size_t count, bool last, std::vector<uint8_t>& out)
+        {
+            if (!fStarted) {
+                out.push_back(0x78);
+                out.push_back(0x9C);
+                fStarted = true;
+            }
+
+            while (count > 0) {
+                size_t chunk = std::min(count, kBlockSize);
+                data = addBlock(data, chunk);
+                count -= chunk;
+                compressBlock(last && count == 0, out);
+            }
+
+            if (!last)
+                return;
+
+            // Nothing at all, or nothing since the last block; an empty
+            // final block, with fixed codes, is just its end of block
+            if (!fFinished) {
+                putBits(out, 3, 3);     // final, fixed
+                putBits(out, 0, 7);     // end of block
+            }
+
+            // To a byte boundary, then the checksum, high byte first
+            flushBits(out, true);
+            uint32_t adler = (fAdlerB << 16) | fAdlerA;
+            for (int shift = 24; shift >= 0; shift -= 8)
+                out.push_back(static_cast<uint8_t>(adler >> shift));
+        }
+
+    private:
+        static constexpr int kHashBits = 15;
+        static constexpr size_t kHashSize = size_t(1) << kHashBits;
+        static constexpr int kMaxChain = 32;
+        static constexpr size_t kMinMatch = 3;
+        static constexpr size_t kMaxMatch = 258;
+        static constexpr uint32_t kMatchFlag = 0x80000000u;
+
+        // Put the block after what is kept of the window, sliding the
+        // window down first if there is not room for it
+        const uint8_t* addBlock(const uint8_t* data, size_t count)
+        {
+            if (fEnd + count > fData.size()) {
+                size_t keep = std::min(fEnd, kWindowSize);
+                size_t shift = fEnd - keep;
+                std::memmove(fData.data(), fData.data() + shift, keep);
+                for (auto& h : fHead)
+                    h = h >= static_cast<int32_t>(shift) ? h - static_cast<int32_t>(shift) : -1;
+                for (size_t i = 0; i < keep; ++i) {
+                    int32_t p = fPrev[i + shift];
+                    fPrev[i] = p >= static_cast<int32_t>(shift) ? p - static_cast<int32_t>(shift) : -1;
+                }
+                fEnd = keep;
+            }
+
+            std::memcpy(fData.data() + fEnd, data, count);
+            updateAdler(data, count);
+            fBlockStart = fEnd;
+            fEnd += count;
+
+            return data + count;
+        }
+
+        void updateAdler(const uint8_t* p, size_t count) noexcept
+        {
+            // 5552 is the most bytes that can be summed before the sums
+            // have to be reduced
+            while (count > 0) {
+                size_t n = std::min<size_t>(count, 5552);
+                count -= n;
+                uint32_t a = fAdlerA, b = fAdlerB;
+                for (size_t i = 0; i < n; ++i) {
+                    a += p[i];
+                    b += a;
+                }
+                p += n;
+                fAdlerA = a % 65521;
+                fAdlerB = b % 65521;
+            }
+        }
+
+        static uint32_t hash3(const uint8_t* p) noexcept
+        {
+            uint32_t v = (uint32_t(p[0]) << 16) | (uint32_t(p[1]) << 8) | p[2];
+            return (v * 2654435761u) >> (32 - kHashBits);
+        }
+
+        static size_t matchLength(const uint8_t* a, const uint8_t* b, size_t limit) noexcept
+        {
+            size_t n = 0;
+            while (n + 8 <= limit) {
+                uint64_t x, y;
+                std::memcpy(&x, a + n, 8);
+                std::memcpy(&y, b + n, 8);
+                if (x != y) {
+                    uint64_t diff = x ^ y;
+#if defined(_MSC_VER)
+                    unsigned long idx;
+                    _BitScanForward64(&idx, diff);
+                    return n + idx / 8;
+#else
+                    return n + static_cast<size_t>(__builtin_ctzll(diff)) / 8;
+#endif
+                }
+                n += 8;
+            }
+            while (n < limit && a[n] == b[n])
+                ++n;
+            return n;
+        }
+
+        void insert(size_t pos) noexcept
+        {
+            uint32_t h = hash3(fData.data() + pos);
+            fPrev[pos] = fHead[h];
+            fHead[h] = static_cast<int32_t>(pos);
+        }
+
+        // Turn the new block into literals and matches
+        void findMatches()
+        {
+            const uint8_t* base = fData.data();
+            size_t pos = fBlockStart;
+
+            fSymbols.clear();
+            std::fill(std::begin(fLiteralFreq), std::end(fLiteralFreq), 0u);
+            std::fill(std::begin(fDistanceFreq), std::end(fDistanceFreq), 0u);
+
+            while (pos < fEnd) {
+                size_t avail = std::min(fEnd - pos, kMaxMatch);
+                size_t bestLength = 0;
+                size_t bestDistance = 0;
+
+                if (avail >= kMinMatch) {
+                    uint32_t h = hash3(base + pos);
+                    int32_t candidate = fHead[h];
+                    int chain = kMaxChain;
+                    while (candidate >= 0 && chain-- > 0) {
+                        size_t distance = pos - static_cast<size_t>(candidate);
+                        if (distance > kWindowSize)
+                            break;
+
+                        // Only worth a full compare if it could be longer
+                        if (base[candidate + bestLength] == base[pos + bestLength] || bestLength == 0) {
+                            size_t length = matchLength(base + candidate, base + pos, avail);
+                            if (length > bestLength) {
+                                bestLength = length;
+                                bestDistance = distance;
+                                if (length == avail)
+                                    break;
+                            }
+                        }
+                        candidate = fPrev[candidate];
+                    }
+                    fPrev[pos] = fHead[h];
+                    fHead[h] = static_cast<int32_t>(pos);
+                }
+
+                if (bestLength >= kMinMatch) {
+                    fSymbols.push_back(kMatchFlag | (static_cast<uint32_t>(bestLength) << 16) | static_cast<uint32_t>(bestDistance));
+                    ++fLiteralFreq[257 + lengthCode(bestLength)];
+                    ++fDistanceFreq[distanceCode(bestDistance)];
+
+                    size_t end = pos + bestLength;
+                    size_t hashEnd = fEnd >= kMinMatch ? fEnd - kMinMatch + 1 : 0;
+                    for (++pos; pos < end; ++pos)
+                        if (pos < hashEnd)
+                            insert(pos);
+                }
+                else {
+                    fSymbols.push_back(base[pos]);
+                    ++fLiteralFreq[base[pos]];
+                    ++pos;
+                }
+            }
+
+            ++fLiteralFreq[256];
+        }
+
+        static uint32_t lengthCode(size_t length) noexcept
+        {
+            static constexpr uint16_t kBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+            uint32_t code = 28;
+            while (kBase[code] > length)
+                --code;
+            return code;
+        }
+
+        static uint32_t distanceCode(size_t distance) noexcept
+        {
+            // Two codes for each power of two, past the first four
+            if (distance <= 4)
+                return static_cast<uint32_t>(distance - 1);
+            uint32_t d = static_cast<uint32_t>(distance - 1);
+#if defined(_MSC_VER)
+            unsigned long top;
+            _BitScanReverse(&top, d);
+            uint32_t bits = static_cast<uint32_t>(top);
+#else
+            uint32_t bits = 31 - static_cast<uint32_t>(__builtin_clz(d));
+#endif
+            return bits * 2 + ((d >> (bits - 1)) & 1);
+        }
+
+        // Code lengths of at most 'maxLength' bits for the frequencies,
+        // through a Huffman tree, then shortened if it is too deep
+        static void buildLengths(const uint32_t* freq, int count, int maxLength, uint8_t* lengths)
+        {
+            std::memset(lengths, 0, count);
+
+            struct Node { uint32_t freq; int left; int right; };
+            std::vector<Node> nodes;
+            std::vector<int> symbolNode(count, -1);
+            for (int i = 0; i < count; ++i) {
+                if (freq[i]) {
+                    symbolNode[i] = static_cast<int>(nodes.size());
+                    nodes.push_back({ freq[i], -1, i });
+                }
+            }
+
+            // A code needs at least two symbols
+            for (int i = 0; nodes.size() < 2 && i < count; ++i) {
+                if (symbolNode[i] < 0) {
+                    symbolNode[i] = static_cast<int>(nodes.size());
+                    nodes.push_back({ 1, -1, i });
+                }
+            }
+
+            size_t leaves = nodes.size();
+
+            // Two queues; the leaves by frequency, and the joined nodes,
+            // which are made in order of frequency
+            std::vector<int> order(leaves);
+            for (size_t i = 0; i < leaves; ++i)
+                order[i] = static_cast<int>(i);
+            std::sort(order.begin(), order.end(), [&nodes](int a, int b) { return nodes[a].freq < nodes[b].freq; });
+
+            size_t nextLeaf = 0;
+            size_t nextJoined = leaves;
+            auto takeLowest = [&]() {
+                if (nextLeaf < leaves && (nextJoined >= nodes.size() || nodes[order[nextLeaf]].freq <= nodes[nextJoined].freq))
+                    return order[nextLeaf++];
+                return static_cast<int>(nextJoined++);
+            };
+
+            for (size_t i = 1; i < leaves; ++i) {
+                int a = takeLowest();
+                int b = takeLowest();
+                nodes.push_back({ nodes[a].freq + nodes[b].freq, a, b });
+            }
+
+            // Depths, from the root down
+            std::vector<int> depth(nodes.size(), 0);
+            for (size_t i = nodes.size() - 1; i >= leaves; --i) {
+                depth[nodes[i].left] = depth[i] + 1;
+                depth[nodes[i].right] = depth[i] + 1;
+            }
+
+            int lengthCount[33] = {};
+            for (size_t i = 0; i < leaves; ++i)
+                ++lengthCount[std::min(depth[i], 32)];
+
+            // Too deep; fold the long codes into the longest allowed,
+            // then split shorter codes until the lengths make a code again
+            for (int len = maxLength + 1; len <= 32; ++len) {
+                lengthCount[maxLength] += lengthCount[len];
+                lengthCount[len] = 0;
+            }
+            uint32_t total = 0;
+            for (int len = maxLength; len > 0; --len)
+                total += static_cast<uint32_t>(lengthCount[len]) << (maxLength - len);
+            while (total > (1u << maxLength)) {
+                --lengthCount[maxLength];
+                for (int len = maxLength - 1; len > 0; --len) {
+                    if (lengthCount[len]) {
+                        --lengthCount[len];
+                        lengthCount[len + 1] += 2;
+                        break;
+                    }
+                }
+                --total;
+            }
+
+            // The most frequent symbols get the shortest codes
+            int len = 1;
+            for (size_t i = leaves; i-- > 0;) {
+                while (lengthCount[len] == 0)
+                    ++len;
+                lengths[nodes[order[i]].right] = static_cast<uint8_t>(len);
+                --lengthCount[len];
+            }
+        }
+
+        static uint32_t reverse(uint32_t code, int length) noexcept
+        {
+            uint32_t r = 0;
+            for (int i = 0; i < length; ++i) {
+                r = (r << 1) | (code & 1);
+                code >>= 1;
+            }
+            return r;
+        }
+
+        // Canonical codes for the lengths, bit reversed, as they are written
+        static void buildCodes(const uint8_t* lengths, int count, uint16_t* codes)
+        {
+            int lengthCount[16] = {};
+            for (int i = 0; i < count; ++i)
+                ++lengthCount[lengths[i]];
+            lengthCount[0] = 0;
+
+            int next[16];
+            int code = 0;
+            for (int len = 1; len < 16; ++len) {
+                code = (code + lengthCount[len - 1]) << 1;
+                next[len] = code;
+            }
+
+            for (int i = 0; i < count; ++i)
+                codes[i] = lengths[i] ? static_cast<uint16_t>(reverse(next[lengths[i]]++, lengths[i])) : 0;
+        }
+
+        void putBits(std::vector<uint8_t>& out, uint32_t value, uint32_t count)
+        {
+            fBits |= static_cast<uint64_t>(value) << fBitCount;
+            fBitCount += count;
+            if (fBitCount >= 32)
+                flushBits(out, false);
+        }
+
+        // Whole bytes out; 'all' pads the last one
+        void flushBits(std::vector<uint8_t>& out, bool all)
+        {
+            while (fBitCount >= 8) {
+                out.push_back(static_cast<uint8_t>(fBits));
+                fBits >>= 8;
+                fBitCount -= 8;
+            }
+            if (all && fBitCount > 0) {
+                out.push_back(static_cast<uint8_t>(fBits));
+                fBits = 0;
+                fBitCount = 0;
+            }
+        }
+
+        void compressBlock(bool last, std::vector<uint8_t>& out)
+        {
+            static constexpr uint8_t kLengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+            static constexpr uint16_t kLengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+            static constexpr uint8_t kDistanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+            static constexpr uint16_t kDistanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+            static constexpr uint8_t kOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+            findMatches();
+
+            uint8_t lengths[286 + 30];
+            buildLengths(fLiteralFreq, 286, 15, lengths);
+            buildLengths(fDistanceFreq, 30, 15, lengths + 286);
+
+            int hlit = 286;
+            while (hlit > 257 && lengths[hlit - 1] == 0)
+                --hlit;
+            int hdist = 30;
+            while (hdist > 1 && lengths[286 + hdist - 1] == 0)
+                --hdist;
+
+            // The lengths, run length coded, as (symbol, extra bits)
+            uint8_t all[286 + 30];
+            std::memcpy(all, lengths, hlit);
+            std::memcpy(all + hlit, lengths + 286, hdist);
+            int allCount = hlit + hdist;
+
+            std::vector<uint16_t> runs;
+            uint32_t clFreq[19] = {};
+            for (int i = 0; i < allCount;) {
+                uint8_t value = all[i];
+                int run = 1;
+                while (i + run < allCount && all[i + run] == value)
+                    ++run;
+
+                if (value == 0 && run >= 3) {
+                    int n = std::min(run, 138);
+                    uint16_t sym = n <= 10 ? 17 : 18;
+                    runs.push_back(static_cast<uint16_t>(sym | ((n - (sym == 17 ? 3 : 11)) << 8)));
+                    ++clFreq[sym];
+                    i += n;
+                }
+                else if (value != 0 && run >= 4) {
+                    runs.push_back(value);
+                    ++clFreq[value];
+                    int n = std::min(run - 1, 6);
+                    runs.push_back(static_cast<uint16_t>(16 | ((n - 3) << 8)));
+                    ++clFreq[16];
+                    i += 1 + n;
+                }
+                else {
+                    runs.push_back(value);
+                    ++clFreq[value];
+                    ++i;
+                }
+            }
+
+            uint8_t clLengths[19];
+            buildLengths(clFreq, 19, 7, clLengths);
+            int hclen = 19;
+            while (hclen > 4 && clLengths[kOrder[hclen - 1]] == 0)
+                --hclen;
+
+            // How big it would be, against storing it
+            size_t bits = 3 + 5 + 5 + 4 + 3 * hclen;
+            for (uint16_t r : runs) {
+                uint32_t sym = r & 0xFF;
+                bits += clLengths[sym] + (sym == 16 ? 2 : sym == 17 ? 3 : sym == 18 ? 7 : 0);
+            }
+            for (int i = 0; i < 286; ++i)
+                bits += size_t(fLiteralFreq[i]) * lengths[i] + (i >= 257 ? size_t(fLiteralFreq[i]) * kLengthExtra[i - 257] : 0);
+            for (int i = 0; i < 30; ++i)
+                bits += size_t(fDistanceFreq[i]) * (lengths[286 + i] + kDistanceExtra[i]);
+
+            size_t rawCount = fEnd - fBlockStart;
+            size_t storedBits = (rawCount + 5 * ((rawCount + 65534) / 65535)) * 8 + 8;
+            fFinished = last;
+
+            if (storedBits < bits) {
+                const uint8_t* p = fData.data() + fBlockStart;
+                size_t left = rawCount;
+                do {
+                    size_t n = std::min<size_t>(left, 65535);
+                    left -= n;
+                    putBits(out, (last && left == 0) ? 1 : 0, 3);
+                    flushBits(out, true);
+                    out.push_back(static_cast<uint8_t>(n));
+                    out.push_back(static_cast<uint8_t>(n >> 8));
+                    out.push_back(static_cast<uint8_t>(~n));
+                    out.push_back(static_cast<uint8_t>(~n >> 8));
+                    out.insert(out.end(), p, p + n);
+                    p += n;
+                } while (left > 0);
+                return;
+            }
+
+            uint16_t litCodes[286], distCodes[30], clCodes[19];
+            buildCodes(lengths, 286, litCodes);
+            buildCodes(lengths + 286, 30, distCodes);
+            buildCodes(clLengths, 19, clCodes);
+
+            out.reserve(out.size() + bits / 8 + 16);
+
+            putBits(out, last ? 5 : 4, 3);      // final, dynamic codes
+            putBits(out, hlit - 257, 5);
+            putBits(out, hdist - 1, 5);
+            putBits(out, hclen - 4, 4);
+            for (int i = 0; i < hclen; ++i)
+                putBits(out, clLengths[kOrder[i]], 3);
+
+            for (uint16_t r : runs) {
+                uint32_t sym = r & 0xFF;
+                putBits(out, clCodes[sym], clLengths[sym]);
+                if (sym == 16)
+                    putBits(out, r >> 8, 2);
+                else if (sym == 17)
+                    putBits(out, r >> 8, 3);
+                else if (sym == 18)
+                    putBits(out, r >> 8, 7);
+            }
+
+            for (uint32_t s : fSymbols) {
+                if (!(s & kMatchFlag)) {
+                    putBits(out, litCodes[s], lengths[s]);
+                    continue;
+                }
+
+                uint32_t length = (s >> 16) & 0x1FF;
+                uint32_t distance = s & 0xFFFF;
+                uint32_t lc = lengthCode(length);
+                putBits(out, litCodes[257 + lc], lengths[257 + lc]);
+                putBits(out, length - kLengthBase[lc], kLengthExtra[lc]);
+                uint32_t dc = distanceCode(distance);
+                putBits(out, distCodes[dc], lengths[286 + dc]);
+                putBits(out, distance - kDistanceBase[dc], kDistanceExtra[dc]);
+            }
+
+            putBits(out, litCodes[256], lengths[256]);
+        }
+
+        std::vector<uint8_t> fData;         // the window, then the block
+        std::vector<int32_t> fPrev;         // earlier place with the same hash, by place
+        std::vector<int32_t> fHead;         // latest place, by hash
+        size_t fEnd = 0;
+        size_t fBlockStart = 0;
+
+        std::vector<uint32_t> fSymbols;     // literal, or kMatchFlag | length << 16 | distance
+        uint32_t fLiteralFreq[286]{};
+        uint32_t fDistanceFreq[30]{};
+
+        uint64_t fBits = 0;
+        uint32_t fBitCount = 0;
+
+        uint32_t fAdlerA = 1;
+        uint32_t fAdlerB = 0;
+        bool fStarted = false;
+        bool fFinished = false;             // the final block is out
+    };
+}
@@ -0,0 +1,328 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "ocspan.h"
+#include "typeconv.h"
+
+//
+// PSDSCIndex
+//
+// Where the parts of a document that follows the Document Structuring
+// Conventions (DSC 3.0) are.  A document that does, keeps its pages
+// independent of each other.  Everything a page needs is set up in the
+// prolog and the setup, ahead of the first %%Page:, so any one page can
+// be run after the header, without running the pages before it.
+//
+// The index is made by a pass over the bytes, ahead of the interpreter.
+// It only looks at lines that begin with '%%', and finds those with
+// memchr, so it costs little more than reading the document once.
+// Documents embedded between %%BeginDocument and %%EndDocument, such as
+// an included EPS figure, have comments of their own, which are skipped.
+// So is what is inside %%BeginData: and %%BeginBinary:, which is not
+// program text at all; by the byte or line count the comment gives, or
+// up to the matching %%EndData or %%EndBinary when it gives none.
+//
+
+namespace waavs
+{
+    struct PSDSCPage
+    {
+        OctetCursor fLabel;         // as written in '%%Page: label ordinal'
+        int32_t fOrdinal{ 0 };
+        size_t fBegin{ 0 };         // offset of the %%Page: line
+        size_t fEnd{ 0 };           // offset of what follows the page
+    };
+
+    struct PSDSCIndex
+    {
+        static constexpr size_t npos = SIZE_MAX;
+
+        OctetCursor fDocument;
+        bool fConforming{ false };      // begins with %!PS-Adobe-
+
+        // Offsets of the comment lines, npos for those not there
+        size_t fPrologOffset{ npos };
+        size_t fEndPrologOffset{ npos };
+        size_t fSetupOffset{ npos };
+        size_t fEndSetupOffset{ npos };
+        size_t fTrailerOffset{ npos };
+        size_t fEOFOffset{ npos };
+        size_t fBoundingBoxOffset{ npos };
+        size_t fPagesOffset{ npos };
+
+        // What %%BoundingBox: and %%Pages: say, in the header, or the
+        // trailer when the header says (atend)
+        bool fHasBoundingBox{ false };
+        double fBoundingBox[4]{ 0, 0, 0, 0 };
+        int32_t fDeclaredPages{ -1 };
+
+        std::vector<PSDSCPage> fPages;
+
+        size_t pageCount() const noexcept { return fPages.size(); }
+
+        // Whether pages can be run on their own
+        bool hasPages() const noexcept { return fConforming && !fPages.empty(); }
+
+        // Everything ahead of the first page; comments, prolog and setup
+        OctetCursor header() const noexcept
+        {
+            size_t end = fPages.empty() ? fDocument.size() : fPages.front().fBegin;
+            return OctetCursor(fDocument.data(), end);
+        }
+
+        // The page at 'index', in the order the pages are in the document
+        OctetCursor page(size_t index) const noexcept
+        {
+            if (index >= fPages.size())
+                return OctetCursor();
+            const PSDSCPage& pg = fPages[index];
+            return OctetCursor(fDocument.data() + pg.fBegin, pg.fEnd - pg.fBegin);
+        }
+
+        // From %%Trailer to the end, empty when there is no trailer
+        OctetCursor trailer() const noexcept
+        {
+            if (fTrailerOffset == npos)
+                return OctetCursor();
+            return OctetCursor(fDocument.data() + fTrailerOffset, fDocument.size() - fTrailerOffset);
+        }
+
+        // The index of the page with the given ordinal, npos if there is none
+        size_t findPage(int32_t ordinal) const noexcept
+        {
+            for (size_t i = 0; i < fPages.size(); ++i) {
+                if (fPages[i].fOrdinal == ordinal)
+                    return i;
+            }
+            return npos;
+        }
+    };
+
+
+    // The value part of a DSC comment, what follows the keyword
+    static inline OctetCursor dscValue(const OctetCursor& line, size_t keywordSize) noexcept
+    {
+        OctetCursor value(line.data() + keywordSize, line.size() - keywordSize);
+        while (!value.empty() && (*value == ' ' || *value == '\t'))
+            ++value;
+        return value;
+    }
+
+    // The next whitespace separated field of a DSC comment value
+    static inline OctetCursor dscNextField(OctetCursor& value) noexcept
+    {
+        while (!value.empty() && (*value == ' ' || *value == '\t'))
+            ++value;
+
+        const uint8_t* start = value.begin();
+        while (!value.empty() && *value != ' ' && *value != '\t')
+            ++value;
+
+        return OctetCursor(start, value.begin() - start);
+    }
+
+    static inline bool dscNextNumber(OctetCursor& value, double& out) noexcept
+    {
+        OctetCursor field = dscNextField(value);
+        bool isInteger = false;
+        return !field.empty() && readNumber(field, out, isInteger) && field.empty();
+    }
+
+    static inline bool dscStartsWith(const OctetCursor& line, const OctetCursor& keyword) noexcept
+    {
+        return line.size() >= keyword.size() && std::memcmp(line.data(), keyword.data(), keyword.size()) == 0;
+    }
+
+    // Past the data that follows a %%BeginData: or %%BeginBinary: line,
+    // which 'p' is at the end of.  'count' is in bytes, or in lines.
+    static inline const uint8_t* dscSkipData(const uint8_t* p, const uint8_t* end, size_t count, bool lines) noexcept
+    {
+        if (p < end && *p == '\r') ++p;
+        if (p < end && *p == '\n') ++p;
+
+        if (!lines)
+            return count < size_t(end - p) ? p + count : end;
+
+        for (; count > 0 && p < end; --count) {
+            while (p < end && *p != '\n' && *p != '\r')
+                ++p;
+            if (p < end && *p == '\r') ++p;
+            if (p < end && *p == '\n') ++p;
+        }
+        return p;
+    }
+
+    // buildDSCIndex
+    // Index the DSC comments of 'doc'.  The index refers to 'doc', which
+    // has to stay where it is for as long as the index is used.
+    static inline bool buildDSCIndex(const OctetCursor& doc, PSDSCIndex& index)
+    {
+        static const OctetCursor kAdobe("%!PS-Adobe-");
+        static const OctetCursor kBeginDocument("%%BeginDocument");
+        static const OctetCursor kEndDocument("%%EndDocument");
+        static const OctetCursor kBeginData("%%BeginData:");
+        static const OctetCursor kEndData("%%EndData");
+        static const OctetCursor kBeginBinary("%%BeginBinary:");
+        static const OctetCursor kEndBinary("%%EndBinary");
+        static const OctetCursor kBeginProlog("%%BeginProlog");
+        static const OctetCursor kEndProlog("%%EndProlog");
+        static const OctetCursor kBeginSetup("%%BeginSetup");
+        static const OctetCursor kEndSetup("%%EndSetup");
+        static const OctetCursor kPage("%%Page:");
+        static const OctetCursor kTrailer("%%Trailer");
+        static const OctetCursor kEOF("%%EOF");
+        static const OctetCursor kBoundingBox("%%BoundingBox:");
+        static const OctetCursor kPages("%%Pages:");
+
+        index = PSDSCIndex();
+        index.fDocument = doc;
+        index.fConforming = dscStartsWith(doc, kAdobe);
+
+        const uint8_t* base = doc.begin();
+        const uint8_t* end = doc.end();
+        const uint8_t* p = base;
+        int nested = 0;
+        const OctetCursor* dataEnd = nullptr;   // the comment that ends uncounted data
+
+        while (p < end) {
+            const uint8_t* pct = static_cast<const uint8_t*>(std::memchr(p, '%', end - p));
+            if (!pct)
+                break;
+
+            p = pct + 1;
+
+            // Only '%%' at the start of a line
+            if ((pct != base && pct[-1] != '\n' && pct[-1] != '\r') || p >= end || *p != '%')
+                continue;
+
+            const uint8_t* lineEnd = p;
+            while (lineEnd < end && *lineEnd != '\n' && *lineEnd != '\r')
+                ++lineEnd;
+
+            OctetCursor line(pct, lineEnd - pct);
+            size_t offset = pct - base;
+            p = lineEnd;
+
+            if (dataEnd) {
+                if (dscStartsWith(line, *dataEnd))
+                    dataEnd = nullptr;
+                continue;
+            }
+
+            // %%BeginData: count [Hex | Binary | ASCII [Bytes | Lines]]
+            // %%BeginBinary: count
+            bool isData = dscStartsWith(line, kBeginData);
+            if (isData || dscStartsWith(line, kBeginBinary)) {
+                OctetCursor value = dscValue(line, isData ? kBeginData.size() : kBeginBinary.size());
+                double count = 0;
+                if (dscNextNumber(value, count) && count >= 0) {
+                    bool lines = false;
+                    if (isData) {
+                        dscNextField(value);
+                        lines = dscNextField(value) == "Lines";
+                    }
+                    // no more than the document holds, bytes or lines
+                    double most = static_cast<double>(end - p);
+                    p = dscSkipData(p, end, static_cast<size_t>(count < most ? count : most), lines);
+                }
+                else {
+                    dataEnd = isData ? &kEndData : &kEndBinary;
+                }
+                continue;
+            }
+
+            if (dscStartsWith(line, kBeginDocument)) {
+                nested++;
+                continue;
+            }
+            if (dscStartsWith(line, kEndDocument)) {
+                if (nested > 0)
+                    nested--;
+                continue;
+            }
+            if (nested > 0)
+                continue;
+
+            if (dscStartsWith(line, kPage)) {
+                OctetCursor value = dscValue(line, kPage.size());
+                PSDSCPage page;
+                page.fLabel = dscNextField(value);
+                double ordinal = 0;
+                page.fOrdinal = dscNextNumber(value, ordinal) ? static_cast<int32_t>(ordinal) : static_cast<int32_t>(index.fPages.size() + 1);
+                page.fBegin = offset;
+                index.fPages.push_back(page);
+            }
+            else if (dscStartsWith(line, kBeginProlog)) {
+                if (index.fPrologOffset == PSDSCIndex::npos)
+                    index.fPrologOffset = offset;
+            }
+            else if (dscStartsWith(line, kEndProlog)) {
+                if (index.fEndPrologOffset == PSDSCIndex::npos)
+                    index.fEndPrologOffset = offset;
+            }
+            else if (dscStartsWith(line, kBeginSetup)) {
+                if (index.fSetupOffset == PSDSCIndex::npos)
+                    index.fSetupOffset = offset;
+            }
+            else if (dscStartsWith(line, kEndSetup)) {
+                if (index.fEndSetupOffset == PSDSCIndex::npos)
+                    index.fEndSetupOffset = offset;
+            }
+            else if (dscStartsWith(line, kTrailer)) {
+                // the last one, as a page may have one of its own
+                index.fTrailerOffset = offset;
+            }
+            else if (dscStartsWith(line, kEOF)) {
+                index.fEOFOffset = offset;
+            }
+            else if (dscStartsWith(line, kBoundingBox)) {
+                if (index.fHasBoundingBox)
+                    continue;
+
+                OctetCursor value = dscValue(line, kBoundingBox.size());
+                double box[4];
+                if (dscNextNumber(value, box[0]) && dscNextNumber(value, box[1]) &&
+                    dscNextNumber(value, box[2]) && dscNextNumber(value, box[3])) {
+                    std::memcpy(index.fBoundingBox, box, sizeof(box));
+                    index.fHasBoundingBox = true;
+                    index.fBoundingBoxOffset = offset;
+                }
+            }
+            else if (dscStartsWith(line, kPages)) {
+                if (index.fDeclaredPages >= 0)
+                    continue;
+
+                OctetCursor value = dscValue(line, kPages.size());
+                double pages = 0;
+                if (dscNextNumber(value, pages)) {
+                    index.fDeclaredPages = static_cast<int32_t>(pages);
+                    index.fPagesOffset = offset;
+                }
+            }
+        }
+
+        // Each page runs up to the next one, and the last one up to the
+        // trailer, or whatever ends the document
+        for (size_t i = 0; i < index.fPages.size(); ++i) {
+            size_t pageEnd = doc.size();
+            if (i + 1 < index.fPages.size())
+                pageEnd = index.fPages[i + 1].fBegin;
+            else if (index.fTrailerOffset != PSDSCIndex::npos && index.fTrailerOffset > index.fPages[i].fBegin)
+                pageEnd = index.fTrailerOffset;
+            else if (index.fEOFOffset != PSDSCIndex::npos && index.fEOFOffset > index.fPages[i].fBegin)
+                pageEnd = index.fEOFOffset;
+
+            index.fPages[i].fEnd = pageEnd;
+        }
+
+        // A trailer ahead of the last page belongs to something else
+        if (index.fTrailerOffset != PSDSCIndex::npos && !index.fPages.empty() &&
+            index.fTrailerOffset < index.fPages.back().fBegin)
+            index.fTrailerOffset = PSDSCIndex::npos;
+
+        return true;
+    }
+}
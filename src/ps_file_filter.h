@@ -4,6 +4,10 @@
 #include "ps_type_dictionary.h"
 #include "psvm.h"
 #include "ps_charcats.h"
+#include "ps_hexdecode.h"
+#include "ps_inflate.h"
+#include "ps_deflate.h"
+#include "ps_predictor.h"
 
 #include <memory>
 #include <vector>
@@ -14,231 +18,1180 @@ namespace waavs
 
 
 
-    class ASCII85DecodeFilter : public PSFile
+    //=====================================================
+    // Decode Filter
+    //
+    // What the decode filters have in common.  Each one decodes a block
+    // at a time, from its source's cursor, into a window, and the filter's 
+    // cursor walks the window.  So a reader takes the decoded bytes in 
+    // place, the scanner directly, readstring or an image a chunk at a 
+    // time (readChunk), and a chain of filters moves data from one to 
+    // the next a block at a time, not a virtual call per byte.
+    //
+    // A filter only says how to decode a block (decodeBlock).
+    //=====================================================
+    class PSDecodeFilter : public PSFile
     {
-    private:
-        std::shared_ptr<PSFile> _source;
-        std::vector<uint8_t> _buffer;
-        size_t _bufferPos;
-        bool _finished;
-
     public:
-        explicit ASCII85DecodeFilter(std::shared_ptr<PSFile> source)
-            : _source(source), 
-            _bufferPos(0), 
-            _finished(false)
+        static constexpr size_t kBlockSize = 4096;     // decoded bytes per refill
+
+        bool hasCursor() const override { return true; }
+        bool isValid() const override { return _source != nullptr; }
+
+        bool isEOF() const override
         {
+            return _finished && fCursor.empty();
         }
 
-        bool readByte(uint8_t& byte) override
+        // Keep what the cursor has not consumed, at the front, and 
+        // decode the next block after it.  A block is at least as big as
+        // what is kept, so a token bigger than a block is scanned again
+        // a number of times that only grows with the log of its size.
+        bool refill() override
         {
-            if (_bufferPos >= _buffer.size()) {
-                if (!refillBuffer())
-                    return false;
-            }
+            if (_finished)
+                return false;
+
+            size_t offset = fCursor.begin() - _window.data();
+            size_t keep = fCursor.size();
+            if (offset > 0 && keep > 0)
+                std::memmove(_window.data(), _window.data() + offset, keep);
+
+            size_t room = std::max(kBlockSize, keep);
+            _window.resize(keep + room);
+            size_t got = decodeBlock(_window.data() + keep, room);
+            _window.resize(keep + got);
+            _blockStart = keep;
+
+            fCursor = OctetCursor(_window.data(), _window.size());
+
+            if (got == 0)
+                _finished = true;
+
+            return got > 0;
+        }
+
+        bool readByte(uint8_t& out) override
+        {
+            if (fCursor.empty() && !refill())
+                return false;
+
+            out = *fCursor;
+            ++fCursor;
 
-            byte = _buffer[_bufferPos++];
             return true;
         }
 
-        bool isEOF() const override
+        bool readBytes(uint8_t* out, size_t count) override
         {
-            return _finished && _bufferPos >= _buffer.size();
+            return readSome(out, count) == count;
         }
 
+        size_t readSome(uint8_t* out, size_t count) override
+        {
+            size_t n = 0;
+            while (n < count) {
+                if (fCursor.empty() && !refill())
+                    break;
+
+                size_t chunk = std::min(count - n, fCursor.size());
+                std::memcpy(out + n, fCursor.begin(), chunk);
+                fCursor.advance(chunk);
+                n += chunk;
+            }
 
+            return n;
+        }
+
+        // Nothing more is read.  The rest of the data is, so the source
+        // is left just after it.
         void finalize() override
         {
-            if (_finished)
-                return;
+            skipToEnd();
+            dropWindow();
+        }
 
-            // Try to finish parsing the trailer
-            uint8_t c;
-            while (_source->readByte(c)) {
-                if (c == '~') {
-                    uint8_t next;
-                    if (_source->readByte(next) && next == '>') {
-                        _finished = true;
-                        return;
+    protected:
+        // A source without a cursor of its own is given one
+        explicit PSDecodeFilter(std::shared_ptr<PSFile> source)
+            : _source(source && !source->hasCursor() ? PSBufferedFile::create(source) : source)
+        {
+            fCursor = OctetCursor(_window.data(), 0);
+        }
+
+        // Decode up to 'room' bytes into 'out', returning how many.
+        // Zero is the end of the data.
+        virtual size_t decodeBlock(uint8_t* out, size_t room) = 0;
+
+        // The source's cursor has something in it; false at its end
+        bool sourceReady()
+        {
+            return !_source->getCursor().empty() || _source->refill();
+        }
+
+        // Decode, and drop, whatever is left up to the end of the data
+        void skipToEnd()
+        {
+            uint8_t scratch[kBlockSize];
+            while (!_finished && decodeBlock(scratch, sizeof(scratch)) > 0)
+                ;
+        }
+
+        void dropWindow()
+        {
+            _finished = true;
+            fCursor = OctetCursor(fCursor.end(), 0);
+        }
+
+        std::shared_ptr<PSFile> _source;
+        std::vector<uint8_t> _window;
+        size_t _blockStart = 0;        // where the newest block is in the window
+        bool _finished = false;
+    };
+
+
+    //=====================================================
+    // ASCII85 Decode Filter
+    //
+    // Groups of five characters, '!' through 'u', are four bytes, 'z' is 
+    // four zeros, whitespace is skipped, and '~>' ends the data.  A short
+    // last group of n characters is n-1 bytes.  Whole groups are decoded
+    // straight from the source's cursor; a group that is broken across
+    // refills of the source, or by whitespace, is gathered a character 
+    // at a time.
+    //=====================================================
+    class ASCII85DecodeFilter : public PSDecodeFilter
+    {
+    public:
+        explicit ASCII85DecodeFilter(std::shared_ptr<PSFile> source)
+            : PSDecodeFilter(source)
+        {
+        }
+
+    protected:
+        size_t decodeBlock(uint8_t* out, size_t room) override
+        {
+            size_t n = 0;
+            bool sourceEnded = false;
+
+            while (!_eod && n + 4 <= room) {
+                if (!sourceReady()) {
+                    sourceEnded = true;
+                    break;
+                }
+
+                OctetCursor& src = _source->getCursor();
+
+                if (_count == 0 && !_tilde) {
+                    while (src.size() >= 5 && n + 4 <= room && isGroup(src.data())) {
+                        putGroup(src.data(), out + n);
+                        src.advance(5);
+                        n += 4;
                     }
+                    if (src.empty() || n + 4 > room)
+                        continue;
+                }
+
+                uint8_t c = *src;
+                ++src;
+
+                if (_tilde) {
+                    // '~' is only ever followed by '>'
+                    _eod = true;
+                    break;
+                }
+
+                if (PSCharClass::isWhitespace(c))
+                    continue;
+
+                if (c == '~') {
+                    _tilde = true;
+                    continue;
+                }
+
+                if (c == 'z' && _count == 0) {
+                    std::memset(out + n, 0, 4);
+                    n += 4;
+                    continue;
                 }
 
+                if (c < '!' || c > 'u') {
+                    _eod = true;        // not ASCII85, the data ends here
+                    break;
+                }
+
+                _group[_count++] = c;
+                if (_count == 5) {
+                    putGroup(_group, out + n);
+                    n += 4;
+                    _count = 0;
+                }
             }
 
-            _source->finalize();
+            // The short last group
+            if ((_eod || sourceEnded) && _count > 1) {
+                for (int i = _count; i < 5; ++i)
+                    _group[i] = 'u';
 
+                uint8_t bytes[4];
+                putGroup(_group, bytes);
+                std::memcpy(out + n, bytes, _count - 1);
+                n += _count - 1;
+            }
+            if (_eod || sourceEnded)
+                _count = 0;
+
+            return n;
         }
 
     private:
+        uint8_t _group[5] = {};
+        int _count = 0;
+        bool _tilde = false;
+        bool _eod = false;
 
-        bool refillBuffer()
+        static bool isGroup(const uint8_t* p)
         {
-            if (_finished)
-                return false;
+            for (int i = 0; i < 5; ++i) {
+                if (p[i] < '!' || p[i] > 'u')
+                    return false;
+            }
+            return true;
+        }
 
-            _buffer.clear();
-            _bufferPos = 0;
+        static void putGroup(const uint8_t* in, uint8_t* out)
+        {
+            uint32_t value = 0;
+            for (int i = 0; i < 5; ++i)
+                value = value * 85 + (in[i] - 33);
 
-            uint8_t in[5] = {};
-            int count = 0;
+            out[0] = static_cast<uint8_t>(value >> 24);
+            out[1] = static_cast<uint8_t>(value >> 16);
+            out[2] = static_cast<uint8_t>(value >> 8);
+            out[3] = static_cast<uint8_t>(value);
+        }
+    };
 
-            while (count < 5) {
-                uint8_t c;
-                if (!_source->readByte(c)) {
-                    _finished = true;
-                    return false;
-                }
 
-                if (PSCharClass::isWhitespace(c)) {
-                    continue;
-                }
 
-                if (c == '~') {
-                    uint8_t next;
-                    if (_source->readByte(next) && next == '>') {
-                        _finished = true;
+    //=====================================================
+    // Run Length Decode Filter
+    //
+    // A length byte, 0-127, is followed by that many bytes plus one, 
+    // which are copied straight from the source.  129-255 is followed by
+    // one byte, repeated 257 less the length times.  128 ends the data.
+    //=====================================================
+    class RunLengthDecodeFilter : public PSDecodeFilter
+    {
+    public:
+        explicit RunLengthDecodeFilter(std::shared_ptr<PSFile> source)
+            : PSDecodeFilter(source)
+        {
+        }
+
+    protected:
+        size_t decodeBlock(uint8_t* out, size_t room) override
+        {
+            size_t n = 0;
+
+            while (n < room && !_eod) {
+                if (_remaining == 0) {
+                    if (!sourceReady()) {
+                        _eod = true;
+                        break;
+                    }
+
+                    OctetCursor& src = _source->getCursor();
+                    uint8_t length = *src;
+                    ++src;
+
+                    if (length == 128) {
+                        _eod = true;
                         break;
                     }
+
+                    if (length < 128) {
+                        _mode = Mode::Literal;
+                        _remaining = length + 1;
+                    }
                     else {
-                        _finished = true;
-                        return false; // Invalid end sequence
+                        if (!sourceReady()) {
+                            _eod = true;
+                            break;
+                        }
+                        _repeated = *_source->getCursor();
+                        ++_source->getCursor();
+                        _mode = Mode::Repeat;
+                        _remaining = 257 - length;
                     }
+                    continue;
                 }
 
-                if (c == 'z' && count == 0) {
-                    _buffer.insert(_buffer.end(), 4, 0);
-                    return true;
+                size_t chunk = std::min(_remaining, room - n);
+                if (_mode == Mode::Literal) {
+                    if (!sourceReady()) {
+                        _eod = true;
+                        break;
+                    }
+                    OctetCursor& src = _source->getCursor();
+                    chunk = std::min(chunk, src.size());
+                    std::memcpy(out + n, src.begin(), chunk);
+                    src.advance(chunk);
+                }
+                else {
+                    std::memset(out + n, _repeated, chunk);
                 }
 
-                if (c < '!' || c > 'u') {
-                    _finished = true;
-                    return false; // Invalid character
+                n += chunk;
+                _remaining -= chunk;
+            }
+
+            return n;
+        }
+
+    private:
+        enum class Mode { Literal, Repeat };
+
+        Mode _mode = Mode::Literal;
+        size_t _remaining = 0;
+        uint8_t _repeated = 0;
+        bool _eod = false;
+    };
+
+
+    //=====================================================
+    // ASCII Hex Decode Filter
+    //
+    // Decodes through PSHexDecoder.  Whitespace is skipped, '>' ends the 
+    // data, and an odd last digit is taken as if followed by a '0'.
+    //=====================================================
+    class ASCIIHexDecodeFilter : public PSDecodeFilter
+    {
+    public:
+        explicit ASCIIHexDecodeFilter(std::shared_ptr<PSFile> source)
+            : PSDecodeFilter(source)
+        {
+        }
+
+    protected:
+        // Decode what the source shows, refilling it only when nothing 
+        // could be decoded from it
+        size_t decodeBlock(uint8_t* out, size_t room) override
+        {
+            if (_ended)
+                return 0;
+
+            size_t got = 0;
+            while (got == 0) {
+                if (!sourceReady()) {
+                    _ended = true;
+                    break;
                 }
 
-                in[count++] = c;
+                got = _decoder.decode(_source->getCursor(), out, room);
+                if (_decoder.isDone()) {
+                    _ended = true;
+                    break;
+                }
             }
 
-            for (int i = count; i < 5; ++i)
-                in[i] = 'u';
+            if (_ended && got < room && _decoder.finish(out[got]))
+                ++got;
 
-            uint32_t value = 0;
-            for (int i = 0; i < 5; ++i)
-                value = value * 85 + (in[i] - 33);
+            return got;
+        }
 
-            for (int i = 3; i >= 0; --i)
-                _buffer.push_back((value >> (i * 8)) & 0xFF);
+    private:
+        PSHexDecoder _decoder;
+        bool _ended = false;
+    };
 
-            if (count < 5) {
-                _buffer.resize(count - 1);
-                _finished = true;
+
+    //=====================================================
+    // Flate Decode Filter
+    //
+    // zlib/deflate data, decoded through PSInflater, then through a
+    // predictor, if the DecodeParms asked for one.  The source is left 
+    // just after the end of the stream.
+    //=====================================================
+    class FlateDecodeFilter : public PSDecodeFilter
+    {
+    public:
+        explicit FlateDecodeFilter(std::shared_ptr<PSFile> source, const PSPredictor& predictor = PSPredictor())
+            : PSDecodeFilter(source)
+            , _inflater(std::make_unique<PSInflater>(_source))
+            , _predictor(predictor)
+        {
+        }
+
+    protected:
+        size_t decodeBlock(uint8_t* out, size_t room) override
+        {
+            if (!_predictor.isActive())
+                return _inflater->inflate(out, room);
+
+            return _predictor.decode(out, room, [this](uint8_t* dst, size_t count) {
+                return _inflater->inflate(dst, count);
+            });
+        }
+
+    private:
+        std::unique_ptr<PSInflater> _inflater;     // big, for its 32K ring
+        PSPredictor _predictor;
+    };
+
+
+    //=====================================================
+    // LZW Decode Filter
+    //
+    // Codes of 9 to 12 bits, high bit first.  256 clears the table, 257
+    // ends the data.  The table is flat; each code is the code before it
+    // and one more byte, so there is no allocation per code, and a string
+    // is written out backwards, from its last byte, straight into the
+    // output.  One that does not fit is written to a side buffer, and
+    // given out from there.
+    //
+    // EarlyChange 1, the default, widens the codes one code early, as
+    // most encoders do.
+    //=====================================================
+    class LZWDecodeFilter : public PSDecodeFilter
+    {
+    public:
+        static constexpr uint32_t kClear = 256;
+        static constexpr uint32_t kEOD = 257;
+        static constexpr uint32_t kMaxCodes = 4096;
+
+        explicit LZWDecodeFilter(std::shared_ptr<PSFile> source, int earlyChange = 1, const PSPredictor& predictor = PSPredictor())
+            : PSDecodeFilter(source)
+            , _earlyChange(earlyChange ? 1 : 0)
+            , _predictor(predictor)
+            , _table(std::make_unique<Table>())
+        {
+            for (uint32_t i = 0; i < 256; ++i) {
+                _table->prefix[i] = 0;
+                _table->suffix[i] = static_cast<uint8_t>(i);
+                _table->first[i] = static_cast<uint8_t>(i);
+                _table->length[i] = 1;
             }
+            clear();
+        }
 
-            return !_buffer.empty();
+    protected:
+        size_t decodeBlock(uint8_t* out, size_t room) override
+        {
+            if (!_predictor.isActive())
+                return decodeCodes(out, room);
+
+            return _predictor.decode(out, room, [this](uint8_t* dst, size_t count) {
+                return decodeCodes(dst, count);
+            });
         }
+
+    private:
+        struct Table {
+            uint16_t prefix[kMaxCodes];
+            uint8_t suffix[kMaxCodes];
+            uint8_t first[kMaxCodes];       // first byte of the code's string
+            uint16_t length[kMaxCodes];
+        };
+
+        void clear() noexcept
+        {
+            _next = 258;
+            _width = 9;
+            _prior = -1;
+        }
+
+        // Codes are read a byte at a time, so nothing after the EOD code 
+        // is taken from the source.  'src' is the source's cursor.
+        bool nextCode(OctetCursor& src, uint32_t& code)
+        {
+            while (_bitCount < _width) {
+                if (src.empty() && !_source->refill())
+                    return false;
+                _bits = (_bits << 8) | *src;
+                ++src;
+                _bitCount += 8;
+            }
+
+            _bitCount -= _width;
+            code = static_cast<uint32_t>(_bits >> _bitCount) & ((1u << _width) - 1);
+            return true;
+        }
+
+        // Write the string for 'code' at 'dst', from its last byte back
+        void writeString(uint32_t code, uint8_t* dst) const noexcept
+        {
+            uint8_t* p = dst + _table->length[code];
+            while (code >= 256) {
+                *--p = _table->suffix[code];
+                code = _table->prefix[code];
+            }
+            *--p = static_cast<uint8_t>(code);
+        }
+
+        size_t decodeCodes(uint8_t* out, size_t room)
+        {
+            size_t n = 0;
+
+            // What is left of a string that did not fit last time
+            if (_pendingPos < _pendingLength) {
+                size_t chunk = std::min(room, _pendingLength - _pendingPos);
+                std::memcpy(out, _pending + _pendingPos, chunk);
+                _pendingPos += chunk;
+                n += chunk;
+            }
+
+            OctetCursor& src = _source->getCursor();
+            while (n < room && !_eod) {
+                uint32_t code;
+                if (!nextCode(src, code) || code == kEOD) {
+                    _eod = true;
+                    break;
+                }
+
+                if (code == kClear) {
+                    clear();
+                    continue;
+                }
+
+                uint32_t emit = code;
+                uint8_t firstByte;
+                if (code < _next) {
+                    firstByte = _table->first[code];
+                }
+                else if (code == _next && _prior >= 0) {
+                    // The code being defined; the prior string and its own
+                    // first byte
+                    firstByte = _table->first[_prior];
+                }
+                else {
+                    _eod = true;            // not a code there can be yet
+                    break;
+                }
+
+                // Add the prior string and the first byte of this one
+                if (_prior >= 0 && _next < kMaxCodes) {
+                    Table& t = *_table;
+                    t.prefix[_next] = static_cast<uint16_t>(_prior);
+                    t.suffix[_next] = firstByte;
+                    t.first[_next] = t.first[_prior];
+                    t.length[_next] = static_cast<uint16_t>(t.length[_prior] + 1);
+                    ++_next;
+                    if (_next + _earlyChange >= (1u << _width) && _width < 12)
+                        ++_width;
+                }
+
+                _prior = static_cast<int>(code);
+
+                size_t length = _table->length[emit];
+                if (length <= room - n) {
+                    writeString(emit, out + n);
+                    n += length;
+                }
+                else {
+                    writeString(emit, _pending);
+                    _pendingLength = length;
+                    _pendingPos = room - n;
+                    std::memcpy(out + n, _pending, _pendingPos);
+                    n = room;
+                }
+            }
+
+            return n;
+        }
+
+        uint32_t _earlyChange;
+        PSPredictor _predictor;
+        std::unique_ptr<Table> _table;
+
+        uint32_t _next = 258;           // the next code to be defined
+        uint32_t _width = 9;
+        int _prior = -1;                // the code before, -1 after a clear
+
+        uint64_t _bits = 0;
+        uint32_t _bitCount = 0;
+        bool _eod = false;
+
+        uint8_t _pending[kMaxCodes];
+        size_t _pendingPos = 0;
+        size_t _pendingLength = 0;
     };
 
 
+    // The predictor a filter's DecodeParms dictionary asks for.  False if
+    // the parameters do not make sense.
+    static inline bool readPredictorParams(const PSDictionaryHandle& params, PSPredictor& predictor)
+    {
+        int values[4] = { 1, 1, 8, 1 };
+        const char* keys[4] = { "Predictor", "Colors", "BitsPerComponent", "Columns" };
+
+        for (int i = 0; i < 4; ++i) {
+            PSObject value;
+            if (!params->get(keys[i], value))
+                continue;
+            if (!value.isInt())
+                return false;
+            values[i] = value.asInt();
+        }
+
+        return predictor.configure(values[0], values[1], values[2], values[3]);
+    }
+
 
     //=====================================================
-    // Run Length Decode Filter
+    // eexec Decode Filter
+    //
+    // Decrypts an eexec section (Type 1 Font Format, 7.2) a block at a 
+    // time, as it is read, so a font of any size is decrypted in bounded
+    // memory.  Whether the cipher text is hex or binary is told from its
+    // first four bytes.  The plain text is held in a window, with a cursor
+    // over it, so the scanner reads it directly, as does readstring, for
+    // the charstrings that follow RD.
+    //
+    // The source is read a block ahead of what has been scanned.  When 
+    // the section closes itself (mark currentfile closefile), the source
+    // is put back to just after the cipher text that was used, so it 
+    // carries on from the right place.
     //=====================================================
-    class RunLengthDecodeFilter : public PSFile
+    class EexecDecodeFilter : public PSDecodeFilter
     {
     public:
-        explicit RunLengthDecodeFilter(std::shared_ptr<PSFile> source)
-            : _source(source), _mode(Mode::Idle), _pos(0), _count(0), _finished(false)
+        static constexpr size_t kLenIV = 4;            // random bytes ahead of the plain text
+
+        explicit EexecDecodeFilter(std::shared_ptr<PSFile> source)
+            : PSDecodeFilter(source)
         {
         }
 
-        bool readByte(uint8_t& out) override
+        void finalize() override { close(); }
+
+        void close() override
         {
-            while (true) {
-                if (_finished)
+            if (_closed)
+                return;
+
+            _closed = true;
+            giveBackSource();
+            dropWindow();
+        }
+
+    private:
+        enum class Mode { Unknown, Hex, Binary };
+
+        PSEexecCipher _cipher;
+        Mode _mode = Mode::Unknown;
+        size_t _skip = kLenIV;
+        bool _closed = false;
+        bool _cipherEnded = false;
+
+        // Where the cipher text of the newest block is in the source.  A 
+        // block is only decrypted from what the source shows, so the 
+        // source does not move under it.
+        const uint8_t* _blockSource = nullptr;
+        size_t _blockSkipped = 0;
+
+        // The source has to show at least 'count' bytes; false if it can not
+        bool sourceHas(size_t count)
+        {
+            OctetCursor& src = _source->getCursor();
+            while (src.size() < count) {
+                if (!_source->refill())
                     return false;
+            }
+            return true;
+        }
 
-                if (_pos < _count) {
-                    out = _buffer[_pos++];
-                    return true;
+        // Binary cipher text begins with something other than four hex 
+        // digits, and is not whitespace, so what comes ahead of it is
+        bool detectMode()
+        {
+            OctetCursor& src = _source->getCursor();
+            while (sourceHas(1) && PSCharClass::isWhitespace(*src))
+                ++src;
+
+            if (!sourceHas(1))
+                return false;
+
+            bool hex = sourceHas(4);
+            for (size_t i = 0; hex && i < 4; ++i)
+                hex = PSCharClass::isHexDigit(src.data()[i]);
+
+            _mode = hex ? Mode::Hex : Mode::Binary;
+            return true;
+        }
+
+        // The next byte of cipher text the source shows, false when it
+        // shows no more.  Hex data ends at the first thing that is not a 
+        // hex digit or whitespace, and a digit is only taken with its pair.
+        bool nextCipherByte(uint8_t& out)
+        {
+            OctetCursor& src = _source->getCursor();
+
+            if (_mode == Mode::Binary) {
+                if (src.empty())
+                    return false;
+                out = *src;
+                ++src;
+                return true;
+            }
+
+            OctetCursor p = src;
+            uint8_t value = 0;
+            int digits = 0;
+            while (!p.empty()) {
+                uint8_t c = *p;
+                if (PSCharClass::isWhitespace(c)) {
+                    ++p;
+                    continue;
                 }
 
-                // Refill buffer
-                uint8_t control;
-                if (!_source->readByte(control)) {
-                    _finished = true;
+                uint8_t nibble;
+                if (!hexToNibble(c, nibble)) {
+                    _cipherEnded = true;
                     return false;
                 }
+                ++p;
 
-                if (control == 128) {
-                    _finished = true;
-                    return false; // EOD
+                value = static_cast<uint8_t>((value << 4) | nibble);
+                if (++digits == 2) {
+                    src = p;
+                    out = value;
+                    return true;
                 }
+            }
 
-                if (control <= 127) {
-                    // Literal run of (control + 1) bytes
-                    _count = control + 1;
-                    _pos = 0;
-                    _buffer.resize(_count);
-           
-                    for (size_t i = 0; i < _count; ++i) {
-                        if (!_source->readByte(_buffer[i])) {
-                            _finished = true;
-                            return false;
-                        }
+            return false;
+        }
+
+        size_t decodeBlock(uint8_t* out, size_t count) override
+        {
+            if (_mode == Mode::Unknown && !detectMode())
+                return 0;
+
+            size_t n = 0;
+            for (;;) {
+                _blockSource = _source->getCursor().begin();
+                _blockSkipped = 0;
+
+                uint8_t cipher;
+                while (n < count && nextCipherByte(cipher)) {
+                    uint8_t plain = _cipher.decrypt(cipher);
+                    if (_skip > 0) {
+                        --_skip;
+                        ++_blockSkipped;
+                        continue;
                     }
+                    out[n++] = plain;
                 }
-                else {
-                    // Repeated byte
-                    _count = 257 - control;
-                    _pos = 0;
-                    uint8_t repeated;
-                    if (!_source->readByte(repeated)) {
-                        _finished = true;
-                        return false;
-                    }
-                    //_buffer.resize(_count, repeated);
-                    _buffer.assign(_count, repeated);
+
+                // Refill only once nothing more can be decrypted
+                if (n > 0 || _cipherEnded || !_source->refill())
+                    break;
+            }
+
+            return n;
+        }
+
+        // Put the source back to just after the cipher text of the plain 
+        // text that was read.  Only possible when that is in the newest 
+        // block, and the source has not moved since it was decrypted.
+        void giveBackSource()
+        {
+            size_t used = fCursor.begin() - _window.data();
+            if (!_blockSource || used < _blockStart)
+                return;
+
+            size_t cipherBytes = used - _blockStart + _blockSkipped;
+            OctetCursor& src = _source->getCursor();
+            const uint8_t* p = _blockSource;
+
+            if (_mode == Mode::Binary) {
+                p += cipherBytes;
+            }
+            else {
+                size_t digits = cipherBytes * 2;
+                while (digits > 0 && p < src.end()) {
+                    if (PSCharClass::isHexDigit(*p))
+                        --digits;
+                    ++p;
                 }
             }
+
+            if (p <= src.end())
+                src = OctetCursor(p, src.end() - p);
         }
+    };
 
-        bool isEOF() const override
+
+    //=====================================================
+    // Encode Filter
+    //
+    // What the encode filters have in common.  What is written is gathered
+    // into a block, and each full block is encoded in one go, and goes to
+    // the target in one write.  Closing the filter encodes what is left,
+    // and writes the end of data marker; the target is flushed, but stays
+    // open.
+    //
+    // A filter only says how to encode a block (encodeBlock).
+    //=====================================================
+    class PSEncodeFilter : public PSFile
+    {
+    public:
+        static constexpr size_t kBlockSize = 64 * 1024;    // bytes gathered per encode
+
+        bool isValid() const override { return _target != nullptr; }
+        bool isWritable() const override { return !_closed; }
+        bool isEOF() const override { return true; }
+
+        size_t position() const override { return _written; }
+
+        bool writeBytes(const uint8_t* data, size_t count) override
         {
-            return _finished && (_pos >= _count);
+            if (_closed)
+                return false;
+
+            _written += count;
+
+            while (count > 0) {
+                size_t chunk = std::min(count, kBlockSize - _in.size());
+                _in.insert(_in.end(), data, data + chunk);
+                data += chunk;
+                count -= chunk;
+
+                if (_in.size() == kBlockSize && !encode(false))
+                    return false;
+            }
+
+            return true;
         }
 
-        //bool hasCursor() const override { return false; }
-        void finalize() override
+        // Encode what can be, and push it on to the target.  An encoding
+        // that works in groups may hold on to a few bytes until more come.
+        bool flush() override
         {
-            if (_finished)
+            if (_closed)
+                return true;
+
+            return encode(false) && _target->flush();
+        }
+
+        void close() override
+        {
+            if (_closed)
                 return;
-            // Try to read until EOD
-            uint8_t control;
-            while (_source->readByte(control)) {
-                if (control == 128) {
-                    _finished = true;
-                    return; // EOD
+
+            encode(true);
+            _target->flush();
+            _closed = true;
+        }
+
+        void finalize() override { close(); }
+
+    protected:
+        explicit PSEncodeFilter(std::shared_ptr<PSFile> target)
+            : _target(std::move(target))
+        {
+            _in.reserve(kBlockSize);
+        }
+
+        // Encode from 'in', appending to _out, and return how many of the
+        // 'count' bytes were taken.  'last' is the end of the data; it is
+        // all to be taken, and the end of data marker written.
+        virtual size_t encodeBlock(const uint8_t* in, size_t count, bool last) = 0;
+
+        std::shared_ptr<PSFile> _target;
+        std::vector<uint8_t> _out;
+
+    private:
+        bool encode(bool last)
+        {
+            size_t used = encodeBlock(_in.data(), _in.size(), last);
+            _in.erase(_in.begin(), _in.begin() + used);
+
+            bool ok = _out.empty() || _target->writeBytes(_out.data(), _out.size());
+            _out.clear();
+            return ok;
+        }
+
+        std::vector<uint8_t> _in;
+        size_t _written = 0;
+        bool _closed = false;
+    };
+
+
+    //=====================================================
+    // ASCII Hex Encode Filter
+    //
+    // Two lowercase digits a byte, through encodeHex(), in lines of 64
+    // digits.  '>' ends the data.
+    //=====================================================
+    class ASCIIHexEncodeFilter : public PSEncodeFilter
+    {
+    public:
+        static constexpr size_t kLineBytes = 32;
+
+        explicit ASCIIHexEncodeFilter(std::shared_ptr<PSFile> target)
+            : PSEncodeFilter(std::move(target))
+        {
+        }
+
+    protected:
+        size_t encodeBlock(const uint8_t* in, size_t count, bool last) override
+        {
+            size_t start = _out.size();
+            _out.resize(start + count * 2 + count / kLineBytes + 2);
+            uint8_t* dst = _out.data() + start;
+
+            size_t i = 0;
+            while (i < count) {
+                size_t n = std::min(count - i, kLineBytes - _column);
+                encodeHex(in + i, n, dst);
+                dst += n * 2;
+                i += n;
+                _column += n;
+                if (_column == kLineBytes) {
+                    *dst++ = '\n';
+                    _column = 0;
                 }
-                // Ignore other bytes, we just want to reach EOD
             }
-            _source->finalize();
-            _finished = true;
+
+            if (last)
+                *dst++ = '>';
+
+            _out.resize(dst - _out.data());
+            return count;
         }
 
+    private:
+        size_t _column = 0;     // bytes on the current line
+    };
+
+
+    //=====================================================
+    // ASCII85 Encode Filter
+    //
+    // Four bytes to five characters, 'z' for four zeros, in lines of no
+    // more than 75 characters.  A short last group of n bytes is n+1 
+    // characters.  '~>' ends the data.
+    //=====================================================
+    class ASCII85EncodeFilter : public PSEncodeFilter
+    {
+    public:
+        static constexpr size_t kLineLength = 75;
+
+        explicit ASCII85EncodeFilter(std::shared_ptr<PSFile> target)
+            : PSEncodeFilter(std::move(target))
+        {
+        }
+
+    protected:
+        size_t encodeBlock(const uint8_t* in, size_t count, bool last) override
+        {
+            size_t groups = count / 4;
+            size_t start = _out.size();
+            _out.resize(start + (groups + 1) * 5 + (groups + 1) * 5 / (kLineLength - 4) + 4);
+            uint8_t* dst = _out.data() + start;
 
+            for (size_t g = 0; g < groups; ++g) {
+                const uint8_t* p = in + g * 4;
+                uint32_t value = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+                if (value == 0) {
+                    *dst++ = 'z';
+                    ++_column;
+                }
+                else {
+                    putGroup(value, 5, dst);
+                    dst += 5;
+                    _column += 5;
+                }
+
+                if (_column >= kLineLength - 4) {
+                    *dst++ = '\n';
+                    _column = 0;
+                }
+            }
+
+            size_t used = groups * 4;
+            if (last) {
+                // The short last group, and ~>, on the line if they fit
+                size_t rest = count - used;
+                if (_column + (rest > 0 ? rest + 1 : 0) + 2 > kLineLength) {
+                    *dst++ = '\n';
+                    _column = 0;
+                }
+                if (rest > 0) {
+                    uint32_t value = 0;
+                    for (size_t k = 0; k < 4; ++k)
+                        value = (value << 8) | (k < rest ? in[used + k] : 0);
+                    putGroup(value, rest + 1, dst);
+                    dst += rest + 1;
+                }
+                *dst++ = '~';
+                *dst++ = '>';
+                used = count;
+            }
+
+            _out.resize(dst - _out.data());
+            return used;
+        }
 
     private:
-        enum class Mode { Idle, Literal, Repeat };
+        // The first 'count' of the five characters for 'value'
+        static void putGroup(uint32_t value, size_t count, uint8_t* dst) noexcept
+        {
+            uint8_t chars[5];
+            for (int k = 4; k >= 0; --k) {
+                chars[k] = static_cast<uint8_t>('!' + value % 85);
+                value /= 85;
+            }
+            std::memcpy(dst, chars, count);
+        }
 
-        std::shared_ptr<PSFile> _source;
-        std::vector<uint8_t> _buffer;
-        size_t _pos;
-        size_t _count;
-        bool _finished;
-        Mode _mode;
+        size_t _column = 0;
     };
 
 
+    //=====================================================
+    // Run Length Encode Filter
+    //
+    // Runs of three or more of a byte are a repeat (257 - n, byte), the
+    // rest go as literals (n - 1, bytes), neither more than 128 bytes.
+    // 128 ends the data.  With a record size, no run or literal crosses
+    // the end of a record.  Runs are looked for 16 bytes at a time.
+    //=====================================================
+    class RunLengthEncodeFilter : public PSEncodeFilter
+    {
+    public:
+        static constexpr size_t kMaxRun = 128;
 
-}
+        explicit RunLengthEncodeFilter(std::shared_ptr<PSFile> target, size_t recordSize = 0)
+            : PSEncodeFilter(std::move(target))
+            , _recordSize(recordSize)
+            , _recordLeft(recordSize)
+        {
+        }
+
+    protected:
+        size_t encodeBlock(const uint8_t* in, size_t count, bool last) override
+        {
+            // Until the last block, leave enough at the end that a run or
+            // literal is never cut short by where the block ends
+            size_t limit = last ? count : (count > kMaxRun + 2 ? count - (kMaxRun + 2) : 0);
+
+            // A literal costs one byte more than it holds, a repeat at
+            // least one less, and there is a literal for every 128 bytes,
+            // or end of a record, at most
+            size_t start = _out.size();
+            size_t units = count / kMaxRun + (_recordSize ? count / _recordSize + 1 : 0) + 2;
+            _out.resize(start + count + units);
+            uint8_t* dst = _out.data() + start;
 
+            size_t i = 0;
+            while (i < limit) {
+                size_t end = _recordSize ? std::min(count, i + _recordLeft) : count;
+                size_t most = std::min(end - i, kMaxRun);
 
+                size_t run = runLength(in + i, most);
+                size_t n;
+                if (run >= 3) {
+                    *dst++ = static_cast<uint8_t>(257 - run);
+                    *dst++ = in[i];
+                    n = run;
+                }
+                else {
+                    n = findRun(in, i, std::min(end, i + kMaxRun), end) - i;
+                    *dst++ = static_cast<uint8_t>(n - 1);
+                    std::memcpy(dst, in + i, n);
+                    dst += n;
+                }
+
+                i += n;
+                if (_recordSize) {
+                    _recordLeft -= n;
+                    if (_recordLeft == 0)
+                        _recordLeft = _recordSize;
+                }
+            }
+
+            if (last)
+                *dst++ = 128;
+
+            _out.resize(dst - _out.data());
+            return i;
+        }
+
+    private:
+        // How many of the first 'most' bytes are the same as the first
+        static size_t runLength(const uint8_t* p, size_t most) noexcept
+        {
+            size_t n = 1;
+#if defined(WAAVS_CHARSCAN_SSE2)
+            __m128i value = _mm_set1_epi8(static_cast<char>(p[0]));
+            while (n + 16 <= most) {
+                uint32_t same = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + n)), value)));
+                if (same != 0xFFFF)
+                    return n + lowestBitIndex(~same);
+                n += 16;
+            }
+#endif
+            while (n < most && p[n] == p[0])
+                ++n;
+            return n;
+        }
+
+        // Where the first run of three starts, from 'i', before 'stop';
+        // 'stop' if there is none.  A run can only be seen up to 'end'.
+        static size_t findRun(const uint8_t* in, size_t i, size_t stop, size_t end) noexcept
+        {
+            size_t k = i;
+#if defined(WAAVS_CHARSCAN_SSE2)
+            while (k < stop && k + 18 <= end) {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + k));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + k + 1));
+                __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + k + 2));
+                uint32_t bits = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, b), _mm_cmpeq_epi8(b, c))));
+                if (bits)
+                    return std::min(k + lowestBitIndex(bits), stop);
+                k += 16;
+            }
+#endif
+            for (; k < stop; ++k) {
+                if (k + 2 < end && in[k] == in[k + 1] && in[k] == in[k + 2])
+                    return k;
+            }
+            return stop;
+        }
+
+        size_t _recordSize;
+        size_t _recordLeft;
+    };
+
+
+    //=====================================================
+    // Flate Encode Filter
+    //
+    // zlib/deflate data, through PSDeflater, a block at a time
+    //=====================================================
+    class FlateEncodeFilter : public PSEncodeFilter
+    {
+    public:
+        explicit FlateEncodeFilter(std::shared_ptr<PSFile> target)
+            : PSEncodeFilter(std::move(target))
+            , _deflater(std::make_unique<PSDeflater>())
+        {
+        }
+
+    protected:
+        size_t encodeBlock(const uint8_t* in, size_t count, bool last) override
+        {
+            _deflater->compress(in, count, last, _out);
+            return count;
+        }
+
+    private:
+        std::unique_ptr<PSDeflater> _deflater;
+    };
+
+
+}
@@ -0,0 +1,344 @@
+#pragma once
+
+#include <cstring>
+
+#include "ps_charscan.h"
+#include "typeconv.h"
+
+//
+// Hex decoding
+//
+// Hex data turns up in three places: <hex string> literals, readhexstring,
+// and the ASCIIHexDecode filter.  Images in EPS files are mostly stored
+// this way, often hundreds of kilobytes of them, so all three decode
+// through the one kernel here.  Going the other way, writehexstring and
+// the ASCIIHexEncode filter share encodeHex().
+//
+// Hex data is mostly long lines of digits, broken by a newline every 64
+// or so.  So runs of digits are decoded 16 or 32 at a time, with the same
+// instruction set choice as ps_charscan.h, and whatever is not a run of
+// digits (whitespace, an odd nibble, the end) is done a byte at a time.
+//
+
+namespace waavs {
+
+#if defined(WAAVS_CHARSCAN_SSE2)
+    // 0xFF in the lanes that are hex digits, and the value of each digit
+    static INLINE __m128i hexNibbles16(__m128i v, __m128i& valid) noexcept
+    {
+        // unsigned compares, by flipping the sign bit
+        const __m128i sign = _mm_set1_epi8(static_cast<char>(0x80));
+        __m128i digit = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+        __m128i alpha = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+        __m128i isDigit = _mm_cmplt_epi8(_mm_xor_si128(digit, sign), _mm_set1_epi8(static_cast<char>(0x80 + 10)));
+        __m128i isAlpha = _mm_cmplt_epi8(_mm_xor_si128(alpha, sign), _mm_set1_epi8(static_cast<char>(0x80 + 6)));
+
+        valid = _mm_or_si128(isDigit, isAlpha);
+        return _mm_or_si128(_mm_and_si128(isDigit, digit), _mm_and_si128(isAlpha, _mm_add_epi8(alpha, _mm_set1_epi8(10))));
+    }
+
+    // Pairs of nibbles, high first, into one byte in each 16 bit lane
+    static INLINE __m128i hexPairs16(__m128i nibbles) noexcept
+    {
+        __m128i hi = _mm_slli_epi16(_mm_and_si128(nibbles, _mm_set1_epi16(0x00FF)), 4);
+        return _mm_or_si128(hi, _mm_srli_epi16(nibbles, 8));
+    }
+#endif
+
+#if defined(WAAVS_CHARSCAN_AVX2)
+    static INLINE __m256i hexNibbles32(__m256i v, __m256i& valid) noexcept
+    {
+        const __m256i sign = _mm256_set1_epi8(static_cast<char>(0x80));
+        __m256i digit = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+        __m256i alpha = _mm256_sub_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+        __m256i isDigit = _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(0x80 + 10)), _mm256_xor_si256(digit, sign));
+        __m256i isAlpha = _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(0x80 + 6)), _mm256_xor_si256(alpha, sign));
+
+        valid = _mm256_or_si256(isDigit, isAlpha);
+        return _mm256_or_si256(_mm256_and_si256(isDigit, digit), _mm256_and_si256(isAlpha, _mm256_add_epi8(alpha, _mm256_set1_epi8(10))));
+    }
+
+    static INLINE __m256i hexPairs32(__m256i nibbles) noexcept
+    {
+        __m256i hi = _mm256_slli_epi16(_mm256_and_si256(nibbles, _mm256_set1_epi16(0x00FF)), 4);
+        return _mm256_or_si256(hi, _mm256_srli_epi16(nibbles, 8));
+    }
+#endif
+
+#if defined(WAAVS_CHARSCAN_NEON)
+    static INLINE uint8x16_t hexNibbles16(uint8x16_t v, uint8x16_t& valid) noexcept
+    {
+        uint8x16_t digit = vsubq_u8(v, vdupq_n_u8('0'));
+        uint8x16_t alpha = vsubq_u8(vorrq_u8(v, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+        uint8x16_t isDigit = vcltq_u8(digit, vdupq_n_u8(10));
+        uint8x16_t isAlpha = vcltq_u8(alpha, vdupq_n_u8(6));
+
+        valid = vorrq_u8(isDigit, isAlpha);
+        return vorrq_u8(vandq_u8(isDigit, digit), vandq_u8(isAlpha, vaddq_u8(alpha, vdupq_n_u8(10))));
+    }
+#endif
+
+    // decodeHexRun
+    // Decode runs of hex digits from 'p' into 'dst', which has room for
+    // 'room' bytes, as many vector steps as there are.  Whitespace after a
+    // run with an even number of digits is skipped, so a line break does
+    // not end it.  Returns the number of bytes decoded, with 'p' left at 
+    // what the vector steps could not take; a run too short, an odd digit,
+    // or something that is not hex data.
+    static INLINE size_t decodeHexRun(const uint8_t*& p, const uint8_t* end, uint8_t* dst, size_t room) noexcept
+    {
+        uint8_t* out = dst;
+
+#if defined(WAAVS_CHARSCAN_SSE2) || defined(WAAVS_CHARSCAN_NEON)
+        for (;;) {
+#if defined(WAAVS_CHARSCAN_AVX2)
+            // 64 digits, 32 bytes
+            while (end - p >= 64 && room - (out - dst) >= 32) {
+                __m256i valid0, valid1;
+                __m256i n0 = hexNibbles32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), valid0);
+                __m256i n1 = hexNibbles32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32)), valid1);
+                if (static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(valid0, valid1))) != 0xFFFFFFFFu)
+                    break;
+
+                // the pack works within each 128 bit half, put the quarters back in order
+                __m256i packed = _mm256_packus_epi16(hexPairs32(n0), hexPairs32(n1));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_permute4x64_epi64(packed, 0xD8));
+                p += 64;
+                out += 32;
+            }
+#endif
+
+#if defined(WAAVS_CHARSCAN_SSE2)
+            // 32 digits, 16 bytes
+            while (end - p >= 32 && room - (out - dst) >= 16) {
+                __m128i valid0, valid1;
+                __m128i n0 = hexNibbles16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), valid0);
+                __m128i n1 = hexNibbles16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16)), valid1);
+                if (_mm_movemask_epi8(_mm_and_si128(valid0, valid1)) != 0xFFFF)
+                    break;
+
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(hexPairs16(n0), hexPairs16(n1)));
+                p += 32;
+                out += 16;
+            }
+
+            // 16 digits, 8 bytes, for what is left of a line.  A line that
+            // ends part way goes through a temporary, so only the pairs
+            // ahead of the line end are written; 'out' may be the caller's
+            // string, and the bytes after what was decoded are not ours.
+            uint32_t digits = 0;
+            while (end - p >= 16 && room - (out - dst) >= 8) {
+                __m128i valid;
+                __m128i n = hexNibbles16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), valid);
+                uint32_t bits = static_cast<uint32_t>(_mm_movemask_epi8(valid));
+                __m128i packed = _mm_packus_epi16(hexPairs16(n), hexPairs16(n));
+
+                if (bits != 0xFFFF) {
+                    alignas(16) uint8_t partial[16];
+                    _mm_store_si128(reinterpret_cast<__m128i*>(partial), packed);
+                    digits = lowestBitIndex(~bits);
+                    std::memcpy(out, partial, digits / 2);
+                    p += digits & ~1u;
+                    out += digits / 2;
+                    break;
+                }
+
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(out), packed);
+                p += 16;
+                out += 8;
+            }
+#else
+            // 32 digits, 16 bytes, split into high and low digits as they load
+            uint32_t digits = 0;
+            while (end - p >= 32 && room - (out - dst) >= 16) {
+                uint8x16x2_t v = vld2q_u8(p);
+                uint8x16_t validHi, validLo;
+                uint8x16_t hi = hexNibbles16(v.val[0], validHi);
+                uint8x16_t lo = hexNibbles16(v.val[1], validLo);
+                if (laneBits16(vandq_u8(validHi, validLo)) != ~uint64_t(0))
+                    break;
+
+                vst1q_u8(out, vorrq_u8(vshlq_n_u8(hi, 4), lo));
+                p += 32;
+                out += 16;
+            }
+#endif
+
+            // Carry on past the line end, unless a digit was left over
+            if ((digits & 1) || p == end || !PSCharClass::isWhitespace(*p))
+                break;
+
+            p = scanWhitespace(p, end);
+        }
+#else
+        // pairs of digits, checked through the table.  A digit's value is
+        // its low 4 bits, plus 9 for a letter, which has bit 6 set.
+        while (end - p >= 2 && out - dst < static_cast<ptrdiff_t>(room)) {
+            if (!PSCharClass::isHexDigit(p[0]) || !PSCharClass::isHexDigit(p[1]))
+                break;
+            uint8_t hi = static_cast<uint8_t>((p[0] & 0x0F) + ((p[0] >> 6) * 9));
+            uint8_t lo = static_cast<uint8_t>((p[1] & 0x0F) + ((p[1] >> 6) * 9));
+            *out++ = static_cast<uint8_t>((hi << 4) | lo);
+            p += 2;
+        }
+#endif
+
+        return out - dst;
+    }
+
+
+    // encodeHex
+    // 'count' bytes from 'src', as two lowercase hex digits each, high
+    // first, into 'dst', which has room for 2 * count
+#if defined(WAAVS_CHARSCAN_SSE2)
+    static INLINE __m128i hexChars16(__m128i nibbles) noexcept
+    {
+        __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)), _mm_set1_epi8('a' - '0' - 10));
+        return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letter);
+    }
+#endif
+
+#if defined(WAAVS_CHARSCAN_AVX2)
+    static INLINE __m256i hexChars32(__m256i nibbles) noexcept
+    {
+        __m256i letter = _mm256_and_si256(_mm256_cmpgt_epi8(nibbles, _mm256_set1_epi8(9)), _mm256_set1_epi8('a' - '0' - 10));
+        return _mm256_add_epi8(_mm256_add_epi8(nibbles, _mm256_set1_epi8('0')), letter);
+    }
+#endif
+
+    static INLINE void encodeHex(const uint8_t* src, size_t count, uint8_t* dst) noexcept
+    {
+        static const char kDigits[] = "0123456789abcdef";
+        const uint8_t* end = src + count;
+
+#if defined(WAAVS_CHARSCAN_AVX2)
+        // the unpacks work within each 128 bit half, put the halves back in order
+        while (end - src >= 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+            __m256i hi = hexChars32(_mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F)));
+            __m256i lo = hexChars32(_mm256_and_si256(v, _mm256_set1_epi8(0x0F)));
+            __m256i a = _mm256_unpacklo_epi8(hi, lo);
+            __m256i b = _mm256_unpackhi_epi8(hi, lo);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), _mm256_permute2x128_si256(a, b, 0x20));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 32), _mm256_permute2x128_si256(a, b, 0x31));
+            src += 32;
+            dst += 64;
+        }
+#endif
+
+#if defined(WAAVS_CHARSCAN_SSE2)
+        while (end - src >= 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+            __m128i hi = hexChars16(_mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0F)));
+            __m128i lo = hexChars16(_mm_and_si128(v, _mm_set1_epi8(0x0F)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi8(hi, lo));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_unpackhi_epi8(hi, lo));
+            src += 16;
+            dst += 32;
+        }
+#elif defined(WAAVS_CHARSCAN_NEON)
+        // the store interleaves the high and low digits
+        while (end - src >= 16) {
+            uint8x16_t v = vld1q_u8(src);
+            uint8x16_t hi = vshrq_n_u8(v, 4);
+            uint8x16_t lo = vandq_u8(v, vdupq_n_u8(0x0F));
+            uint8x16x2_t chars;
+            chars.val[0] = vaddq_u8(vaddq_u8(hi, vdupq_n_u8('0')), vandq_u8(vcgtq_u8(hi, vdupq_n_u8(9)), vdupq_n_u8('a' - '0' - 10)));
+            chars.val[1] = vaddq_u8(vaddq_u8(lo, vdupq_n_u8('0')), vandq_u8(vcgtq_u8(lo, vdupq_n_u8(9)), vdupq_n_u8('a' - '0' - 10)));
+            vst2q_u8(dst, chars);
+            src += 16;
+            dst += 32;
+        }
+#endif
+
+        while (src < end) {
+            *dst++ = static_cast<uint8_t>(kDigits[*src >> 4]);
+            *dst++ = static_cast<uint8_t>(kDigits[*src & 0x0F]);
+            ++src;
+        }
+    }
+
+
+    // PSHexDecoder
+    //
+    // Decodes hex data that may come in pieces, as from a file a window
+    // at a time; a digit left over at the end of one piece pairs up with
+    // the first one of the next.  Whitespace is skipped.
+    //
+    // What else may be in the data depends on who is reading it
+    //   stopAtOther  false - anything that is not a digit is skipped (readhexstring)
+    //                true  - '>' is the end of the data, and is consumed,
+    //                        anything else stops the decoding where it is,
+    //                        and is an error (hex strings, ASCIIHexDecode)
+    //
+    struct PSHexDecoder
+    {
+        bool fStopAtOther{ true };
+        bool fHaveHigh{ false };
+        uint8_t fHigh{ 0 };
+        bool fEOD{ false };         // saw the '>'
+        bool fInvalid{ false };     // stopped at something that is not hex data
+
+        explicit PSHexDecoder(bool stopAtOther = true) noexcept : fStopAtOther(stopAtOther) {}
+
+        bool isDone() const noexcept { return fEOD || fInvalid; }
+
+        // Decode from 'src' into 'dst', up to 'room' bytes.  Stops when
+        // 'dst' is full, 'src' is used up, or the data ends.  'src' is
+        // advanced past what was decoded, and the number of bytes decoded
+        // is returned.
+        size_t decode(OctetCursor& src, uint8_t* dst, size_t room) noexcept
+        {
+            const uint8_t* p = src.begin();
+            const uint8_t* end = src.end();
+            size_t n = 0;
+
+            while (n < room && p < end && !isDone()) {
+                if (!fHaveHigh) {
+                    n += decodeHexRun(p, end, dst + n, room - n);
+                    if (n == room || p == end)
+                        break;
+                }
+
+                uint8_t c = *p;
+                uint8_t nibble;
+                if (hexToNibble(c, nibble)) {
+                    ++p;
+                    if (fHaveHigh) {
+                        dst[n++] = static_cast<uint8_t>((fHigh << 4) | nibble);
+                        fHaveHigh = false;
+                    }
+                    else {
+                        fHigh = nibble;
+                        fHaveHigh = true;
+                    }
+                }
+                else if (PSCharClass::isWhitespace(c) || !fStopAtOther) {
+                    ++p;
+                }
+                else if (c == '>') {
+                    ++p;
+                    fEOD = true;
+                }
+                else {
+                    fInvalid = true;
+                }
+            }
+
+            src.fStart = p;
+            return n;
+        }
+
+        // A digit left over at the end of the data, is taken as if it
+        // were followed by a '0'.  False when there is none.
+        bool finish(uint8_t& out) noexcept
+        {
+            if (!fHaveHigh)
+                return false;
+
+            out = static_cast<uint8_t>(fHigh << 4);
+            fHaveHigh = false;
+            return true;
+        }
+    };
+}
@@ -0,0 +1,567 @@
+#pragma once
+
+#include "ps_type_file.h"
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+//
+// Inflate
+//
+// Decompression of zlib streams (RFC 1950) of deflate data (RFC 1951),
+// for the FlateDecode filter.
+//
+// It is a streaming decoder; the data is pulled from a file with a cursor,
+// a window at a time, and decoded into a fixed ring buffer that holds the
+// last 32K of output, which is all a match can reach back to.  So a stream
+// of any size is decoded in bounded memory, and a caller can ask for as
+// little or as much of it at a time as it wants.
+//
+// Huffman codes are decoded through a lookup table on the next 10 bits,
+// which covers nearly every code in practice, and canonical code ranges
+// for anything longer.  Bits are held 64 at a time.
+//
+
+namespace waavs {
+
+    struct PSHuffmanTable
+    {
+        static constexpr int kFastBits = 10;
+        static constexpr uint32_t kFastMask = (1u << kFastBits) - 1;
+
+        // symbol | (length << 9), zero for a code longer than kFastBits
+        uint16_t fFast[1u << kFastBits];
+
+        // For codes longer than kFastBits, by length; the first code of
+        // each length, left aligned in 16 bits, one past the last, and
+        // where its symbols start in fSymbols
+        uint16_t fFirstCode[17];
+        uint32_t fMaxCode[18];
+        uint16_t fFirstSymbol[17];
+        uint16_t fSymbols[288];
+
+        static uint32_t reverseBits(uint32_t v, int count) noexcept
+        {
+            v = ((v & 0xAAAA) >> 1) | ((v & 0x5555) << 1);
+            v = ((v & 0xCCCC) >> 2) | ((v & 0x3333) << 2);
+            v = ((v & 0xF0F0) >> 4) | ((v & 0x0F0F) << 4);
+            v = ((v & 0xFF00) >> 8) | ((v & 0x00FF) << 8);
+            return v >> (16 - count);
+        }
+
+        // Build from the code length of each symbol.  False if the lengths
+        // do not make a code.
+        bool build(const uint8_t* lengths, int count) noexcept
+        {
+            int lengthCount[16] = {};
+            for (int i = 0; i < count; ++i)
+                ++lengthCount[lengths[i]];
+            lengthCount[0] = 0;
+
+            // No more codes of a length than there is room for
+            for (int len = 1; len < 16; ++len)
+                if (lengthCount[len] > (1 << len))
+                    return false;
+
+            std::memset(fFast, 0, sizeof(fFast));
+
+            int nextCode[16];
+            int code = 0;
+            int symbol = 0;
+            for (int len = 1; len < 16; ++len) {
+                nextCode[len] = code;
+                fFirstCode[len] = static_cast<uint16_t>(code);
+                fFirstSymbol[len] = static_cast<uint16_t>(symbol);
+                code += lengthCount[len];
+                if (lengthCount[len] && code - 1 >= (1 << len))
+                    return false;
+                fMaxCode[len] = static_cast<uint32_t>(code << (16 - len));
+                code <<= 1;
+                symbol += lengthCount[len];
+            }
+            fMaxCode[16] = 0x10000;
+
+            for (int i = 0; i < count; ++i) {
+                int len = lengths[i];
+                if (len == 0)
+                    continue;
+
+                int c = nextCode[len]++;
+                fSymbols[fFirstSymbol[len] + (c - fFirstCode[len])] = static_cast<uint16_t>(i);
+
+                if (len <= kFastBits) {
+                    uint16_t entry = static_cast<uint16_t>(i | (len << 9));
+                    for (uint32_t j = reverseBits(c, len); j < (1u << kFastBits); j += (1u << len))
+                        fFast[j] = entry;
+                }
+            }
+
+            return true;
+        }
+    };
+
+
+    class PSInflater
+    {
+    public:
+        static constexpr size_t kRingSize = 32 * 1024;
+        static constexpr size_t kRingMask = kRingSize - 1;
+
+        // The source has to have a cursor
+        explicit PSInflater(std::shared_ptr<PSFile> source)
+            : fSource(std::move(source))
+        {
+        }
+
+        bool isDone() const noexcept { return fState == State::Done || fState == State::Error; }
+        bool hasError() const noexcept { return fState == State::Error; }
+
+        // Decode up to 'room' bytes into 'out', returning how many.  Zero
+        // is the end of the stream, or data that could not be decoded.
+        size_t inflate(uint8_t* out, size_t room)
+        {
+            size_t n = 0;
+
+            // Decode into the ring, and copy out.  No more than half of it
+            // at a time, so what was just decoded is still there to copy.
+            while (n < room && !isDone()) {
+                size_t want = std::min(room - n, kRingSize / 2);
+                size_t start = fPos;
+                size_t got = decode(want);
+                if (got == 0)
+                    continue;
+
+                size_t first = std::min(got, kRingSize - (start & kRingMask));
+                std::memcpy(out + n, fRing + (start & kRingMask), first);
+                std::memcpy(out + n + first, fRing, got - first);
+                n += got;
+            }
+
+            return n;
+        }
+
+    private:
+        enum class State { Header, BlockHeader, Stored, Huffman, Trailer, Done, Error };
+
+        // Bits
+        // Whole bytes are taken from the source's cursor, as many as fit,
+        // but the source is only refilled when the bits wanted are not
+        // there.  So any bytes loaded past the end of the stream come from
+        // the source's current window, and can be put back.
+        bool need(uint32_t count)
+        {
+            while (fBitCount < count) {
+                OctetCursor& in = fSource->getCursor();
+                if (in.empty() && !fSource->refill())
+                    return false;
+                fill();
+            }
+            return true;
+        }
+
+        void fill() noexcept
+        {
+            OctetCursor& in = fSource->getCursor();
+            const uint8_t* p = in.begin();
+            const uint8_t* end = in.end();
+            while (fBitCount <= 56 && p < end) {
+                fBits |= static_cast<uint64_t>(*p++) << fBitCount;
+                fBitCount += 8;
+            }
+            in.fStart = p;
+        }
+
+        uint32_t peek(uint32_t count) const noexcept { return static_cast<uint32_t>(fBits & ((uint64_t(1) << count) - 1)); }
+
+        void drop(uint32_t count) noexcept
+        {
+            fBits >>= count;
+            fBitCount -= count;
+        }
+
+        bool bits(uint32_t count, uint32_t& value)
+        {
+            if (!need(count))
+                return false;
+            value = peek(count);
+            drop(count);
+            return true;
+        }
+
+        // The next symbol of a code, -1 at the end of the input, or
+        // on a code that is not in the table.  There are always more than
+        // 15 bits after a symbol, the stream ends with a checksum, so
+        // looking ahead that far does not read past the end.
+        int symbol(const PSHuffmanTable& table)
+        {
+            if (fBitCount < 15 && !need(15)) {
+                // A short stream; take what there is
+                if (fBitCount == 0)
+                    return -1;
+            }
+
+            uint16_t entry = table.fFast[fBits & PSHuffmanTable::kFastMask];
+            if (entry) {
+                uint32_t len = entry >> 9;
+                if (len > fBitCount)
+                    return -1;
+                drop(len);
+                return entry & 0x1FF;
+            }
+
+            // Longer codes; compare against the end of each length's range
+            uint32_t code = PSHuffmanTable::reverseBits(static_cast<uint32_t>(fBits & 0xFFFF), 16);
+            uint32_t len = PSHuffmanTable::kFastBits + 1;
+            while (len < 16 && code >= table.fMaxCode[len])
+                ++len;
+            if (len >= 16 || len > fBitCount)
+                return -1;
+
+            uint32_t index = table.fFirstSymbol[len] + ((code >> (16 - len)) - table.fFirstCode[len]);
+            if (index >= 288)
+                return -1;
+
+            drop(len);
+            return table.fSymbols[index];
+        }
+
+        bool fail()
+        {
+            fState = State::Error;
+            return false;
+        }
+
+        bool readHeader()
+        {
+            uint32_t cmf, flg;
+            if (!bits(8, cmf) || !bits(8, flg))
+                return fail();
+
+            // deflate, a window of no more than 32K, no preset dictionary
+            if ((cmf & 0x0F) != 8 || (cmf >> 4) > 7 || ((cmf << 8) | flg) % 31 != 0 || (flg & 0x20))
+                return fail();
+
+            fState = State::BlockHeader;
+            return true;
+        }
+
+        bool readBlockHeader()
+        {
+            if (fLastBlock) {
+                fState = State::Trailer;
+                return true;
+            }
+
+            uint32_t header;
+            if (!bits(3, header))
+                return fail();
+
+            fLastBlock = (header & 1) != 0;
+
+            switch (header >> 1) {
+            case 0: {
+                // stored; on a byte boundary, a length and its complement
+                drop(fBitCount & 7);
+                uint32_t len, nlen;
+                if (!bits(16, len) || !bits(16, nlen) || (len ^ 0xFFFF) != nlen)
+                    return fail();
+                fStoredLeft = len;
+                fState = State::Stored;
+                return true;
+            }
+
+            case 1:
+                buildFixedTables();
+                fState = State::Huffman;
+                return true;
+
+            case 2:
+                if (!readDynamicTables())
+                    return fail();
+                fState = State::Huffman;
+                return true;
+
+            default:
+                return fail();
+            }
+        }
+
+        void buildFixedTables()
+        {
+            if (!fFixedBuilt) {
+                uint8_t lengths[288 + 32];
+                std::memset(lengths, 8, 144);
+                std::memset(lengths + 144, 9, 112);
+                std::memset(lengths + 256, 7, 24);
+                std::memset(lengths + 280, 8, 8);
+                std::memset(lengths + 288, 5, 32);
+                fFixedLiterals.build(lengths, 288);
+                fFixedDistances.build(lengths + 288, 32);
+                fFixedBuilt = true;
+            }
+
+            fLiterals = &fFixedLiterals;
+            fDistances = &fFixedDistances;
+        }
+
+        bool readDynamicTables()
+        {
+            static constexpr uint8_t kOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+            uint32_t hlit, hdist, hclen;
+            if (!bits(5, hlit) || !bits(5, hdist) || !bits(4, hclen))
+                return false;
+            hlit += 257;
+            hdist += 1;
+            hclen += 4;
+            if (hlit > 286 || hdist > 30)
+                return false;
+
+            uint8_t codeLengths[19] = {};
+            for (uint32_t i = 0; i < hclen; ++i) {
+                uint32_t len;
+                if (!bits(3, len))
+                    return false;
+                codeLengths[kOrder[i]] = static_cast<uint8_t>(len);
+            }
+
+            PSHuffmanTable& lengthCode = fDynamicDistances;     // only needed until the lengths are read
+            if (!lengthCode.build(codeLengths, 19))
+                return false;
+
+            uint8_t lengths[286 + 30] = {};
+            uint32_t count = hlit + hdist;
+            uint32_t i = 0;
+            while (i < count) {
+                int sym = symbol(lengthCode);
+                if (sym < 0)
+                    return false;
+
+                if (sym < 16) {
+                    lengths[i++] = static_cast<uint8_t>(sym);
+                    continue;
+                }
+
+                uint32_t repeat;
+                uint8_t value = 0;
+                if (sym == 16) {
+                    if (i == 0 || !bits(2, repeat))
+                        return false;
+                    value = lengths[i - 1];
+                    repeat += 3;
+                }
+                else if (sym == 17) {
+                    if (!bits(3, repeat))
+                        return false;
+                    repeat += 3;
+                }
+                else {
+                    if (!bits(7, repeat))
+                        return false;
+                    repeat += 11;
+                }
+
+                if (i + repeat > count)
+                    return false;
+                std::memset(lengths + i, value, repeat);
+                i += repeat;
+            }
+
+            // There has to be an end of block code
+            if (lengths[256] == 0)
+                return false;
+
+            if (!fDynamicLiterals.build(lengths, hlit) || !fDynamicDistances.build(lengths + hlit, hdist))
+                return false;
+
+            fLiterals = &fDynamicLiterals;
+            fDistances = &fDynamicDistances;
+            return true;
+        }
+
+        // Copy what is left of a match, up to 'room' bytes of it
+        size_t copyMatch(size_t room) noexcept
+        {
+            size_t len = std::min(fMatchLeft, room);
+            size_t to = fPos & kRingMask;
+            size_t from = (fPos - fMatchDistance) & kRingMask;
+
+            // A match reaches back at least as far as it is long, so what
+            // it copies from is never what it is writing, in the stream.
+            // In the ring, the two can overlap near a 32K distance.
+            if (fMatchDistance >= len && to + len <= kRingSize && from + len <= kRingSize) {
+                std::memmove(fRing + to, fRing + from, len);
+            }
+            else if (fMatchDistance == 1) {
+                uint8_t value = fRing[from];
+                for (size_t i = 0; i < len; ++i)
+                    fRing[(to + i) & kRingMask] = value;
+            }
+            else {
+                for (size_t i = 0; i < len; ++i)
+                    fRing[(to + i) & kRingMask] = fRing[(from + i) & kRingMask];
+            }
+
+            fPos += len;
+            fMatchLeft -= len;
+            return len;
+        }
+
+        // Decode up to 'want' bytes into the ring
+        size_t decode(size_t want)
+        {
+            static constexpr uint16_t kLengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+            static constexpr uint8_t kLengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+            static constexpr uint16_t kDistanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+            static constexpr uint8_t kDistanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+            size_t n = 0;
+
+            while (n < want) {
+                switch (fState) {
+                case State::Header:
+                    if (!readHeader())
+                        return n;
+                    break;
+
+                case State::BlockHeader:
+                    if (!readBlockHeader())
+                        return n;
+                    break;
+
+                case State::Stored: {
+                    if (fStoredLeft == 0) {
+                        fState = State::BlockHeader;
+                        break;
+                    }
+
+                    // Whole bytes still held as bits go first
+                    if (fBitCount >= 8) {
+                        fRing[fPos++ & kRingMask] = static_cast<uint8_t>(fBits);
+                        drop(8);
+                        --fStoredLeft;
+                        ++n;
+                        break;
+                    }
+
+                    OctetCursor& in = fSource->getCursor();
+                    if (in.empty() && !fSource->refill()) {
+                        fail();
+                        return n;
+                    }
+
+                    size_t to = fPos & kRingMask;
+                    size_t chunk = std::min({ fStoredLeft, want - n, in.size(), kRingSize - to });
+                    std::memcpy(fRing + to, in.begin(), chunk);
+                    in.advance(chunk);
+                    fPos += chunk;
+                    fStoredLeft -= chunk;
+                    n += chunk;
+                    break;
+                }
+
+                case State::Huffman: {
+                    if (fMatchLeft > 0) {
+                        n += copyMatch(want - n);
+                        break;
+                    }
+
+                    int sym = symbol(*fLiterals);
+                    if (sym < 0) {
+                        fail();
+                        return n;
+                    }
+
+                    if (sym < 256) {
+                        fRing[fPos++ & kRingMask] = static_cast<uint8_t>(sym);
+                        ++n;
+                        break;
+                    }
+
+                    if (sym == 256) {
+                        fState = State::BlockHeader;
+                        break;
+                    }
+
+                    sym -= 257;
+                    if (sym >= 29) {
+                        fail();
+                        return n;
+                    }
+
+                    uint32_t extra;
+                    if (!bits(kLengthExtra[sym], extra)) {
+                        fail();
+                        return n;
+                    }
+                    size_t length = kLengthBase[sym] + extra;
+
+                    int dsym = symbol(*fDistances);
+                    if (dsym < 0 || dsym >= 30 || !bits(kDistanceExtra[dsym], extra)) {
+                        fail();
+                        return n;
+                    }
+                    size_t distance = kDistanceBase[dsym] + extra;
+                    if (distance > fPos) {
+                        fail();
+                        return n;
+                    }
+
+                    fMatchLeft = length;
+                    fMatchDistance = distance;
+                    n += copyMatch(want - n);
+                    break;
+                }
+
+                case State::Trailer: {
+                    // The Adler-32 checksum, after the bits on a byte boundary.
+                    // Whatever whole bytes were loaded past it go back to
+                    // the source, so it carries on just after the stream.
+                    drop(fBitCount & 7);
+                    uint32_t adler;
+                    if (!bits(16, adler) || !bits(16, adler)) {
+                        fState = State::Done;
+                        return n;
+                    }
+
+                    OctetCursor& in = fSource->getCursor();
+                    in.fStart -= fBitCount / 8;
+                    fBits = 0;
+                    fBitCount = 0;
+                    fState = State::Done;
+                    return n;
+                }
+
+                default:
+                    return n;
+                }
+            }
+
+            return n;
+        }
+
+    private:
+        std::shared_ptr<PSFile> fSource;
+        State fState = State::Header;
+
+        uint64_t fBits = 0;
+        uint32_t fBitCount = 0;
+
+        bool fLastBlock = false;
+        size_t fStoredLeft = 0;
+        size_t fMatchLeft = 0;
+        size_t fMatchDistance = 0;
+
+        const PSHuffmanTable* fLiterals = nullptr;
+        const PSHuffmanTable* fDistances = nullptr;
+        PSHuffmanTable fDynamicLiterals;
+        PSHuffmanTable fDynamicDistances;
+        PSHuffmanTable fFixedLiterals;
+        PSHuffmanTable fFixedDistances;
+        bool fFixedBuilt = false;
+
+        size_t fPos = 0;                // bytes decoded, ever; where the next one goes in the ring
+        uint8_t fRing[kRingSize];
+    };
+}
@@ -3,6 +3,7 @@
 #include <memory>
 
 #include "ocspan.h"
+#include "ps_charscan.h"
 #include "ps_type_name.h"
 #include "ps_type_file.h"
 
@@ -14,17 +15,10 @@
 namespace waavs {
 
 	// Skip characters in the input stream that match the given category mask
+	// Whitespace and name characters are scanned many bytes at a time, see ps_charscan.h
 	static inline const uint8_t* skipWhile(OctetCursor& src, uint8_t categoryMask) noexcept
 	{
-		const uint8_t* p = src.begin();
-		const uint8_t* end = src.end();
-
-		if (p == end) return p;  // Empty input
-
-		while (p < end && PSCharClass::is(*p, categoryMask))
-		{
-			++p;
-		}
+		const uint8_t* p = scanWhile(src.begin(), src.end(), categoryMask);
 
 		src.fStart = p;  // Update cursor position
 
@@ -104,7 +98,8 @@ namespace waavs
 		Comment,
         DSCComment,		// %%DSCKeyword value
 		Delimiter,
-        EexecSwitch,	// eexec switch
+		BinaryToken,	// binary encoded number, string, or name (132-149)
+		BinarySequence,	// binary object sequence (128-131)
 		Eof
 	};
 
@@ -137,8 +132,7 @@ namespace waavs {
 		//const uint8_t* commentStart = p;
 
 		// Scan to end of line, allowing \n, \r, or \r\n
-		while (p < end && *p != '\n' && *p != '\r')
-			++p;
+		p = scanLineEnd(p, end);
 
 		const uint8_t* commentEnd = p;
 
@@ -174,6 +168,13 @@ namespace waavs {
 		bool inEscape = false;
 
 		while (p < end && depth > 0) {
+			// Outside of an escape, only ( ) and \ mean anything
+			if (!inEscape) {
+				p = scanStringSpecial(p, end);
+				if (p == end)
+					break;
+			}
+
 			uint8_t c = *p++;
 
 			if (inEscape) {
@@ -213,6 +214,8 @@ namespace waavs {
 		return true;
 	}
 
+	// On a malformed number, the cursor is left where the scan stopped, so 
+	// a number that was only cut off by the end of a window gets another try
 	static bool scanNumberLexeme(OctetCursor& src, PSLexeme& lex) noexcept
 	{
 		const uint8_t* start = src.begin();
@@ -226,8 +229,10 @@ namespace waavs {
 		if (*p == '+' || *p == '-')
 			++p;
 
-		if (p >= end)
+		if (p >= end) {
+			src.fStart = p;
 			return false;
+		}
 
 		// Try to detect radix format (e.g., 16#1A)
 		const uint8_t* radixStart = p;
@@ -246,6 +251,7 @@ namespace waavs {
 				return true;
 			}
 			else {
+				src.fStart = p;
 				return false; // no valid digits after '#'
 			}
 		}
@@ -283,8 +289,10 @@ namespace waavs {
 				const uint8_t* expStart = p;
 				while (p < end && isdigit(*p)) ++p;
 
-				if (expStart == p)
+				if (expStart == p) {
+					src.fStart = p;
 					return false; // exponent with no digits
+				}
 			}
 			else {
 				break;
@@ -298,6 +306,7 @@ namespace waavs {
 			return true;
 		}
 
+		src.fStart = p;
 		return false;
 	}
 
@@ -328,65 +337,135 @@ namespace waavs {
 		return true;
 	}
 
-	inline bool scanEncryptedBlock(OctetCursor& src, PSLexeme& lex) noexcept
+	static bool scanNameLexeme(OctetCursor& src, PSLexeme& lex) noexcept
+	{
+		const uint8_t * start = src.begin();
+		skipWhile(src, PS_NAME_CHAR);
+		lex.type = PSLexType::Name;
+		lex.span = OctetCursor(start, src.begin() - start);
+
+		// The whitespace character that ends a name goes with it, so a 
+		// read from currentfile, after RD or image, starts right after 
+		// it (PLRM 3.8.1).  CR LF counts as one.
+		if (!src.empty() && PSCharClass::isWhitespace(*src)) {
+			bool cr = *src == '\r';
+			++src;
+			if (cr && !src.empty() && *src == '\n')
+				++src;
+		}
+
+		return true;
+	}
+
+
+	// binaryTokenSize
+	// How many bytes the binary token at 'p' takes, PLRM 3.14.  Returns 0 
+	// when there are not yet enough bytes to tell, and SIZE_MAX when the 
+	// token is not valid.
+	static size_t binaryTokenSize(const uint8_t* p, size_t avail) noexcept
 	{
-		static OctetCursor keyword = "cleartomark";
-		OctetCursor begin = src;
-		OctetCursor cursor = src;
+		static constexpr size_t kInvalid = SIZE_MAX;
+
+		auto u16 = [p](size_t at, bool lowFirst) -> size_t {
+			return lowFirst ? (p[at] | (p[at + 1] << 8)) : ((p[at] << 8) | p[at + 1]);
+		};
+
+		// bytes per number in representation r, 0 if not valid
+		auto numberSize = [](uint8_t r) -> size_t {
+			r &= 0x7f;
+			return (r < 32) ? 4 : (r < 48) ? 2 : (r < 50) ? 4 : 0;
+		};
+
+		uint8_t c = p[0];
+		switch (c) {
+		case 128: case 129: case 130: case 131: {		// binary object sequence
+			if (avail < 4) return 0;
+			bool lowFirst = (c & 1) != 0;
+			if (p[1] != 0) {
+				size_t len = u16(2, lowFirst);
+				return len < 4 ? kInvalid : len;
+			}
+			if (avail < 8) return 0;
+			size_t len = lowFirst
+				? (size_t(p[4]) | (size_t(p[5]) << 8) | (size_t(p[6]) << 16) | (size_t(p[7]) << 24))
+				: ((size_t(p[4]) << 24) | (size_t(p[5]) << 16) | (size_t(p[6]) << 8) | size_t(p[7]));
+			return len < 8 ? kInvalid : len;
+		}
 
+		case 132: case 133: return 5;		// 32 bit integer
+		case 134: case 135: return 3;		// 16 bit integer
+		case 136: return 2;					// 8 bit integer
 
-        // return false if the keyword is not found
-		if (!skipUntilKeyword(cursor, keyword))
-			return false;
+		case 137: {							// fixed point
+			if (avail < 2) return 0;
+			if ((p[1] & 0x7f) >= 48) return kInvalid;
+			return 2 + numberSize(p[1]);
+		}
 
-		// Set span from beginning to just before the match
-		lex.type = PSLexType::EexecSwitch;
-		lex.span = OctetCursor(begin.begin(), cursor.begin() - begin.begin());
+		case 138: case 139: case 140: return 5;		// real
+		case 141: return 2;							// boolean
 
-		// Advance *past* the matched keyword
-		cursor.advance(keyword.size());
-		src = cursor;
+		case 142:							// string, 8 bit length
+			return (avail < 2) ? 0 : 2 + p[1];
 
-		return true;
-	}
+		case 143: case 144:					// string, 16 bit length
+			return (avail < 3) ? 0 : 3 + u16(1, c == 144);
 
+		case 145: case 146: case 147: case 148:		// names
+			return 2;
 
+		case 149: {							// homogeneous number array
+			if (avail < 4) return 0;
+			size_t size = numberSize(p[1]);
+			if (size == 0) return kInvalid;
+			return 4 + u16(2, (p[1] & 0x80) != 0) * size;
+		}
 
-	static bool scanNameLexeme(OctetCursor& src, PSLexeme& lex) noexcept
+		default:							// 150-159 are unassigned
+			return kInvalid;
+		}
+	}
+
+	// scanBinaryTokenLexeme
+	// The lexeme is the whole of the binary token.  A token that runs past
+	// the end of the input consumes all of it, so a windowed file refills.
+	// Bytes that are not a valid binary token are a single delimiter, which
+	// becomes an undefined name.
+	static bool scanBinaryTokenLexeme(OctetCursor& src, PSLexeme& lex) noexcept
 	{
-		const uint8_t * start = src.begin();
-		skipWhile(src, PS_NAME_CHAR);
-		lex.type = PSLexType::Name;
-		lex.span = OctetCursor(start, src.begin() - start);
+		const uint8_t* start = src.begin();
+		size_t avail = src.size();
+		size_t len = binaryTokenSize(start, avail);
 
-		if (lex.span == "eexec") {
-            if (!scanEncryptedBlock(src, lex))
-				return false;
+		if (len == SIZE_MAX) {
+			lex.type = PSLexType::Delimiter;
+			lex.span = OctetCursor(start, 1);
+			src.advance(1);
+			return true;
+		}
 
-        }
+		if (len == 0 || len > avail) {
+			src.fStart = src.fEnd;
+			return false;
+		}
 
+		lex.type = (*start <= 131) ? PSLexType::BinarySequence : PSLexType::BinaryToken;
+		lex.span = OctetCursor(start, len);
+		src.advance(len);
 		return true;
 	}
 
-
-	// nextPSLexeme
+	// scanPSLexeme
 	// Return the next lexically significant token from the input stream.
 	// Updates the source cursor to point to the next position after the token.
 	//
 	// This is pretty low level.  It will do things like isolate a number, but 
 	// won't actually give you the decimal value for that number
 	//
-	static bool nextPSLexeme(std::shared_ptr<PSFile> file, PSLexeme& lex) noexcept 
+	static bool scanPSLexeme(OctetCursor& src, PSLexeme& lex) noexcept 
 	{
 		using CC = PSCharClass;
 
-		if (!file->hasCursor())
-			return false;
-
-		auto& src = file->getCursor();
-
-
-
 		// Skip whitespace
 		skipWhile(src, PS_WHITESPACE);
 		// skip null bytes
@@ -408,6 +487,11 @@ namespace waavs {
 			return scanCommentLexeme(src, lex);
 		}
 
+		// Binary tokens
+		if (c >= 128 && c <= 159) {
+			return scanBinaryTokenLexeme(src, lex);
+		}
+
 		// Literal name: starts with '/'
 		if (c == '/') {
 			return scanLiteralNameLexeme(src, lex);
@@ -467,7 +551,9 @@ namespace waavs {
 				const uint8_t* q = strStart;
 				const uint8_t* end = src.end();
 
-				while (q < end && *q != '>') ++q;
+				q = static_cast<const uint8_t*>(std::memchr(q, '>', end - q));
+				if (!q)
+					q = end;
 
 				lex.type = (q < end) ? PSLexType::HexString : PSLexType::UnterminatedString;
 				lex.span = OctetCursor(strStart, q - strStart);
@@ -561,14 +647,41 @@ namespace waavs {
 		return true;
 	}
 
+	// nextPSLexeme
+	// Scan the next token from the file's cursor.  When the cursor is over 
+	// a window of the file (see PSBufferedFile), a token that runs into the 
+	// end of the window may carry on past it, so the window is refilled 
+	// from where the token started, and the token is scanned again.
+	//
+	static bool nextPSLexeme(std::shared_ptr<PSFile> file, PSLexeme& lex) noexcept 
+	{
+		if (!file->hasCursor())
+			return false;
+
+		auto& src = file->getCursor();
+
+		while (true) {
+			OctetCursor start = src;
+			bool ok = scanPSLexeme(src, lex);
+			if (!src.empty())
+				return ok;
+
+			src = start;
+			if (!file->refill())
+				return scanPSLexeme(src, lex);		// the bytes may have moved
+		}
+	}
+
 } // namespace waavs
 
 namespace waavs {
 	struct PSLexemeGenerator {
 		PSFileHandle fFile;
+		PSLexType fLastType{ PSLexType::Invalid };		// of the most recent lexeme
 
+		// A file without a cursor of its own is scanned through a window
 		PSLexemeGenerator(PSFileHandle file) 
-            : fFile(file)
+            : fFile(file && !file->hasCursor() ? PSBufferedFile::create(file) : file)
 		{
 		}
 
@@ -577,7 +690,9 @@ namespace waavs {
 
 		bool next(PSLexeme &lex) 
 		{
-			return nextPSLexeme(fFile, lex);
+			bool ok = nextPSLexeme(fFile, lex);
+			fLastType = lex.type;
+			return ok;
 		}
 
 		//void setCursor(OctetCursor input)  { src = input;  }
@@ -98,7 +98,7 @@ namespace waavs {
             intervalObj.resetFromArray(sub);
 		} else if (containerObj.isString())
 		{
-			auto &str = containerObj.asString();
+			auto str = containerObj.asString();
             auto subStr = str.getInterval(start, count);
 			intervalObj.resetFromString(subStr);
         }
@@ -107,6 +107,7 @@ namespace waavs {
 	}
 
 	// ( destArray index srcArray -- )
+	// ( destString index srcString -- )
 	inline bool op_putinterval(PSVirtualMachine& vm) {
 		auto& s = vm.opStack();
 		if (s.size() < 3) 
@@ -121,6 +122,19 @@ namespace waavs {
 
 		s.pop(destArrObj);
 
+		if (destArrObj.isString() && srcArrObj.isString()) {
+			// The bytes land in the shared body, so every view of
+			// the destination sees them
+			auto dest = destArrObj.asString();
+			auto src = srcArrObj.asString();
+
+			if (index < 0 || static_cast<size_t>(index) + src.length() > dest.length())
+				return vm.error("op_putinterval: rangecheck");
+
+			dest.putInterval(static_cast<uint32_t>(index), src);
+			return true;
+		}
+
 		if (!destArrObj.isArray() ||  !srcArrObj.isArray())
 			return vm.error("op_putinterval: typecheck; dest or src not array");
 
@@ -138,31 +152,24 @@ namespace waavs {
 	}
 
 
+	// ( proc -- proc ) 
+	// Names that resolve to operators are replaced by the operators,
+	// all the way down through nested procedures.  See PSVirtualMachine::bindProc()
 	inline bool op_bind(PSVirtualMachine& vm) {
         auto& ostk = vm.opStack();
 
         if (ostk.empty())
             return vm.error("op_bind: stackunderflow");
 		
-		PSArrayHandle arr;
-		if (!ostk.popArray(arr))
-			return vm.error("op_bind: typecheck; not array");;
-
-		for (auto& elem : arr->elements) {
-			if (elem.isExecutableName()) {
-				// If the name resolves to an operator, then replace it in 
-				// the array with the actual operator object.
-				PSObject resolved;
-				if (vm.dictionaryStack.load(elem.asName(), resolved)) {
-					if (resolved.isOperator()) {
-						elem.resetFromOperator(resolved.asOperator());
-					}
-				} 
-			}
-			// Do NOT recurse into nested procedures
-		}
+		PSObject proc;
+		ostk.pop(proc);
+		if (!proc.isArray())
+			return vm.error("op_bind: typecheck; not array");
+
+		vm.bindProc(proc);
 
-		ostk.pushProcedure(arr);
+		proc.setExecutable(true);
+		ostk.push(proc);
 
 		return true;
 	}
@@ -6,102 +6,75 @@
 
 namespace waavs {
 
-    // ( proc -- ) Executes a procedure
+    // ( any -- ) Executes an object
+    // A procedure gets a frame on the exec stack, and runs once this
+    // operator returns.  Other executable objects run the same way.
     inline bool op_exec(PSVirtualMachine& vm) 
     {
         auto& ostk = vm.opStack();
-        auto& estk = vm.execStack();
 
         if (ostk.empty())
             return vm.error("op_exec: stackunderflow");
 
-        PSObject proc;
-        ostk.pop(proc);
-
-        if (!proc.isArray() || !proc.isExecutable())
-            return vm.error("op_exec: typecheck; expected procedure (array)");
+        PSObject obj;
+        ostk.pop(obj);
 
+        if (!obj.isExecutable())
+            return ostk.push(obj);
 
-        return vm.runProc(proc);
+        return vm.pushExec(obj);
     }
 
     // ( bool proc -- ) If condition is true, execute procedure
     inline bool op_if(PSVirtualMachine& vm) 
     {
         auto& ostk = vm.opStack();
-        auto& estk = vm.execStack();
 
-        if (ostk.size() < 2)
-            return vm.error("op_if: stackunderflow");
+        bool cond = ostk.fromTop(1).asBool();
+        bool ok = cond ? vm.pushProc(ostk.fromTop(0)) : true;
+        ostk.drop(2);
 
-        PSObject proc, cond;
-        ostk.pop(proc);
-        ostk.pop(cond);
-
-        if (!cond.isBool())
-            return vm.error("op_if: typecheck; expected boolean");
-
-        if (cond.asBool())
-        {
-            return vm.runProc(proc);
-        }
-
-        return true;
+        return ok;
     }
 
     // ( bool proc_true proc_false -- ) Conditional execution
     inline bool op_ifelse(PSVirtualMachine& vm) 
     {
         auto& ostk = vm.opStack();
-        auto& estk = vm.execStack();
 
-        if (ostk.size() < 3)
-            return vm.error("op_ifelse: stackunderflow");
+        bool cond = ostk.fromTop(2).asBool();
+        bool ok = vm.pushProc(ostk.fromTop(cond ? 1 : 0));
+        ostk.drop(3);
 
-        PSObject procFalse, procTrue, cond;
-        ostk.pop(procFalse);
-        ostk.pop(procTrue);
-        ostk.pop(cond);
-
-        if (!cond.isBool())
-            return vm.error("op_ifelse: typecheck; expected boolean");
-
-        PSObject proc = cond.asBool() ? procTrue : procFalse;
-
-        if (!proc.isArray() || !proc.isExecutable())
-            return vm.error("op_ifelse: typecheck; expected procedure (array)");
-
-        return vm.runProc(proc);
+        return ok;
     }
 
     // ( count proc -- ) Repeat execution
+    // The loop runs from a frame on the exec stack, which counts down
+    // the passes, this operator only sets it up.
     inline bool op_repeat(PSVirtualMachine& vm) {
         auto& ostk = vm.opStack();
-        auto& estk = vm.execStack();
 
         if (ostk.size() < 2)
-            return vm.error("stackunderflow");
+            return vm.error("op_repeat: stackunderflow");
 
         PSObject proc;
         int count;
         ostk.pop(proc);
         if (!ostk.popInt(count))
-            return vm.error("typecheck: expected integer");
+            return vm.error("op_repeat: typecheck; expected integer");
 
+        if (!proc.isArray() || !proc.isExecutable())
+            return vm.error("op_repeat: typecheck; expected procedure (array)");
 
-        for (int i = 0; i < count; ++i) {
-            if (!vm.runProc(proc))
-                return vm.error("repeat:: run() failed");
+        if (count < 0)
+            return vm.error("op_repeat: rangecheck");
 
-            if (vm.isExitRequested()) {
-                //vm.clearExitRequest();
-                break;
-            }
-            if (vm.isStopRequested()) {
-                vm.clearStopRequest();
-                break;
-            }
-        }
+        PSExecFrame* frame = vm.pushLoop(PSExecFrameKind::Repeat, proc);
+        if (!frame)
+            return false;
+
+        frame->fCounter = count;
 
         return true;
     }
@@ -109,7 +82,6 @@ namespace waavs {
     // ( proc -- ) Infinite loop execution
     inline bool op_loop(PSVirtualMachine& vm) {
         auto& ostk = vm.opStack();
-        auto& estk = vm.execStack();
 
         if (ostk.empty())
             return vm.error("op_loop: stackunderflow");
@@ -120,31 +92,23 @@ namespace waavs {
         if (!proc.isArray() || !proc.isExecutable())
             return vm.error("op_loop: typecheck: expected procedure (array)");
 
-        while (true) {
-            if (!vm.runProc(proc)) {
-                return vm.error("op_loop:: run() failed");
-			}
-
-            if (vm.isExitRequested()) {
-                vm.clearExitRequest();
-                break;
-            }
-        }
-
-        return true;
+        return vm.pushLoop(PSExecFrameKind::Loop, proc) != nullptr;
     }
 
     // ( -- ) Signal exit from a loop
+    // The exec stack is unwound to the innermost loop frame, which 
+    // is popped, ending that loop, and only that loop.
     inline bool op_exit(PSVirtualMachine& vm) {
         vm.exit();
         return true;
     }
 
     // ( initial increment limit proc -- ) Numeric for-loop
+    // When initial and increment are both integers, the control 
+    // variable is an integer, otherwise it is a real.
     inline bool op_for(PSVirtualMachine& vm) 
     {
         auto& ostk = vm.opStack();
-        auto& estk = vm.execStack();
     
         if (ostk.size() < 4)
             return vm.error("op_for: stackunderflow");
@@ -161,100 +125,59 @@ namespace waavs {
         if (!proc.isArray() || !proc.isExecutable())
             return vm.error("op_for: typecheck; expected procedure (array)");
 
-        double i = initial.asReal();
-        double inc = increment.asReal();
-        double lim = limit.asReal();
-
-        while ((inc > 0 && i <= lim) || (inc < 0 && i >= lim)) 
-        {
-            ostk.pushReal(i);
-
-            if (!vm.runProc(proc))
-                return vm.error("op_for: run failed");
+        PSExecFrame* frame = vm.pushLoop(PSExecFrameKind::For, proc);
+        if (!frame)
+            return false;
 
-            if (vm.isExitRequested()) {
-                vm.clearExitRequest();
-                break;
-            }
+        frame->fIntegers = initial.type == PSObjectType::Int && increment.type == PSObjectType::Int;
+        frame->fLimit = limit.asReal();
 
-            i += inc;
+        if (frame->fIntegers) {
+            frame->fCounter = initial.asInt();
+            frame->fIncrement = increment.asInt();
+        }
+        else {
+            frame->fRealCounter = initial.asReal();
+            frame->fRealIncrement = increment.asReal();
         }
 
         return true;
     }
 
+    // ( array proc -- ) ( string proc -- ) ( dict proc -- )
+    // Execute the procedure for each element of the container
     inline bool op_forall(PSVirtualMachine& vm) 
     {
         auto& ostk = vm.opStack();
-        auto& estk = vm.execStack();
 
         if (ostk.size() < 2)
-            return vm.error("forall: stackunderflow");
+            return vm.error("op_forall: stackunderflow");
 
         PSObject proc, container;
         ostk.pop(proc);
         ostk.pop(container);
 
-
-        auto apply = [&](const PSObject& val1, const PSObject* val2 = nullptr) -> bool {
-            if (val2) ostk.push(*val2);
-            ostk.push(val1);
-
-            if (!vm.runProc(proc)) {
-                return vm.error("op_forall: run() failed");
-            }
-
-            if (vm.isExitRequested()) {
-                vm.clearExitRequest();
-                return true; // exit terminates loop early
-            }
-            return true;
-            };
+        if (!proc.isArray() || !proc.isExecutable())
+            return vm.error("op_forall: typecheck; expected procedure (array)");
 
         switch (container.type) {
-        case PSObjectType::Array: {
-            for (const auto& val : container.asArray()->elements) {
-                if (!apply(val)) break;
-            }
-            return true;
-        }
+        case PSObjectType::Array:
+        case PSObjectType::String:
+        case PSObjectType::Dictionary:
+            break;
 
-        case PSObjectType::String: {
-            auto str = container.asString();
-            for (int i = 0; i < str.length(); ++i) {
-                PSObject obj;
-                uint8_t byte;
-                str.get(i, byte);
-                obj = PSObject::fromInt(static_cast<unsigned char>(byte));
-                if (!apply(obj)) break;
-            }
-            return true;
+        default:
+            return vm.error("op_forall: typecheck; unsupported container type");
         }
 
-        case PSObjectType::Dictionary: {
-            auto applyToDict = [&](const PSName& keyName, const PSObject& val2) -> bool {
-                ostk.pushLiteralName(keyName);
-                ostk.push(val2);
-
-                estk.push(proc);
-                if (!vm.run()) {
-                    return vm.error("forall: failed to run procedure");
-                }
-
-                if (vm.isExitRequested()) {
-                    vm.clearExitRequest();
-                    return true; // exit terminates loop early
-                }
-                return true;
-                };
-
-                container.asDictionary()->forEach(applyToDict);
-            return true;
-        }
+        PSExecFrame* frame = vm.pushLoop(PSExecFrameKind::ForAll, proc);
+        if (!frame)
+            return false;
 
-        default:
-            return vm.error("forall: unsupported container type");
-        }
+        frame->fContainer = container;
+        frame->fPosition = 0;
+
+        return true;
     }
 
     // ( -- ) Signal stop condition
@@ -264,10 +187,12 @@ namespace waavs {
     }
 
     // ( proc -- bool ) Execute procedure with stop protection
+    // Pushes a 'stopped' frame under the procedure.  If the procedure
+    // finishes, run() pops that frame and pushes false.  If 'stop' is 
+    // called, the exec stack is unwound to that frame, and true is pushed.
     inline bool op_stopped(PSVirtualMachine& vm) 
     {
         auto& ostk = vm.opStack();
-        auto& estk = vm.execStack();
 
         if (ostk.empty())
             return vm.error("op_stopped: stackunderflow");
@@ -282,29 +207,18 @@ namespace waavs {
         if (!arr)
             return vm.error("op_stopped: valuecheck");
 
-        bool prevStop = vm.isStopRequested();
-        vm.clearStopRequest();
-
-        if (!vm.runProc(proc))
+        if (!vm.pushStopped())
             return false;
 
-        bool stopOccurred = vm.isStopRequested();
-
-        if (prevStop)
-            vm.stop();
-        else
-            vm.clearStopRequest();
-
-        ostk.pushBool(stopOccurred);
-        return true;
+        return vm.pushProc(proc);
     }
 
     // Operator table
     inline const PSOperatorFuncMap& getControlOps() {
         static const PSOperatorFuncMap table = {
             { "exec",      op_exec },
-            { "if",        op_if },
-            { "ifelse",    op_ifelse },
+            { "if",        { op_if, "bP" } },
+            { "ifelse",    { op_ifelse, "bPP" } },
             { "repeat",    op_repeat },
             { "loop",      op_loop },
             { "exit",      op_exit },
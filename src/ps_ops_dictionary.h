@@ -28,6 +28,9 @@ namespace waavs {
             return vm.error("op_def:typecheck: def expects a literal name");
         }
 
+        if (vm.autoBind() && value.isExecutableArray())
+            vm.bindProc(value);
+
         vm.dictionaryStack.define(keyObj.asName(), value);
 
         return true;
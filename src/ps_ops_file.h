@@ -28,6 +28,23 @@ namespace waavs {
         const PSString& filename = filenameObj.asString();
         const PSString& access = accessObj.asString();
 
+        // (w) access is an output file, on disk, or %stdout, %stderr
+        if (access.toString() == "w") {
+            std::string fname = filename.toString();
+            std::shared_ptr<PSFile> out;
+            if (fname == "%stdout")
+                out = PSOutputFile::createStdout();
+            else if (fname == "%stderr")
+                out = PSOutputFile::createStderr();
+            else
+                out = PSOutputFile::create(fname);
+
+            if (!out)
+                return vm.error("file: could not open");
+
+            return s.push(PSObject::fromFile(out));
+        }
+
         auto pf = PSDiskFile::create(filename, access);
         if (!pf || !pf->isValid())
             return vm.error("file: could not open");
@@ -47,10 +64,10 @@ namespace waavs {
             return vm.error("typecheck: expected file");
 
         auto fileHandle = file.asFile();
+        if (fileHandle)
+            fileHandle->close();
 
-        //file->close();
-
-        return vm.error("closefile operator not yet implemented");
+        return true;
     }
 
     inline bool op_deletefile(PSVirtualMachine& vm) {
@@ -142,16 +159,7 @@ namespace waavs {
 
         PSString str = strObj.asString();
         size_t count = str.capacity();
-        size_t actual = 0;
-
-        for (; actual < count; ++actual) {
-            uint8_t b;
-            if (!file->readByte(b))
-                break;
-
-            if (!str.put(static_cast<uint32_t>(actual), b))
-                break;
-        }
+        size_t actual = count > 0 ? file->readSome(str.data(), count) : 0;
 
         str.setLength(static_cast<uint32_t>(actual));
         s.push(PSObject::fromString(str));
@@ -181,56 +189,30 @@ namespace waavs {
         PSString str = strObj.asString();
         size_t count = str.capacity();
         size_t written = 0;
+        uint8_t* dst = str.data();
 
-        auto isHexDigit = [](uint8_t ch) -> bool {
-            return ('0' <= ch && ch <= '9') ||
-                ('A' <= ch && ch <= 'F') ||
-                ('a' <= ch && ch <= 'f');
-            };
-
-        auto hexValue = [](uint8_t ch) -> uint8_t {
-            if ('0' <= ch && ch <= '9') return ch - '0';
-            if ('A' <= ch && ch <= 'F') return ch - 'A' + 10;
-            if ('a' <= ch && ch <= 'f') return ch - 'a' + 10;
-            return 0xFF;
-            };
-
-        while (written < count) {
-            uint8_t c1 = 0, c2 = 0;
-
-            // Skip whitespace and find first hex digit
-            do {
-                if (!file->readByte(c1)) goto eof;
-            } while (c1 <= 0x20);  // skip control and space
-
-            if (!isHexDigit(c1)) break; // non-hex ends read
-
-            // Skip whitespace and find second hex digit
-            do {
-                if (!file->readByte(c2)) {
-                    // Handle trailing odd nibble case (treat missing second digit as '0')
-                    c2 = '0';
-                    break;
-                }
-            } while (c2 <= 0x20);
-
-            if (!isHexDigit(c2)) break;
+        // Anything that is not a hex digit is skipped (PLRM 3rd ed, readhexstring)
+        PSHexDecoder decoder(false);
 
-            uint8_t high = hexValue(c1);
-            uint8_t low = hexValue(c2);
-
-            if (high == 0xFF || low == 0xFF)
-                return vm.error("typecheck: invalid hex digit");
-
-            uint8_t byte = (high << 4) | low;
-
-            if (!str.put(static_cast<uint32_t>(written), byte))
-                break;
+        if (file->hasCursor()) {
+            while (written < count) {
+                if (file->getCursor().empty() && !file->refill())
+                    break;
+                written += decoder.decode(file->getCursor(), dst + written, count - written);
+            }
+        }
+        else {
+            uint8_t c;
+            while (written < count && file->readByte(c)) {
+                OctetCursor one(&c, 1);
+                written += decoder.decode(one, dst + written, count - written);
+            }
+        }
 
+        // Handle trailing odd nibble case (treat missing second digit as '0')
+        if (written < count && decoder.finish(dst[written]))
             ++written;
-        }
 
-    eof:
         str.setLength(static_cast<uint32_t>(written));
         s.push(PSObject::fromString(str));
         s.push(PSObject::fromBool(written == count));
@@ -329,7 +311,15 @@ namespace waavs {
         if (!file.isFile() || !ch.isInt())
             return vm.error("typecheck: expected file and integer");
 
-        return vm.error("write operator not yet implemented");
+        auto f = file.asFile();
+        if (!f || !f->isWritable())
+            return vm.error("write: invalidaccess");
+
+        // Only the low 8 bits are written
+        if (!f->writeByte(static_cast<uint8_t>(ch.asInt() & 0xFF)))
+            return vm.error("write: ioerror");
+
+        return true;
     }
 
     inline bool op_writestring(PSVirtualMachine& vm) {
@@ -343,7 +333,15 @@ namespace waavs {
         if (!file.isFile() || !str.isString())
             return vm.error("typecheck: expected file and string");
 
-        return vm.error("op_writestring: operator not yet implemented");
+        auto f = file.asFile();
+        if (!f || !f->isWritable())
+            return vm.error("op_writestring: invalidaccess");
+
+        const PSString& data = str.asString();
+        if (!f->writeBytes(data.data(), data.length()))
+            return vm.error("op_writestring: ioerror");
+
+        return true;
     }
 
     inline bool op_writehexstring(PSVirtualMachine& vm) {
@@ -357,7 +355,17 @@ namespace waavs {
         if (!file.isFile() || !str.isString())
             return vm.error("typecheck: expected file and string");
 
-        return vm.error("op_writehexstring: operator not yet implemented");
+        auto f = file.asFile();
+        if (!f || !f->isWritable())
+            return vm.error("op_writehexstring: invalidaccess");
+
+        const PSString& data = str.asString();
+        std::vector<uint8_t> hex(data.length() * 2);
+        encodeHex(data.data(), data.length(), hex.data());
+        if (!f->writeBytes(hex.data(), hex.size()))
+            return vm.error("op_writehexstring: ioerror");
+
+        return true;
     }
 
     inline bool op_flushfile(PSVirtualMachine& vm) {
@@ -446,17 +454,37 @@ namespace waavs {
 
 
     // op_filter
-    // BUGBUG - only doing the one that takes two parameters
+    // source /name filter
+    // source dict /name filter
+    // target recordSize /RunLengthEncode filter
+    // The dictionary holds the filter's parameters, DecodeParms.
+    // An encode filter writes to its target, which has to be writable.
     bool op_filter(PSVirtualMachine& vm)
     {
         auto& ostk = vm.opStack();
 
-        // Support 2 parameter formm
         PSObject sourceObj, nameObj;
+        PSDictionaryHandle params;
+        int32_t recordSize = 0;
 
         if (!ostk.pop(nameObj) || !ostk.pop(sourceObj))
             return vm.error("op_filter: stackunderflow");
 
+        if (nameObj.isName() && nameObj.asName() == "RunLengthEncode") {
+            if (!sourceObj.isInt())
+                return vm.error("op_filter: typecheck: expected record size");
+            recordSize = sourceObj.asInt();
+            if (recordSize < 0)
+                return vm.error("op_filter: rangecheck: record size");
+            if (!ostk.pop(sourceObj))
+                return vm.error("op_filter: stackunderflow");
+        }
+
+        if (sourceObj.isDictionary()) {
+            params = sourceObj.asDictionary();
+            if (!ostk.pop(sourceObj))
+                return vm.error("op_filter: stackunderflow");
+        }
 
         if (!nameObj.isName())
             return vm.error("op_filter: typecheck: expected filter name");
@@ -476,6 +504,40 @@ namespace waavs {
         } else if (filterName == "RunLengthDecode")
         {
             fileWrapper = std::make_shared<RunLengthDecodeFilter>(sourceFile);
+        } else if (filterName == "ASCIIHexDecode")
+        {
+            fileWrapper = std::make_shared<ASCIIHexDecodeFilter>(sourceFile);
+        } else if (filterName == "eexecDecode")
+        {
+            fileWrapper = std::make_shared<EexecDecodeFilter>(sourceFile);
+        } else if (filterName == "FlateDecode")
+        {
+            PSPredictor predictor;
+            if (params && !readPredictorParams(params, predictor))
+                return vm.error("op_filter: rangecheck: DecodeParms");
+            fileWrapper = std::make_shared<FlateDecodeFilter>(sourceFile, predictor);
+        } else if (filterName == "LZWDecode")
+        {
+            PSPredictor predictor;
+            PSObject earlyChange = PSObject::fromInt(1);
+            if (params && (!readPredictorParams(params, predictor) ||
+                (params->get("EarlyChange", earlyChange) && !earlyChange.isInt())))
+                return vm.error("op_filter: rangecheck: DecodeParms");
+            fileWrapper = std::make_shared<LZWDecodeFilter>(sourceFile, earlyChange.asInt(), predictor);
+        } else if (filterName == "ASCIIHexEncode" || filterName == "ASCII85Encode" ||
+            filterName == "RunLengthEncode" || filterName == "FlateEncode")
+        {
+            if (!sourceFile || !sourceFile->isWritable())
+                return vm.error("op_filter: invalidaccess: target is not writable");
+
+            if (filterName == "ASCIIHexEncode")
+                fileWrapper = std::make_shared<ASCIIHexEncodeFilter>(sourceFile);
+            else if (filterName == "ASCII85Encode")
+                fileWrapper = std::make_shared<ASCII85EncodeFilter>(sourceFile);
+            else if (filterName == "RunLengthEncode")
+                fileWrapper = std::make_shared<RunLengthEncodeFilter>(sourceFile, static_cast<size_t>(recordSize));
+            else
+                fileWrapper = std::make_shared<FlateEncodeFilter>(sourceFile);
         }
         else
         {
@@ -531,6 +593,45 @@ namespace waavs {
     }
 */
 
+    // op_eexec
+    // file eexec -
+    // string eexec -
+    // Decrypt the file or string, and run the program it holds, with 
+    // systemdict on top of the dictionary stack, so the operators it 
+    // uses have their standard meanings.  The program usually ends with
+    // 'mark currentfile closefile', and the file carries on after it.
+    inline bool op_eexec(PSVirtualMachine& vm)
+    {
+        auto& ostk = vm.opStack();
+
+        PSObject sourceObj;
+        if (!ostk.pop(sourceObj))
+            return vm.error("op_eexec: stackunderflow");
+
+        // A string stays alive on this frame for as long as it is read
+        PSFileHandle sourceFile;
+        if (sourceObj.isFile()) {
+            sourceFile = sourceObj.asFile();
+        }
+        else if (sourceObj.isString()) {
+            PSString str = sourceObj.asString();
+            sourceFile = PSMemoryFile::create(OctetCursor(str.data(), str.length()));
+        }
+        else {
+            return vm.error("op_eexec: typecheck: expected file or string");
+        }
+
+        auto systemdict = vm.getSystemDict();
+        vm.dictionaryStack.push(systemdict);
+
+        bool ok = vm.interpret(std::make_shared<EexecDecodeFilter>(sourceFile));
+
+        if (vm.dictionaryStack.currentdict() == systemdict && vm.dictionaryStack.size() > 2)
+            vm.dictionaryStack.pop();
+
+        return ok;
+    }
+
     inline bool op_resetfile(PSVirtualMachine& vm) {
         auto& s = vm.opStack();
         if (s.size() < 1)
@@ -563,8 +664,9 @@ namespace waavs {
         if (srcObj.isString()) {
             // (filename) run
             const PSString& name = srcObj.asString();
+            // read once, front to back; a small file is read in at once
             PSString access = PSString::fromCString("r");
-            file = PSDiskFile::create(name, access);
+            file = PSDiskFile::create(name, access, MAPPED_HINT_SEQUENTIAL | MAPPED_HINT_POPULATE | MAPPED_HINT_HUGEPAGES);
             if (!file || !file->isValid())
                 return vm.error("invalidfileaccess: cannot open file");
         }
@@ -578,18 +680,8 @@ namespace waavs {
             return vm.error("typecheck: expected file or filename");
         }
 
-        // Push currentFile and run the content
-        // BUGBUG - maybe just pushing is good enough, and the run
-        // loop can take care of popping when it's exhausted?
-        vm.pushCurrentFile(file);
-
-        bool ok = vm.interpret(file);
-
-        PSFileHandle lastOne;
-
-        vm.popCurrentFile(lastOne); // restore
-
-        return ok;
+        // interpret() makes the file the currentfile while it runs
+        return vm.interpret(file);
     }
 
 
@@ -628,6 +720,7 @@ namespace waavs {
             // File environment
             { "currentfile",     op_currentfile },
             { "filter",          op_filter },
+            { "eexec",           op_eexec },
             { "run",             op_run }
         };
         return table;
@@ -20,18 +20,10 @@ namespace waavs {
         auto& ostk = vm.opStack();
         auto& ctm = vm.graphics()->getCTM();
 
-        if (ostk.empty())
-            return vm.error("op_setlinewidth: stackunderflow");    
-
-        PSObject widthObj;
-        ostk.pop(widthObj);
-
-        if (!widthObj.isNumber())
-            return vm.error("op_setlinewidth:typecheck; expected number");
-
         double width, dwidth;
 
-        ctm.dtransform(widthObj.asReal(), 0.0, width, dwidth);
+        ctm.dtransform(ostk.fromTop(0).asReal(), 0.0, width, dwidth);
+        ostk.drop(1);
 
         vm.graphics()->setLineWidth(width);
 
@@ -230,11 +222,10 @@ namespace waavs {
 
     // Color setting operations
     inline bool op_setgray(PSVirtualMachine& vm) {
-        PSObject obj;
-        if (!vm.opStack().pop(obj) || !obj.isNumber())
-            return vm.error("typecheck: expected number");
+        auto& ostk = vm.opStack();
 
-        vm.graphics()->setGray(obj.asReal());
+        vm.graphics()->setGray(ostk.fromTop(0).asReal());
+        ostk.drop(1);
         return true;
     }
 
@@ -249,16 +240,10 @@ namespace waavs {
     }
 
     inline bool op_setrgbcolor(PSVirtualMachine& vm) {
-        PSObject b, g, r;
-
-		vm.opStack().pop(b);
-		vm.opStack().pop(g);
-		vm.opStack().pop(r);
-
-        if (!r.isNumber() || !g.isNumber() || !b.isNumber())
-            return vm.error("typecheck: expected 3 numbers");
+        auto& ostk = vm.opStack();
 
-        vm.graphics()->setRGB(r.asReal(), g.asReal(), b.asReal());
+        vm.graphics()->setRGB(ostk.fromTop(2).asReal(), ostk.fromTop(1).asReal(), ostk.fromTop(0).asReal());
+        ostk.drop(3);
         return true;
     }
 
@@ -483,15 +468,15 @@ namespace waavs {
             { "grestore",      op_grestore },
 
             // Color attributes
-            { "setgray",       op_setgray },
-            { "setrgbcolor",   op_setrgbcolor },
+            { "setgray",       { op_setgray, "N" } },
+            { "setrgbcolor",   { op_setrgbcolor, "NNN" } },
             { "setrgbacolor",  op_setrgbacolor },
             { "setcmykcolor",  op_setcmykcolor },
             { "sethsbcolor",   op_sethsbcolor },
             { "currentrgbcolor", op_currentrgbcolor },
             
             // Drawing attributes
-            { "setlinewidth",  op_setlinewidth },
+            { "setlinewidth",  { op_setlinewidth, "N" } },
             { "setlinecap",    op_setlinecap },
             { "setlinejoin",   op_setlinejoin },
             { "setmiterlimit", op_setmiterlimit },
@@ -7,19 +7,13 @@
 namespace waavs {
 
     // ----- Reusable Templates -----
+    // The operands are checked against the signatures in the table 
+    // below before any of these run, so they only do the arithmetic,
+    // leaving the result where the first operand was.
     template <typename Func>
     inline bool unaryMathOp(PSVirtualMachine& vm, Func func) {
-        auto& s = vm.opStack();
-        if (s.empty()) 
-            return vm.error("unaryMathOp: stackunderflow");
-
-        PSObject a;
-        s.pop(a);
-        if (!a.isNumber()) 
-            return vm.error("unaryMathOp: typecheck");
-
-        double result = func(a.asReal());
-        s.pushReal(result);
+        PSObject& a = vm.opStack().fromTop(0);
+        a.resetFromReal(func(a.asReal()));
 
         return true;
     }
@@ -27,26 +21,45 @@ namespace waavs {
     template <typename Func>
     inline bool binaryMathOp(PSVirtualMachine& vm, Func func) {
         auto& s = vm.opStack();
-        if (s.size() < 2) 
-            return vm.error("binaryMathOp: stackunderflow");
+        PSObject& a = s.fromTop(1);
+        const PSObject& b = s.fromTop(0);
 
-        PSObject b, a;
-        s.pop(b); s.pop(a);
+        a.resetFromReal(func(a.asReal(), b.asReal()));
+        s.drop(1);
 
-        if (!a.isNumber() || !b.isNumber()) 
-            return vm.error("binaryMathOp: typecheck");
+        return true;
+    }
 
-        double result = func(a.asReal(), b.asReal());
-        s.push(PSObject::fromReal(result));
+    // Like binaryMathOp, but two integers give an integer, as long 
+    // as the result fits, otherwise the result is a real.
+    template <typename Func>
+    inline bool binaryArithOp(PSVirtualMachine& vm, Func func) {
+        auto& s = vm.opStack();
+        PSObject& a = s.fromTop(1);
+        const PSObject& b = s.fromTop(0);
+
+        if (a.type == PSObjectType::Int && b.type == PSObjectType::Int) {
+            int64_t result = func(int64_t(a.asInt()), int64_t(b.asInt()));
+            if (result >= INT32_MIN && result <= INT32_MAX)
+                a.resetFromInt(static_cast<int32_t>(result));
+            else
+                a.resetFromReal(static_cast<double>(result));
+        }
+        else {
+            a.resetFromReal(func(a.asReal(), b.asReal()));
+        }
+        s.drop(1);
 
         return true;
     }
 
     // ----- Operator Implementations -----
+    // add and mul have fixed opcodes, and the VM runs the common
+    // cases of both inline, see PSVirtualMachine::execInline()
 
-    inline bool op_add(PSVirtualMachine& vm) { return binaryMathOp(vm, [](double a, double b) { return a + b; }); }
-    inline bool op_sub(PSVirtualMachine& vm) { return binaryMathOp(vm, [](double a, double b) { return a - b; }); }
-    inline bool op_mul(PSVirtualMachine& vm) { return binaryMathOp(vm, [](double a, double b) { return a * b; }); }
+    inline bool op_add(PSVirtualMachine& vm) { return binaryArithOp(vm, [](auto a, auto b) { return a + b; }); }
+    inline bool op_sub(PSVirtualMachine& vm) { return binaryArithOp(vm, [](auto a, auto b) { return a - b; }); }
+    inline bool op_mul(PSVirtualMachine& vm) { return binaryArithOp(vm, [](auto a, auto b) { return a * b; }); }
     inline bool op_div(PSVirtualMachine& vm) 
     { 
         return binaryMathOp(vm, [](double a, double b) { return a / b; }); 
@@ -56,40 +69,28 @@ namespace waavs {
 
     inline bool op_idiv(PSVirtualMachine& vm) {
         auto& s = vm.opStack();
-        if (s.size() < 2) 
-            return vm.error("op_idiv: stackunderflow");
-
-        PSObject b, a;
-        s.pop(b); 
-        s.pop(a);
-        
-        if (!a.isInt() || !b.isInt())
-            return vm.error("op_idiv: typecheck");
+        PSObject& a = s.fromTop(1);
+        const PSObject& b = s.fromTop(0);
 
         if (b.asInt() == 0) 
             return vm.error("op_idiv: divisor == 0");
 
-        s.pushInt(a.asInt() / b.asInt());
+        a.resetFromInt(a.asInt() / b.asInt());
+        s.drop(1);
+
         return true;
     }
 
     inline bool op_mod(PSVirtualMachine& vm) {
         auto& s = vm.opStack();
-        if (s.size() < 2) 
-            return vm.error("op_mod: stackunderflow");
-
-        PSObject b, a;
-        s.pop(b);
-        s.pop(a);
-        
-        if (!a.isInt() || !b.isInt())
-            return vm.error("op_mod: typecheck");
+        PSObject& a = s.fromTop(1);
+        const PSObject& b = s.fromTop(0);
 
         if (b.asInt() == 0) 
             return vm.error("op_mod: dividend == 0");
         
-        int modValue = a.asInt() % b.asInt();
-        s.push(PSObject::fromInt(modValue));
+        a.resetFromInt(a.asInt() % b.asInt());
+        s.drop(1);
 
         return true;
     }
@@ -109,21 +110,8 @@ namespace waavs {
 
     inline bool op_atan(PSVirtualMachine& vm) 
     {
-        auto& s = vm.opStack();
-    
-        if (s.size() < 2) 
-            return vm.error("op_atan: stackunderflow");
-        
-        double dx, dy;
-
-        if (!s.popReal(dx) || !s.popReal(dy)) 
-            return vm.error("op_atan: typecheck, expecting two numbers");
-
         // Note: atan2 returns angle in radians, we convert to degrees
-        double angle = std::atan2(dy, dx) * RAD_TO_DEG;
-        s.pushReal(angle);
-
-        return true;
+        return binaryMathOp(vm, [](double dy, double dx) { return std::atan2(dy, dx) * RAD_TO_DEG; });
     }
 
     // Exponentials
@@ -142,15 +130,8 @@ namespace waavs {
 
     inline bool op_srand(PSVirtualMachine& vm) {
         auto& s = vm.opStack();
-        if (s.empty()) 
-            return vm.error("op_srand: stackunderflow");
-
-        PSObject obj;
-        s.pop(obj);
-        if (!obj.isInt())
-            return vm.error("op_srand: typecheck");
-
-        vm.randSeed = obj.asInt() & 0x7FFFFFFF;
+        vm.randSeed = s.fromTop(0).asInt() & 0x7FFFFFFF;
+        s.drop(1);
 
         return true;
     }
@@ -163,21 +144,13 @@ namespace waavs {
     }
 
     inline bool op_cvi(PSVirtualMachine& vm) {
-        auto& s = vm.opStack();
-        if (s.empty())
-            return vm.error("stackunderflow");
-
-        PSObject top;
-        s.pop(top);
-
-        if (!top.isNumber())
-            return vm.error("typecheck: cvi requires a numeric operand");
+        PSObject& top = vm.opStack().fromTop(0);
 
         // Note: This is a simple conversion, it does not handle overflow or special cases
         double val = top.asReal();
         int32_t ival = static_cast<int32_t>(val); // truncate toward zero
 
-        s.pushInt(ival);
+        top.resetFromInt(ival);
 
         return true;
     }
@@ -186,34 +159,34 @@ namespace waavs {
 
     inline const PSOperatorFuncMap& getMathOps() {
         static const PSOperatorFuncMap table = {
-            { "add",      op_add },
-            { "sub",      op_sub },
-            { "mul",      op_mul },
-            { "div",      op_div },
-            { "idiv",     op_idiv },
-            { "mod",      op_mod },
-            { "max",      op_max },
-            { ".max",     op_max },         // Common alias
-            { "min",      op_min },
-            { ".min",     op_min},          // Common alias
-            { "neg",      op_neg },
-            { "abs",      op_abs },
-            { "sqrt",     op_sqrt },
-            { "ceiling",  op_ceiling },
-            { "floor",    op_floor },
-            { "round",    op_round },
-            { "truncate", op_truncate },
-            { "sin",      op_sin },
-            { "cos",      op_cos },
-            { "atan",     op_atan },
-            { "exp",      op_exp },
-            { "ln",       op_ln },
-            { "log",      op_log },
+            { "add",      { op_add, "NN", PSOpcode::Add } },
+            { "sub",      { op_sub, "NN" } },
+            { "mul",      { op_mul, "NN", PSOpcode::Mul } },
+            { "div",      { op_div, "NN" } },
+            { "idiv",     { op_idiv, "ii" } },
+            { "mod",      { op_mod, "ii" } },
+            { "max",      { op_max, "NN" } },
+            { ".max",     { op_max, "NN" } },   // Common alias
+            { "min",      { op_min, "NN" } },
+            { ".min",     { op_min, "NN" } },   // Common alias
+            { "neg",      { op_neg, "N" } },
+            { "abs",      { op_abs, "N" } },
+            { "sqrt",     { op_sqrt, "N" } },
+            { "ceiling",  { op_ceiling, "N" } },
+            { "floor",    { op_floor, "N" } },
+            { "round",    { op_round, "N" } },
+            { "truncate", { op_truncate, "N" } },
+            { "sin",      { op_sin, "N" } },
+            { "cos",      { op_cos, "N" } },
+            { "atan",     { op_atan, "NN" } },
+            { "exp",      { op_exp, "NN" } },
+            { "ln",       { op_ln, "N" } },
+            { "log",      { op_log, "N" } },
             { "rand",     op_rand },
-            { "srand",    op_srand },
+            { "srand",    { op_srand, "i" } },
             { "rrand",    op_rrand },
 
-            { "cvi",      op_cvi },
+            { "cvi",      { op_cvi, "N" } },
         };
         return table;
     }
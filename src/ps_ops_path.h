@@ -207,12 +207,9 @@ namespace waavs
         auto& path = vm.graphics()->currentPath();
         auto& ctm = vm.graphics()->getCTM();
 
-        if (ostk.size() < 2)
-            return vm.error("op_moveto: stackunderflow; expected two numbers");
-
-        double x0, y0;
-        if (!ostk.popReal(y0) || !ostk.popReal(x0))
-            return vm.error("op_moveto:typecheck; expected two numbers");
+        double x0 = ostk.fromTop(1).asReal();
+        double y0 = ostk.fromTop(0).asReal();
+        ostk.drop(2);
 
         if (!path.moveto(ctm, x0, y0))
             return vm.error("op_moveto: path.moveto() error");
@@ -225,18 +222,13 @@ namespace waavs
         auto& path = vm.graphics()->currentPath();
         auto& ctm = vm.graphics()->getCTM();
 
-        PSObject objdy, objdx;
-
-        if (!ostk.pop(objdy) || !ostk.pop(objdx) || !objdx.isNumber() || !objdy.isNumber())
-            return vm.error("op_moveto:typecheck; expected two numbers");
-
-
         double x0{ 0 }, y0{ 0 };
         if (!path.getCurrentPoint(x0, y0))
             return vm.error("op_rmoveto:nocurrentpoint");
 
-        double dx = objdx.asReal();
-        double dy = objdy.asReal();
+        double dx = ostk.fromTop(1).asReal();
+        double dy = ostk.fromTop(0).asReal();
+        ostk.drop(2);
 
         return path.moveto(ctm, x0 + dx, y0 + dy);
     }
@@ -246,12 +238,9 @@ namespace waavs
         auto& path = vm.graphics()->currentPath();
         auto& ctm = vm.graphics()->getCTM();
 
-        if (ostk.size() < 2)
-            return vm.error("op_lineto: stackunderflow; expected two numbers");
-
-        double x, y;
-        if (!ostk.popReal(y) || !ostk.popReal(x))
-            return vm.error("op_lineto:typecheck; expected two numbers");
+        double x = ostk.fromTop(1).asReal();
+        double y = ostk.fromTop(0).asReal();
+        ostk.drop(2);
 
         return path.lineto(ctm, x, y);
     }
@@ -261,16 +250,13 @@ namespace waavs
         auto& path = vm.graphics()->currentPath();
         auto& ctm = vm.graphics()->getCTM();
 
-        PSObject dyObj, dxObj;
-        if (!s.pop(dyObj) || !s.pop(dxObj) || !dxObj.isNumber() || !dyObj.isNumber())
-            return vm.error("op_rlineto:typecheck; expected two numbers");
-
         double x0, y0;
         if (!path.getCurrentPoint(x0, y0)) 
             return vm.error("op_rlineto:nocurrentpoint");
 
-        double dx = dxObj.asReal();
-        double dy = dyObj.asReal();
+        double dx = s.fromTop(1).asReal();
+        double dy = s.fromTop(0).asReal();
+        s.drop(2);
 
         return path.lineto(ctm, x0 + dx, y0 + dy);
     }
@@ -283,18 +269,11 @@ namespace waavs
         auto& path = vm.graphics()->currentPath();
         auto& ctm = vm.graphics()->getCTM();
 
-        if (ostk.size() < 4)
-            return vm.error("rectpath: stackunderflow");
-
-        double x;
-        double y;
-        double w;
-        double h;
-
-        if (!ostk.popReal(h) || !ostk.popReal(w) ||
-            !ostk.popReal(y) || !ostk.popReal(x))
-            return vm.error("op_rectpath: typecheck; expected four numbers");
-
+        double x = ostk.fromTop(3).asReal();
+        double y = ostk.fromTop(2).asReal();
+        double w = ostk.fromTop(1).asReal();
+        double h = ostk.fromTop(0).asReal();
+        ostk.drop(4);
 
         return path.moveto(ctm, x, y)
             && path.lineto(ctm, x + w, y)
@@ -370,12 +349,12 @@ namespace waavs
         auto& path = grph->currentPath();
         const PSMatrix& ctm = grph->getCTM();
 
-        double radius, startDeg, endDeg, cy, cx;
-        if (!ostk.popReal(endDeg)) return vm.error("op_arc: invalid angle2");
-        if (!ostk.popReal(startDeg)) return vm.error("op_arc: invalid angle1");
-        if (!ostk.popReal(radius)) return vm.error("op_arc: invalid radius");
-        if (!ostk.popReal(cy)) return vm.error("op_arc: invalid y");
-        if (!ostk.popReal(cx)) return vm.error("op_arc: invalid x");
+        double cx = ostk.fromTop(4).asReal();
+        double cy = ostk.fromTop(3).asReal();
+        double radius = ostk.fromTop(2).asReal();
+        double startDeg = ostk.fromTop(1).asReal();
+        double endDeg = ostk.fromTop(0).asReal();
+        ostk.drop(5);
 
         if (!emitArc(path, ctm, cx, cy, radius, startDeg, endDeg, false))
             return vm.error("op_arc: emitArc failed");
@@ -392,12 +371,12 @@ namespace waavs
         auto& path = grph->currentPath();
         const PSMatrix& ctm = grph->getCTM();
 
-        double radius, startDeg, endDeg, cy, cx;
-        if (!ostk.popReal(endDeg)) return vm.error("op_arcn: invalid angle2");
-        if (!ostk.popReal(startDeg)) return vm.error("op_arcn: invalid angle1");
-        if (!ostk.popReal(radius)) return vm.error("op_arcn: invalid radius");
-        if (!ostk.popReal(cy)) return vm.error("op_arcn: invalid y");
-        if (!ostk.popReal(cx)) return vm.error("op_arcn: invalid x");
+        double cx = ostk.fromTop(4).asReal();
+        double cy = ostk.fromTop(3).asReal();
+        double radius = ostk.fromTop(2).asReal();
+        double startDeg = ostk.fromTop(1).asReal();
+        double endDeg = ostk.fromTop(0).asReal();
+        ostk.drop(5);
 
         if (!emitArc(path, ctm, cx, cy, radius, startDeg, endDeg, true))
             return vm.error("op_arcn: emitArc failed");
@@ -480,31 +459,17 @@ namespace waavs
         auto& path = vm.graphics()->currentPath();
         auto& ctm = vm.graphics()->getCTM();
 
-        // Ensure 6 items are available
-        if (s.size() < 6)
-            return vm.error("curveto: stackunderflow");
-
-        PSObject y3Obj, x3Obj, y2Obj, x2Obj, y1Obj, x1Obj;
-        s.pop(y3Obj); s.pop(x3Obj);
-        s.pop(y2Obj); s.pop(x2Obj);
-        s.pop(y1Obj); s.pop(x1Obj);
-
-        if (!x1Obj.isNumber() || !y1Obj.isNumber() ||
-            !x2Obj.isNumber() || !y2Obj.isNumber() ||
-            !x3Obj.isNumber() || !y3Obj.isNumber()) {
-            return vm.error("curveto: typecheck");
-        }
-
         // Validate there's a currentpoint
         if (!path.hasCurrentPoint())
             return vm.error("curveto: no currentpoint");
 
-        double x1 = x1Obj.asReal();
-        double y1 = y1Obj.asReal();
-        double x2 = x2Obj.asReal();
-        double y2 = y2Obj.asReal();
-        double x3 = x3Obj.asReal();
-        double y3 = y3Obj.asReal();
+        double x1 = s.fromTop(5).asReal();
+        double y1 = s.fromTop(4).asReal();
+        double x2 = s.fromTop(3).asReal();
+        double y2 = s.fromTop(2).asReal();
+        double x3 = s.fromTop(1).asReal();
+        double y3 = s.fromTop(0).asReal();
+        s.drop(6);
 
         return path.curveto(ctm, x1, y1, x2, y2, x3, y3);
     }
@@ -515,27 +480,14 @@ namespace waavs
         auto& path = vm.graphics()->currentPath();
         auto& ctm = vm.graphics()->getCTM();
 
-        if (s.size() < 6)
-            return vm.error("rcurveto: stackunderflow");
-
-        PSObject dy3Obj, dx3Obj, dy2Obj, dx2Obj, dy1Obj, dx1Obj;
-        s.pop(dy3Obj); s.pop(dx3Obj);
-        s.pop(dy2Obj); s.pop(dx2Obj);
-        s.pop(dy1Obj); s.pop(dx1Obj);
-
-        if (!dx1Obj.isNumber() || !dy1Obj.isNumber() ||
-            !dx2Obj.isNumber() || !dy2Obj.isNumber() ||
-            !dx3Obj.isNumber() || !dy3Obj.isNumber()) {
-            return vm.error("rcurveto: typecheck");
-        }
-
         double cx, cy;
         if (!path.getCurrentPoint(cx, cy))
             return vm.error("rcurveto: no currentpoint");
 
-        double dx1 = dx1Obj.asReal(), dy1 = dy1Obj.asReal();
-        double dx2 = dx2Obj.asReal(), dy2 = dy2Obj.asReal();
-        double dx3 = dx3Obj.asReal(), dy3 = dy3Obj.asReal();
+        double dx1 = s.fromTop(5).asReal(), dy1 = s.fromTop(4).asReal();
+        double dx2 = s.fromTop(3).asReal(), dy2 = s.fromTop(2).asReal();
+        double dx3 = s.fromTop(1).asReal(), dy3 = s.fromTop(0).asReal();
+        s.drop(6);
 
 
         double x1 = cx + dx1;
@@ -682,6 +634,15 @@ namespace waavs
                 // pathforall ignores arcs and non-standard segment types
                 break;
             }
+
+            // 'exit' from one of the procedures ends the walk, a 'stop' 
+            // is left for run() to unwind
+            if (vm.isExitRequested()) {
+                vm.clearExitRequest();
+                break;
+            }
+            if (vm.isStopRequested())
+                break;
         }
 
         return true;
@@ -724,18 +685,18 @@ namespace waavs
             // path construction
             { "newpath",       op_newpath },
             { "currentpoint",  op_currentpoint },
-            { "moveto",        op_moveto },
-            { "rmoveto",       op_rmoveto },
-            { "lineto",        op_lineto },
-            { "rlineto",       op_rlineto },
-            { "arc",           op_arc },
-            { "arcn",          op_arcn },
+            { "moveto",        { op_moveto, "NN", PSOpcode::MoveTo } },
+            { "rmoveto",       { op_rmoveto, "NN" } },
+            { "lineto",        { op_lineto, "NN", PSOpcode::LineTo } },
+            { "rlineto",       { op_rlineto, "NN" } },
+            { "arc",           { op_arc, "NNNNN" } },
+            { "arcn",          { op_arcn, "NNNNN" } },
             { "arcto",         op_arcto },
             { "arct",          op_arct },
-            { "rectpath",      op_rectpath },
+            { "rectpath",      { op_rectpath, "NNNN" } },
 
-            { "curveto",       op_curveto },
-            { "rcurveto",      op_rcurveto },
+            { "curveto",       { op_curveto, "NNNNNN" } },
+            { "rcurveto",      { op_rcurveto, "NNNNNN" } },
             { "closepath",     op_closepath },
 
             // path management
@@ -235,10 +235,14 @@ namespace waavs
             // Make sure neither one is null
             //if (!dest || !src) return  vm.error("op_copy:invalidaccess");
 
+            if (src.length() > dest.length())
+                return vm.error("op_copy: rangecheck");
+
             if (!dest.putInterval(0, src)) 
                 return vm.error("op_copy:putInterval failed");
 
-            return s.push(destObject);
+            // The result is the part of string2 that was copied into
+            return s.push(PSObject::fromString(dest.getInterval(0, static_cast<uint32_t>(src.length()))));
         }
 
         return false; // vm.error("typecheck");
@@ -208,7 +208,6 @@ namespace waavs
     inline bool op_resourceforall(PSVirtualMachine& vm)
     {
         auto& s = vm.opStack();
-        auto& estk = vm.execStack();
         auto& rs = vm.getResourceStack();
 
         // stack: category proc
@@ -246,16 +245,20 @@ namespace waavs
                         // push key, value, proc, exec
                         s.push(PSObject::fromName(key));
                         s.push(value);
-                        estk.push(procObj);
-                        if (!vm.run())
+                        if (!vm.runProc(procObj))
                         {
                             // if exec fails, break everything
                             return false;
                         }
-                        return true;
+                        return !vm.isExitRequested() && !vm.isStopRequested();
                     });
 
-                return true; // keep scanning resource stack
+                // 'exit' ends the enumeration, a 'stop' is left for run()
+                if (vm.isExitRequested()) {
+                    vm.clearExitRequest();
+                    return false;
+                }
+                return !vm.isStopRequested(); // keep scanning resource stack
             });
 
         return true;
@@ -7,19 +7,16 @@ namespace waavs {
 
     // ----- Stack Operator Implementations -----
 
-    inline bool op_dup(PSVirtualMachine& vm) {
-        auto& s = vm.opStack();
-        if (s.empty()) return false;
+    // dup, pop, exch, index and roll have operand signatures in the table 
+    // below, so the VM has checked their operands before they run.
 
-        PSObject top;
-        if (!s.top(top)) return false;
-        s.push(top);
-        return true;
+    inline bool op_dup(PSVirtualMachine& vm) {
+        return vm.opStack().dup();
     }
 
     inline bool op_pop(PSVirtualMachine& vm) {
-        PSObject obj;
-        return vm.opStack().pop(obj);
+        vm.opStack().drop(1);
+        return true;
     }
 
     inline bool op_exch(PSVirtualMachine& vm) {
@@ -28,28 +25,27 @@ namespace waavs {
 
     inline bool op_index(PSVirtualMachine& vm) {
         auto& s = vm.opStack();
-        PSObject countObj;
-
-        if (!s.pop(countObj)) return false;
-        if (!countObj.isInt()) return false;
+        PSObject& top = s.fromTop(0);
 
-        int n = countObj.asInt();
-        PSObject nthObj;
-        if (!s.nth(n, nthObj)) return false;
+        int n = top.asInt();
+        if (n < 0 || size_t(n) + 1 >= s.size())
+            return vm.error("rangecheck", "index");
 
-        return s.push(nthObj);
+        top = s.fromTop(size_t(n) + 1);
+        return true;
     }
 
     inline bool op_roll(PSVirtualMachine& vm) {
         auto& s = vm.opStack();
-        PSObject jObj, nObj;
 
-        if (!s.pop(jObj)) return false;
-        if (!s.pop(nObj)) return false;
-        if (!jObj.isInt() || !nObj.isInt()) return false;
+        int count = s.fromTop(1).asInt();
+        int shift = s.fromTop(0).asInt();
+        if (count < 0 || size_t(count) + 2 > s.size())
+            return vm.error("rangecheck", "roll");
 
-        int count = nObj.asInt();
-        int shift = jObj.asInt();
+        s.drop(2);
+        if (count == 0)
+            return true;
 
         return s.roll(count, shift);
     }
@@ -104,11 +100,11 @@ namespace waavs {
 
     inline const PSOperatorFuncMap& getStackOps() {
         static const PSOperatorFuncMap table = {
-            { "dup",          op_dup },
-            { "pop",          op_pop },
-            { "exch",         op_exch },
-            { "index",        op_index },
-            { "roll",         op_roll },
+            { "dup",          { op_dup, "*", PSOpcode::Dup } },
+            { "pop",          { op_pop, "*" } },
+            { "exch",         { op_exch, "**", PSOpcode::Exch } },
+            { "index",        { op_index, "i", PSOpcode::Index } },
+            { "roll",         { op_roll, "ii", PSOpcode::Roll } },
             { "clear",        op_clear },
             { "count",        op_count },
             { "mark",         op_mark },
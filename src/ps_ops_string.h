@@ -19,9 +19,10 @@ namespace waavs {
         if (!strObj.isString()) 
             return vm.error("op_cvs: typecheck");
 
-        auto &buf = strObj.asMutableString();
-        char* dst = reinterpret_cast<char*>(buf.data());
-        size_t maxLen = buf.capacity()+1;
+        // Format into a scratch buffer, since snprintf wants room for
+        // a terminating null, which the string does not have.
+        char dst[256];
+        size_t maxLen = sizeof(dst);
 
         int len = 0;
 
@@ -43,13 +44,20 @@ namespace waavs {
             break;
         }
 
-        // Ensure length is valid and clamped to capacity
         if (len < 0) len = 0;
-        if (static_cast<size_t>(len) > maxLen) 
-            len = static_cast<int>(maxLen);
-        buf.setLength(len);
+        if (static_cast<size_t>(len) >= maxLen)
+            len = static_cast<int>(maxLen - 1);
 
-        return s.push(strObj);
+        // The result is the initial substring of the operand string
+        auto buf = strObj.asString();
+        if (static_cast<size_t>(len) > buf.length())
+            return vm.error("op_cvs: rangecheck");
+
+        auto result = buf.getInterval(0, static_cast<uint32_t>(len));
+        if (len > 0)
+            std::memcpy(result.data(), dst, len);
+
+        return s.push(PSObject::fromString(result));
 
     }
 
@@ -21,8 +21,11 @@ namespace waavs {
             return vm.error("op_ashow: stackunderflow");
         }
 
+        if (!strObj.isString())
+            return vm.error("op_ashow: typecheck; string");
+
         // BUGBUG: not using specified adjustments
-        g->showText(ctm, strObj.asMutableString());
+        g->showText(ctm, strObj.asString());
 
         return true;
     }
@@ -48,7 +51,7 @@ namespace waavs {
 
         // BUGBUG: need to apply per character-pair spacing
         // but for now we'll just do what show does
-        g->showText(ctm, strObj.asMutableString());
+        g->showText(ctm, strObj.asString());
 
         return true;
     }
@@ -65,9 +68,11 @@ namespace waavs {
         PSObject strObj;
 
         ostk.pop(strObj);
+        if (!strObj.isString())
+            return vm.error("op_show: typecheck; string");
 
         // pop a string, then render it using current position and font
-        g->showText(ctm, strObj.asMutableString());
+        g->showText(ctm, strObj.asString());
 
         return true;
     }
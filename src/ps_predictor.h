@@ -0,0 +1,220 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+//
+// Predictors
+//
+// The FlateDecode and LZWDecode filters can be told, through their
+// DecodeParms, that the image data was run through a predictor before it
+// was compressed, which makes it compress better.  Undoing it happens a
+// row at a time, after decoding.
+//
+//  Predictor  1        none
+//             2        TIFF predictor 2, each sample less the one to its left
+//             10..15   PNG predictors, each row starts with a byte saying
+//                      which of the five PNG filters it went through
+//
+// Colors, BitsPerComponent and Columns give the size of a row.
+//
+
+namespace waavs {
+
+    struct PSPredictor
+    {
+        int fPredictor = 1;
+        int fColors = 1;
+        int fBitsPerComponent = 8;
+        int fColumns = 1;
+
+        // False for parameters that do not make sense
+        bool configure(int predictor, int colors, int bitsPerComponent, int columns)
+        {
+            if (predictor != 1 && predictor != 2 && (predictor < 10 || predictor > 15))
+                return false;
+            if (colors < 1 || columns < 1)
+                return false;
+            if (bitsPerComponent != 1 && bitsPerComponent != 2 && bitsPerComponent != 4 &&
+                bitsPerComponent != 8 && bitsPerComponent != 16)
+                return false;
+
+            fPredictor = predictor;
+            fColors = colors;
+            fBitsPerComponent = bitsPerComponent;
+            fColumns = columns;
+
+            fRowBytes = (static_cast<size_t>(colors) * bitsPerComponent * columns + 7) / 8;
+            fPixelBytes = std::max<size_t>(1, static_cast<size_t>(colors) * bitsPerComponent / 8);
+
+            // Room for the PNG filter byte in front of each row
+            fRaw.assign(fRowBytes + 1, 0);
+            fPrior.assign(fRowBytes + 1, 0);
+            fRawFill = 0;
+            fRowPos = fRowLength = 0;
+
+            return true;
+        }
+
+        bool isActive() const noexcept { return fPredictor >= 2; }
+        bool isPNG() const noexcept { return fPredictor >= 10; }
+
+        // Decode up to 'room' bytes into 'out', a row at a time, taking
+        // the predicted data from 'read', which is called as a filter's
+        // decodeBlock is; read(dst, count) returns how many bytes it gave,
+        // zero at the end of the data.  A short last row is undone as far
+        // as it goes.
+        template <typename Read>
+        size_t decode(uint8_t* out, size_t room, Read&& read)
+        {
+            size_t n = 0;
+
+            while (n < room) {
+                if (fRowPos < fRowLength) {
+                    size_t chunk = std::min(room - n, fRowLength - fRowPos);
+                    std::memcpy(out + n, fPrior.data() + 1 + fRowPos, chunk);
+                    fRowPos += chunk;
+                    n += chunk;
+                    continue;
+                }
+
+                // Gather the next row
+                size_t first = isPNG() ? 0 : 1;
+                size_t rawSize = fRowBytes + 1;
+                while (first + fRawFill < rawSize) {
+                    size_t got = read(fRaw.data() + first + fRawFill, rawSize - first - fRawFill);
+                    if (got == 0)
+                        break;
+                    fRawFill += got;
+                }
+
+                size_t length = fRawFill - (isPNG() ? std::min<size_t>(fRawFill, 1) : 0);
+                fRawFill = 0;
+                if (length == 0)
+                    break;
+
+                if (isPNG())
+                    undoPNG(length);
+                else
+                    undoTIFF(length);
+
+                // The row just undone is the prior row for the next one
+                std::swap(fRaw, fPrior);
+                fRowPos = 0;
+                fRowLength = length;
+            }
+
+            return n;
+        }
+
+    private:
+        static uint8_t paeth(int a, int b, int c) noexcept
+        {
+            int p = a + b - c;
+            int pa = std::abs(p - a);
+            int pb = std::abs(p - b);
+            int pc = std::abs(p - c);
+            if (pa <= pb && pa <= pc)
+                return static_cast<uint8_t>(a);
+            if (pb <= pc)
+                return static_cast<uint8_t>(b);
+            return static_cast<uint8_t>(c);
+        }
+
+        // fRaw is a filter byte, and 'length' bytes of a row, fPrior the
+        // row before, zeros before the first
+        void undoPNG(size_t length) noexcept
+        {
+            uint8_t* row = fRaw.data() + 1;
+            const uint8_t* prior = fPrior.data() + 1;
+            size_t bpp = std::min(fPixelBytes, length);
+
+            switch (fRaw[0]) {
+            case 0:     // None
+                break;
+
+            case 1:     // Sub
+                for (size_t i = bpp; i < length; ++i)
+                    row[i] = static_cast<uint8_t>(row[i] + row[i - bpp]);
+                break;
+
+            case 2:     // Up
+                for (size_t i = 0; i < length; ++i)
+                    row[i] = static_cast<uint8_t>(row[i] + prior[i]);
+                break;
+
+            case 3:     // Average
+                for (size_t i = 0; i < bpp; ++i)
+                    row[i] = static_cast<uint8_t>(row[i] + (prior[i] >> 1));
+                for (size_t i = bpp; i < length; ++i)
+                    row[i] = static_cast<uint8_t>(row[i] + ((row[i - bpp] + prior[i]) >> 1));
+                break;
+
+            case 4:     // Paeth
+                for (size_t i = 0; i < bpp; ++i)
+                    row[i] = static_cast<uint8_t>(row[i] + prior[i]);
+                for (size_t i = bpp; i < length; ++i)
+                    row[i] = static_cast<uint8_t>(row[i] + paeth(row[i - bpp], prior[i], prior[i - bpp]));
+                break;
+
+            default:    // not a PNG filter; the row is left as it is
+                break;
+            }
+
+            // A short row leaves whatever was there before in the rest of
+            // it, which is never read again
+        }
+
+        // TIFF predictor 2; each sample is the difference from the sample
+        // of the same color to its left
+        void undoTIFF(size_t length) noexcept
+        {
+            uint8_t* row = fRaw.data() + 1;
+            size_t colors = static_cast<size_t>(fColors);
+
+            if (fBitsPerComponent == 8) {
+                for (size_t i = colors; i < length; ++i)
+                    row[i] = static_cast<uint8_t>(row[i] + row[i - colors]);
+                return;
+            }
+
+            if (fBitsPerComponent == 16) {
+                size_t stride = colors * 2;
+                for (size_t i = stride; i + 1 < length; i += 2) {
+                    uint16_t left = static_cast<uint16_t>((row[i - stride] << 8) | row[i - stride + 1]);
+                    uint16_t value = static_cast<uint16_t>(((row[i] << 8) | row[i + 1]) + left);
+                    row[i] = static_cast<uint8_t>(value >> 8);
+                    row[i + 1] = static_cast<uint8_t>(value);
+                }
+                return;
+            }
+
+            // 1, 2 or 4 bits; samples packed high bits first
+            size_t bits = static_cast<size_t>(fBitsPerComponent);
+            size_t samples = std::min(length * 8, fRowBytes * 8) / bits;
+            samples = std::min(samples, colors * static_cast<size_t>(fColumns));
+            uint32_t mask = (1u << bits) - 1;
+            for (size_t s = colors; s < samples; ++s) {
+                size_t at = s * bits;
+                size_t from = (s - colors) * bits;
+                uint32_t shift = static_cast<uint32_t>(8 - bits - (at & 7));
+                uint32_t left = (row[from >> 3] >> (8 - bits - (from & 7))) & mask;
+                uint32_t value = (((row[at >> 3] >> shift) & mask) + left) & mask;
+                row[at >> 3] = static_cast<uint8_t>((row[at >> 3] & ~(mask << shift)) | (value << shift));
+            }
+        }
+
+        size_t fRowBytes = 0;
+        size_t fPixelBytes = 1;
+
+        std::vector<uint8_t> fRaw;      // the row being gathered, after a filter byte
+        std::vector<uint8_t> fPrior;    // the last row undone, after a filter byte
+        size_t fRawFill = 0;
+        size_t fRowPos = 0;             // how much of the last row has been given out
+        size_t fRowLength = 0;
+    };
+}
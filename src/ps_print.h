@@ -113,7 +113,7 @@ namespace waavs {
             break;
 
         case PSObjectType::String: {
-            auto& strPs = obj.asString();
+            auto strPs = obj.asString();
 
             os << "(";
             if (strPs.length() == 0) {
@@ -142,7 +142,7 @@ namespace waavs {
             break;
 
         case PSObjectType::Operator: {
-            auto op = obj.asOperator();
+            const PSOperator& op = obj.asOperator();
             os << "--OP:" << (op.name().isValid() ? op.name().c_str() : "UNKNOWN") << "--";
         }
                                    break;
@@ -0,0 +1,402 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "pscore.h"
+
+//
+// PSPrologCache
+//
+// Most jobs begin with the same prolog; the dvips TeXDict, a driver's
+// procset.  Scanning it into objects is the same work every time, so the
+// objects the scanner makes for a prolog region are kept, in a compact
+// binary form, keyed by a hash of the region's bytes.  The next job with
+// the same bytes gets the objects back without lexing anything.  Each
+// entry keeps the bytes themselves too, and a hit is only a hit when they
+// match; the hash is easy to collide, and one job must not be able to
+// choose what a later job's prolog turns into.
+//
+// A region is what lies between one of these pairs of DSC comments
+//   %%BeginProlog      %%EndProlog
+//   %%BeginProcSet     %%EndProcSet
+//   %%BeginResource    %%EndResource
+// and PSObjectGenerator is what finds them, and replays the objects.
+//
+// A region that reads from its own file (currentfile, eexec) is never
+// cached, as what follows those is data, not program text.
+//
+// The cache always lives in memory.  Given a directory, entries are also
+// written there, one file per region, so they persist from one run to
+// the next.  The cache is opt-in; see PSVirtualMachine::setPrologCache()
+//
+
+namespace waavs
+{
+    struct PSPrologCacheStats
+    {
+        size_t fHits{ 0 };
+        size_t fMisses{ 0 };
+        size_t fUncacheable{ 0 };
+        size_t fBytesReplayed{ 0 };     // of prolog text that was not scanned
+        double fScanMs{ 0 };            // scanning regions that missed
+        double fReplayMs{ 0 };          // replaying regions that hit
+        double fSavedMs{ 0 };           // what scanning the hits cost, less replaying them
+    };
+
+    struct PSPrologCache
+    {
+    private:
+        static constexpr uint32_t kMagic = 0x43535057;  // "WPSC"
+        static constexpr uint32_t kVersion = 2;
+
+        struct Entry {
+            std::vector<uint8_t> fText; // the region text, to compare on a lookup
+            double fScanMs{ 0 };        // what scanning it took, the first time
+            std::vector<uint8_t> fData; // the serialized objects
+
+            bool matches(const OctetCursor& region) const noexcept
+            {
+                return fText.size() == region.size()
+                    && (region.empty() || std::memcmp(fText.data(), region.data(), region.size()) == 0);
+            }
+        };
+
+        std::string fDirectory;
+        std::unordered_map<uint64_t, Entry> fEntries;
+        std::unordered_set<uint64_t> fUncacheable;
+        PSPrologCacheStats fStats;
+
+        // Serialized object tags
+        enum Tag : uint8_t {
+            TagNull = 0,
+            TagInt,
+            TagReal,
+            TagBool,
+            TagName,
+            TagString,
+            TagArray,
+        };
+
+        static void putBytes(std::vector<uint8_t>& out, const void* p, size_t n)
+        {
+            const uint8_t* b = static_cast<const uint8_t*>(p);
+            out.insert(out.end(), b, b + n);
+        }
+
+        template <typename T>
+        static void putValue(std::vector<uint8_t>& out, T v) { putBytes(out, &v, sizeof(v)); }
+
+        template <typename T>
+        static bool getValue(const uint8_t*& p, const uint8_t* end, T& v)
+        {
+            if (size_t(end - p) < sizeof(T)) return false;
+            std::memcpy(&v, p, sizeof(T));
+            p += sizeof(T);
+            return true;
+        }
+
+        // Only what the scanner makes can be serialized
+        static bool serializeObject(std::vector<uint8_t>& out, const PSObject& obj)
+        {
+            uint8_t flags = static_cast<uint8_t>((obj.isExecutable() ? uint8_t(PS_OBJ_FLAG_EXECUTABLE) : uint8_t(0))
+                | (obj.isSystemOp() ? uint8_t(PS_OBJ_FLAG_SYSTEM_OP) : uint8_t(0)));
+
+            switch (obj.type) {
+            case PSObjectType::Null:
+                putValue(out, uint8_t(TagNull)); putValue(out, flags);
+                return true;
+
+            case PSObjectType::Int:
+                putValue(out, uint8_t(TagInt)); putValue(out, flags);
+                putValue(out, obj.asInt());
+                return true;
+
+            case PSObjectType::Real:
+                putValue(out, uint8_t(TagReal)); putValue(out, flags);
+                putValue(out, obj.asReal());
+                return true;
+
+            case PSObjectType::Bool:
+                putValue(out, uint8_t(TagBool)); putValue(out, flags);
+                putValue(out, uint8_t(obj.asBool() ? 1 : 0));
+                return true;
+
+            case PSObjectType::Name: {
+                PSName name = obj.asName();
+                uint32_t len = static_cast<uint32_t>(name.length());
+                putValue(out, uint8_t(TagName)); putValue(out, flags);
+                putValue(out, len);
+                putBytes(out, name.c_str(), len);
+                return true;
+            }
+
+            case PSObjectType::String: {
+                PSString str = obj.asString();
+                uint32_t len = static_cast<uint32_t>(str.length());
+                putValue(out, uint8_t(TagString)); putValue(out, flags);
+                putValue(out, len);
+                if (len)
+                    putBytes(out, str.data(), len);
+                return true;
+            }
+
+            case PSObjectType::Array: {
+                auto arr = obj.asArray();
+                if (!arr)
+                    return false;
+
+                putValue(out, uint8_t(TagArray)); putValue(out, flags);
+                putValue(out, static_cast<uint32_t>(arr->size()));
+                for (const PSObject& element : arr->elements) {
+                    if (!serializeObject(out, element))
+                        return false;
+                }
+                return true;
+            }
+
+            default:
+                return false;
+            }
+        }
+
+        static bool deserializeObject(const uint8_t*& p, const uint8_t* end, PSObject& obj, int depth)
+        {
+            uint8_t tag = 0;
+            uint8_t flags = 0;
+            if (depth > 1000 || !getValue(p, end, tag) || !getValue(p, end, flags))
+                return false;
+
+            switch (tag) {
+            case TagNull:
+                obj.reset();
+                break;
+
+            case TagInt: {
+                int32_t v;
+                if (!getValue(p, end, v)) return false;
+                obj.resetFromInt(v);
+                break;
+            }
+
+            case TagReal: {
+                double v;
+                if (!getValue(p, end, v)) return false;
+                obj.resetFromReal(v);
+                break;
+            }
+
+            case TagBool: {
+                uint8_t v;
+                if (!getValue(p, end, v)) return false;
+                obj.resetFromBool(v != 0);
+                break;
+            }
+
+            case TagName:
+            case TagString: {
+                uint32_t len;
+                if (!getValue(p, end, len) || size_t(end - p) < len) return false;
+                if (tag == TagName)
+                    obj.resetFromName(PSName(reinterpret_cast<const char*>(p), len));
+                else
+                    obj.resetFromString(PSString::fromSpan(p, len));
+                p += len;
+                break;
+            }
+
+            case TagArray: {
+                uint32_t count;
+                if (!getValue(p, end, count) || size_t(end - p) < count * 2ull) return false;
+                auto arr = PSArray::create(count);
+                for (uint32_t i = 0; i < count; ++i) {
+                    if (!deserializeObject(p, end, arr->elements[i], depth + 1))
+                        return false;
+                }
+                obj.resetFromArray(arr);
+                break;
+            }
+
+            default:
+                return false;
+            }
+
+            obj.setExecutable((flags & PS_OBJ_FLAG_EXECUTABLE) != 0);
+            obj.setSystemOp((flags & PS_OBJ_FLAG_SYSTEM_OP) != 0);
+            return true;
+        }
+
+        std::string entryPath(uint64_t key) const
+        {
+            char name[32];
+            snprintf(name, sizeof(name), "%016llx.psc", static_cast<unsigned long long>(key));
+            return fDirectory + "/" + name;
+        }
+
+        // An entry file is a header, the region text, then the serialized objects
+        //   magic, version, region length, scan time (ms), data length
+        bool loadEntry(uint64_t key, const OctetCursor& region, Entry& entry) const
+        {
+            if (fDirectory.empty())
+                return false;
+
+            FILE* fp = fopen(entryPath(key).c_str(), "rb");
+            if (!fp)
+                return false;
+
+            uint32_t magic = 0, version = 0;
+            uint64_t regionLength = 0, dataLength = 0;
+            double scanMs = 0;
+            bool ok = fread(&magic, sizeof(magic), 1, fp) == 1 && magic == kMagic
+                && fread(&version, sizeof(version), 1, fp) == 1 && version == kVersion
+                && fread(&regionLength, sizeof(regionLength), 1, fp) == 1 && regionLength == region.size()
+                && fread(&scanMs, sizeof(scanMs), 1, fp) == 1
+                && fread(&dataLength, sizeof(dataLength), 1, fp) == 1;
+
+            if (ok) {
+                entry.fText.resize(region.size());
+                ok = region.empty() || fread(entry.fText.data(), 1, entry.fText.size(), fp) == entry.fText.size();
+                ok = ok && entry.matches(region);
+            }
+
+            if (ok) {
+                entry.fScanMs = scanMs;
+                entry.fData.resize(static_cast<size_t>(dataLength));
+                ok = dataLength == 0 || fread(entry.fData.data(), 1, entry.fData.size(), fp) == entry.fData.size();
+            }
+
+            fclose(fp);
+            return ok;
+        }
+
+        void saveEntry(uint64_t key, const Entry& entry) const
+        {
+            if (fDirectory.empty())
+                return;
+
+            FILE* fp = fopen(entryPath(key).c_str(), "wb");
+            if (!fp)
+                return;
+
+            uint64_t regionLength = entry.fText.size();
+            uint64_t dataLength = entry.fData.size();
+            fwrite(&kMagic, sizeof(kMagic), 1, fp);
+            fwrite(&kVersion, sizeof(kVersion), 1, fp);
+            fwrite(&regionLength, sizeof(regionLength), 1, fp);
+            fwrite(&entry.fScanMs, sizeof(entry.fScanMs), 1, fp);
+            fwrite(&dataLength, sizeof(dataLength), 1, fp);
+            fwrite(entry.fText.data(), 1, entry.fText.size(), fp);
+            fwrite(entry.fData.data(), 1, entry.fData.size(), fp);
+            fclose(fp);
+        }
+
+    public:
+        // Smaller regions scan faster than they can be fetched
+        static constexpr size_t kMinRegionSize = 1024;
+
+        explicit PSPrologCache(const char* directory = nullptr)
+            : fDirectory(directory ? directory : "")
+        {
+        }
+
+        // A cache in memory only, or one that also keeps its
+        // entries in 'directory', which must already exist
+        static std::shared_ptr<PSPrologCache> create(const char* directory = nullptr)
+        {
+            return std::make_shared<PSPrologCache>(directory);
+        }
+
+        static double nowMs() noexcept
+        {
+            using namespace std::chrono;
+            return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+        }
+
+        // The key for a region of prolog text
+        static uint64_t keyOf(const OctetCursor& region) noexcept
+        {
+            return fnv1a_64(region.data(), region.size()) ^ (uint64_t(region.size()) * 0x9E3779B97F4A7C15ull);
+        }
+
+        const PSPrologCacheStats& stats() const noexcept { return fStats; }
+        void resetStats() noexcept { fStats = PSPrologCacheStats(); }
+
+        bool isUncacheable(uint64_t key) const { return fUncacheable.count(key) != 0; }
+
+        void markUncacheable(uint64_t key)
+        {
+            fUncacheable.insert(key);
+            fStats.fUncacheable++;
+        }
+
+        // Replay the objects of a region seen before.  False when the
+        // region is not in the cache, or a different region has its key.
+        bool lookup(uint64_t key, const OctetCursor& region, std::vector<PSObject>& out)
+        {
+            double start = nowMs();
+
+            auto it = fEntries.find(key);
+            if (it == fEntries.end() || !it->second.matches(region)) {
+                Entry entry;
+                if (!loadEntry(key, region, entry))
+                    return false;
+                it = fEntries.insert_or_assign(key, std::move(entry)).first;
+            }
+
+            const Entry& entry = it->second;
+            const uint8_t* p = entry.fData.data();
+            const uint8_t* end = p + entry.fData.size();
+
+            uint32_t count = 0;
+            if (!getValue(p, end, count))
+                return false;
+
+            out.clear();
+            out.resize(count);
+            for (uint32_t i = 0; i < count; ++i) {
+                if (!deserializeObject(p, end, out[i], 0)) {
+                    out.clear();
+                    fEntries.erase(it);
+                    return false;
+                }
+            }
+
+            double ms = nowMs() - start;
+            fStats.fHits++;
+            fStats.fBytesReplayed += region.size();
+            fStats.fReplayMs += ms;
+            fStats.fSavedMs += entry.fScanMs - ms;
+
+            return true;
+        }
+
+        // Keep the objects scanned from a region, which took 'scanMs'
+        bool store(uint64_t key, const OctetCursor& region, const std::vector<PSObject>& objects, double scanMs)
+        {
+            Entry entry;
+            entry.fText.assign(region.begin(), region.end());
+            entry.fScanMs = scanMs;
+
+            putValue(entry.fData, static_cast<uint32_t>(objects.size()));
+            for (const PSObject& obj : objects) {
+                if (!serializeObject(entry.fData, obj)) {
+                    markUncacheable(key);
+                    return false;
+                }
+            }
+
+            fStats.fMisses++;
+            fStats.fScanMs += scanMs;
+
+            saveEntry(key, entry);
+            fEntries.insert_or_assign(key, std::move(entry));
+            return true;
+        }
+    };
+}
@@ -4,6 +4,9 @@
 
 #include "pscore.h"
 #include "ps_lex_tokenizer.h"
+#include "ps_binary_token.h"
+#include "ps_hexdecode.h"
+#include "ps_prolog_cache.h"
 #include "typeconv.h"
 
 //
@@ -15,101 +18,139 @@ namespace waavs
 {
 
 
-    static bool spanToString(OctetCursor oc, std::vector<uint8_t>& result)
+    // decodeStringLiteral
+    // The body of a (string) literal, with its escapes, decoded into 'dst',
+    // which has room for at least oc.size() bytes; the decoded string is 
+    // never longer than its source.  Returns the decoded length.
+    // Runs between escapes are copied whole, so a literal without any
+    // escapes is a single memcpy.
+    static size_t decodeStringLiteral(OctetCursor oc, uint8_t* dst) noexcept
     {
-        const char* src = (const char *)oc.data();
-        size_t len = oc.size();
-
-        result.reserve(len); // worst case
-
-        for (size_t i = 0; i < len; ++i) {
-            char ch = src[i];
-            if (ch == '\\' && i + 1 < len) {
-                char next = src[++i];
-
-                switch (next) {
-                case 'n': result.push_back('\n'); break;
-                case 'r': result.push_back('\r'); break;
-                case 't': result.push_back('\t'); break;
-                case 'b': result.push_back('\b'); break;
-                case 'f': result.push_back('\f'); break;
-                case '\\': result.push_back('\\'); break;
-                case '(': result.push_back('('); break;
-                case ')': result.push_back(')'); break;
-                default:
-                    if (next >= '0' && next <= '7') {
-                        // Octal escape: up to 3 digits
-                        int val = next - '0';
-                        int count = 1;
-
-                        while (count < 3 && i + 1 < len && src[i + 1] >= '0' && src[i + 1] <= '7') {
-                            val = (val << 3) + (src[++i] - '0');
-                            ++count;
-                        }
-                        result.push_back(static_cast<uint8_t>(val));
-                    }
-                    else {
-                        // Unknown escape, just keep literal
-                        result.push_back(next);
+        const uint8_t* src = oc.data();
+        const uint8_t* end = src + oc.size();
+        uint8_t* out = dst;
+
+        while (src < end) {
+            const uint8_t* esc = static_cast<const uint8_t*>(std::memchr(src, '\\', end - src));
+            if (esc == nullptr || esc + 1 >= end) {
+                // no more escapes, a trailing backslash is kept as it is
+                std::memcpy(out, src, end - src);
+                out += end - src;
+                break;
+            }
+
+            std::memcpy(out, src, esc - src);
+            out += esc - src;
+            src = esc + 1;
+
+            uint8_t next = *src++;
+            switch (next) {
+            case 'n': *out++ = '\n'; break;
+            case 'r': *out++ = '\r'; break;
+            case 't': *out++ = '\t'; break;
+            case 'b': *out++ = '\b'; break;
+            case 'f': *out++ = '\f'; break;
+            case '\\': *out++ = '\\'; break;
+            case '(': *out++ = '('; break;
+            case ')': *out++ = ')'; break;
+
+            // A '\\' at the end of a line continues the string on the next
+            // line, neither the backslash nor the line ending are part of it
+            case '\r':
+                if (src < end && *src == '\n')
+                    ++src;
+                break;
+            case '\n':
+                break;
+
+            default:
+                if (next >= '0' && next <= '7') {
+                    // Octal escape: up to 3 digits
+                    int val = next - '0';
+                    int count = 1;
+
+                    while (count < 3 && src < end && *src >= '0' && *src <= '7') {
+                        val = (val << 3) + (*src++ - '0');
+                        ++count;
                     }
-                    break;
+                    *out++ = static_cast<uint8_t>(val);
                 }
-            }
-            else {
-                result.push_back(static_cast<uint8_t>(ch));
+                else {
+                    // Unknown escape, just keep literal
+                    *out++ = next;
+                }
+                break;
             }
         }
 
-        return true;
+        return out - dst;
     }
 
-
-    static bool spanToHexString(OctetCursor src, std::vector<uint8_t>& out) noexcept
+    // decodeHexLiteral
+    // The body of a <hex string> decoded into 'dst', which has room for
+    // (oc.size() + 1) / 2 bytes.  Whitespace is ignored, and an odd final
+    // digit is taken as if followed by a '0'.
+    static bool decodeHexLiteral(OctetCursor src, uint8_t* dst, size_t& len) noexcept
     {
-        out.clear();
+        PSHexDecoder decoder;
+        size_t n = decoder.decode(src, dst, (src.size() + 1) / 2);
+        if (decoder.fInvalid)
+            return false;
 
-        while (!src.empty()) {
-            skipWhile(src, PS_WHITESPACE);
-            if (src.empty()) break;
+        if (decoder.finish(dst[n]))
+            ++n;
 
-            uint8_t hiChar = *src;
-            ++src;
-            skipWhile(src, PS_WHITESPACE);
+        len = n;
+        return true;
+    }
 
-            uint8_t loChar = src.empty() ? '0' : *src;
-            ++src;
+    inline bool spanToString(OctetCursor oc, std::vector<uint8_t>& result)
+    {
+        result.resize(oc.size()); // worst case
+        result.resize(decodeStringLiteral(oc, result.data()));
 
-            // try to create a byte value from the two hex characters
-            uint8_t hi, lo;
-            if (!hexToNibble(hiChar, hi) || !hexToNibble(loChar, lo))
-                return false;
+        return true;
+    }
 
-            uint8_t value = (hi << 4) | lo;
-            out.push_back(value);
-        }
+    inline bool spanToHexString(OctetCursor src, std::vector<uint8_t>& out) noexcept
+    {
+        size_t len = 0;
+        out.resize((src.size() + 1) / 2);
+        bool ok = decodeHexLiteral(src, out.data(), len);
+        out.resize(ok ? len : 0);
 
-        return true;
+        return ok;
     }
 
-    // Decrypt eexec-encrypted data
+    // The cipher of eexec sections and charstrings (Type 1 Font Format, 7.1)
     // seed
-    //   55665 - exec seed (default)
-    //   4330 - eexec seed (used in Type 1 fonts)
-    inline bool eexecDecrypt(const std::vector<uint8_t>& in, std::vector<uint8_t>& out, uint16_t seed = 55665)
+    //   55665 - eexec sections (default)
+    //   4330 - charstrings
+    struct PSEexecCipher
     {
-        constexpr uint16_t c1 = 52845u;
-        constexpr uint16_t c2 = 22719u;
-        constexpr uint16_t R = 55665;
+        static constexpr uint16_t kEexecSeed = 55665;
+        static constexpr uint16_t kCharStringSeed = 4330;
 
-        out.resize(in.size());
-        uint16_t key = R;
+        uint16_t fKey;
 
-        for (size_t i = 0; i < in.size(); ++i) {
-            uint16_t cipher = in[i];
-            uint16_t plain = cipher ^ (key >> 8);
-            out[i] = plain;
-            key = static_cast<uint16_t>(((cipher + key) * c1 + c2) & 0xFFFF);
+        explicit PSEexecCipher(uint16_t seed = kEexecSeed) noexcept : fKey(seed) {}
+
+        uint8_t decrypt(uint8_t cipher) noexcept
+        {
+            uint8_t plain = static_cast<uint8_t>(cipher ^ (fKey >> 8));
+            fKey = static_cast<uint16_t>((cipher + fKey) * 52845u + 22719u);
+            return plain;
         }
+    };
+
+    // Decrypt eexec-encrypted data, all at once
+    inline bool eexecDecrypt(const std::vector<uint8_t>& in, std::vector<uint8_t>& out, uint16_t seed = PSEexecCipher::kEexecSeed)
+    {
+        PSEexecCipher cipher(seed);
+
+        out.resize(in.size());
+        for (size_t i = 0; i < in.size(); ++i)
+            out[i] = cipher.decrypt(in[i]);
 
         return true;
     }
@@ -166,37 +207,60 @@ namespace waavs
         {
             double value = 0.0;
             bool isInteger = false;
+            OctetCursor digits = lex.span;
 
-            if (readNumber(lex.span, value, isInteger)) {
+            if (readNumber(digits, value, isInteger) && digits.empty()) {
                 if (isInteger)
                     return obj.resetFromInt(static_cast<int32_t>(value));
                 else
                     return obj.resetFromReal(value);
             }
-            else {
-                return false; // Invalid number format
-            }
+
+            // Not a well formed number, such as 16#FG or 37#1, 
+            // so it is an executable name, as the Red Book says
+            if (!obj.resetFromName(lex.span)) return false;
+            obj.setExecutable(true);
+            return true;
         }
 
         case PSLexType::String: {    // (abc)
-            // BUGBUG - here we can do string decoding, or perhaps we leave
-            // that to the PSString class?
-            std::vector<uint8_t> decoded;
-            if (!spanToString(lex.span, decoded)) {
-                return false; // Invalid string format
-            }
+            // Decoded straight into the string's own storage.  The source
+            // length is an upper bound, and is exact when there are no escapes
+            PSString str;
+            PSString::fromDecoder(lex.span.size(), [&lex](uint8_t* dst, size_t& len) {
+                len = decodeStringLiteral(lex.span, dst);
+                return true;
+                }, str);
 
-            return obj.resetFromString(PSString::fromVector(decoded));
+            return obj.resetFromString(str);
         }
 
         case PSLexType::HexString: { // <48656C6C6F>
-            std::vector<uint8_t> decoded;
-            if (!spanToHexString(lex.span, decoded))
+            PSString str;
+            if (!PSString::fromDecoder((lex.span.size() + 1) / 2, [&lex](uint8_t* dst, size_t& len) {
+                return decodeHexLiteral(lex.span, dst, len);
+                }, str))
                 return false;
-            PSString str = PSString::fromVector(decoded);
+
             return obj.resetFromString(str);
         }
 
+        // A binary token that can not be decoded, a user name say, is
+        // an executable name of its first byte, which will be undefined
+        case PSLexType::BinaryToken:        // 132 - 149
+        case PSLexType::BinarySequence:     // 128 - 131
+        {
+            bool ok = (lex.type == PSLexType::BinaryToken) 
+                ? decodeBinaryToken(lex.span, obj) 
+                : decodeBinaryObjectSequence(lex.span, obj);
+            if (ok)
+                return true;
+
+            if (!obj.resetFromName(OctetCursor(lex.span.data(), 1))) return false;
+            obj.setExecutable(true);
+            return true;
+        }
+
         // The default case is to return anything not already identified
         // as an executable name
         default:
@@ -219,16 +283,29 @@ namespace waavs
     static inline bool nextPSObject(PSLexemeGenerator& lexgen, PSObject& obj);
 
 
+    // The elements of the procedures being scanned, the innermost last.
+    // It keeps its capacity from one procedure to the next, so the only
+    // allocation for a procedure's elements is made once its size is 
+    // known, instead of each time a growing array runs out of room.
+    static inline std::vector<PSObject>& procedureScratch()
+    {
+        static thread_local std::vector<PSObject> sScratch;
+        return sScratch;
+    }
+
     // Scan a procedure, which is a sequence of tokens that ends with a ProcEnd token.
     static bool scanProcedure(PSLexemeGenerator& lexgen, PSObject& out)
     {
-        auto arr = PSArray::create();
+        std::vector<PSObject>& scratch = procedureScratch();
+        const size_t base = scratch.size();
 
         while (true) {
             PSObject element;
 
-			if (!nextPSObject(lexgen, element)) 
+			if (!nextPSObject(lexgen, element)) {
+                scratch.resize(base);
                 return false;   // unterminated procedure
+            }
 
             // We get a null object either at procEnd, or end of input
             if (element.isNull()) {
@@ -236,16 +313,38 @@ namespace waavs
                 break;
 			}
 
-            arr->append(element);
+            scratch.push_back(std::move(element));
         }
 
-        out.resetFromArray(arr);
+        out.resetFromArray(PSArray::createFrom(scratch.data() + base, scratch.size() - base));
         out.setExecutable(true); // mark the procedure as executable
+        scratch.resize(base);
 
         return true;
     }
 
 
+    // Turn a lexeme into an object, reading the rest of a procedure when
+    // the lexeme opens one
+    static inline bool objectFromLexeme(PSLexemeGenerator& lexgen, const PSLexeme& lex, PSObject& obj)
+    {
+        switch (lex.type) {
+            case PSLexType::Eof:
+                return obj.reset(); // Reset the object to null on EOF
+
+            case PSLexType::LBRACE: // {
+                return scanProcedure(lexgen, obj);
+
+            case PSLexType::RBRACE: // }
+                return obj.reset();
+
+            // The default case is to return anything not already identified
+            // as an executable name
+            default:
+                return objectFromLex(lex, obj);
+        }
+    }
+
     // Take the stream of lexemes, and return the next PSObject from there
     //
     static inline bool nextPSObject(PSLexemeGenerator& lexgen, PSObject &obj) 
@@ -260,31 +359,111 @@ namespace waavs
                 case PSLexType::DSCComment:
                     continue; // Skip
 
-                case PSLexType::Eof:
-				    return obj.reset(); // Reset the object to null on EOF
+                default:
+                    return objectFromLexeme(lexgen, lex, obj);
+            }
+        }
 
-				case PSLexType::LBRACE: // {
-                    return scanProcedure(lexgen, obj);
+        return false;
+    }
 
-                case PSLexType::RBRACE: // }
-                    return obj.reset();
+    // The DSC comments that bracket a region the prolog cache can keep
+    struct PSPrologRegionKind {
+        OctetCursor fBegin;
+        OctetCursor fEnd;
+    };
+
+    static inline const PSPrologRegionKind* prologRegionKind(const OctetCursor& comment) noexcept
+    {
+        static const PSPrologRegionKind kKinds[] = {
+            { "%%BeginProlog", "%%EndProlog" },
+            { "%%BeginProcSet", "%%EndProcSet" },
+            { "%%BeginResource", "%%EndResource" },
+        };
+
+        for (const auto& kind : kKinds) {
+            if (comment.size() >= kind.fBegin.size() && std::memcmp(comment.data(), kind.fBegin.data(), kind.fBegin.size()) == 0)
+                return &kind;
+        }
+
+        return nullptr;
+    }
+
+    // The start of the first line in [p, end) that begins with 'keyword', 
+    // nullptr if there is not one.  'p' is not itself a line start.
+    static inline const uint8_t* findDSCLine(const uint8_t* p, const uint8_t* end, const OctetCursor& keyword) noexcept
+    {
+        const uint8_t* start = p;
+        while (p < end) {
+            const uint8_t* pct = static_cast<const uint8_t*>(std::memchr(p, '%', end - p));
+            if (!pct)
+                return nullptr;
+
+            if (pct > start && (pct[-1] == '\n' || pct[-1] == '\r') &&
+                size_t(end - pct) >= keyword.size() && std::memcmp(pct, keyword.data(), keyword.size()) == 0)
+                return pct;
+
+            p = pct + 1;
+        }
+
+        return nullptr;
+    }
+
+    // A region can be cached when it is nothing but program text.  It
+    // must not read from its own file, its braces must balance, and
+    // nothing in it can be something that runs as soon as it is read.
+    static inline bool isCacheablePrologRegion(const OctetCursor& region)
+    {
+        auto file = PSMemoryFile::create(region);
+        PSLexeme lex;
+        int depth = 0;
+
+        while (nextPSLexeme(file, lex)) {
+            switch (lex.type) {
+                case PSLexType::LBRACE:
+                    depth++;
+                    break;
+
+                case PSLexType::RBRACE:
+                    if (--depth < 0)
+                        return false;
+                    break;
+
+                case PSLexType::Name:
+                    if (lex.span == "currentfile" || lex.span == "eexec")
+                        return false;
+                    break;
+
+                case PSLexType::BinarySequence:
+                    if (depth == 0)
+                        return false;
+                    break;
+
+                case PSLexType::UnterminatedString:
+                    return false;
+
+                case PSLexType::Eof:
+                    return depth == 0;
 
-                // The default case is to return anything not already identified
-                // as an executable name
                 default:
-				    return objectFromLex(lex, obj);
+                    break;
             }
         }
 
-        return false;
+        // anything left over did not make a token
+        return depth == 0 && file->getCursor().empty();
     }
 
-    
     struct PSObjectGenerator
     {
         PSFileHandle fOwnFile;
         PSLexemeGenerator lexgen;
 
+        // Objects of a prolog region, waiting to be handed out
+        PSPrologCache* fPrologCache{ nullptr };
+        std::vector<PSObject> fReplay;
+        size_t fReplayAt{ 0 };
+
 
         explicit PSObjectGenerator(PSFileHandle file)
             : fOwnFile(file),
@@ -303,78 +482,105 @@ namespace waavs
         //{
         //}
 
+        // With a cache, prolog regions are scanned once, and their
+        // objects replayed from then on
+        void setPrologCache(PSPrologCache* cache) noexcept { fPrologCache = cache; }
+
         bool next(PSObject& obj)
         {
-            return nextPSObject(lexgen, obj);
-        }
-    };
-    
-
-    /*
-    * This is for dealing with embedded type1 fonts
-    struct PSObjectGenerator
-    {
-        std::vector<PSLexemeGenerator> stack;
-        std::vector<uint8_t> decrypted;
+            if (fReplayAt < fReplay.size()) {
+                obj = std::move(fReplay[fReplayAt++]);
+                return true;
+            }
 
-        explicit PSObjectGenerator(const OctetCursor& oc)
-        {
-            stack.emplace_back(oc);
-        }
+            if (!fPrologCache)
+                return nextPSObject(lexgen, obj);
 
-        bool next(PSObject& obj)
-        {
+            PSLexeme lex;
+            while (lexgen.next(lex)) {
+                switch (lex.type) {
+                    case PSLexType::Whitespace:
+                    case PSLexType::Comment:
+                        continue;
 
-            while (!stack.empty()) {
-                PSLexemeGenerator& top = stack.back();
+                    case PSLexType::DSCComment:
+                        if (replayPrologRegion(lex)) {
+                            obj = std::move(fReplay[fReplayAt++]);
+                            return true;
+                        }
+                        continue;
 
-                PSLexeme lex;
-                if (!top.next(lex)) {
-                    stack.pop_back(); // finished current stream
-                    continue;
+                    default:
+                        return objectFromLexeme(lexgen, lex, obj);
                 }
+            }
 
-                switch (lex.type)
-                {
+            return false;
+        }
 
-                case PSLexType::Eof:
-                    stack.pop_back(); // done with this generator
-                    continue;
+        // A binary object sequence read directly by the interpreter is 
+        // executed as soon as it is read, unlike a { procedure }
+        bool isImmediate() const noexcept
+        {
+            return lexgen.fLastType == PSLexType::BinarySequence;
+        }
 
-                case PSLexType::EexecSwitch: {
-                    // --- decrypt remaining input ---
-                    std::vector<uint8_t> hexDecoded;
+    private:
+        // Having just read the comment that begins a prolog region, fill 
+        // the replay list with the objects of the region, from the cache,
+        // or by scanning it, and move the file to the comment that ends it.
+        // False when the region is not one that can be cached, in which
+        // case it is scanned as usual.
+        bool replayPrologRegion(const PSLexeme& comment)
+        {
+            const PSPrologRegionKind* kind = prologRegionKind(comment.span);
+            if (!kind)
+                return false;
 
-                    if (!spanToHexString(lex.span, hexDecoded))
-                        return false;
+            // The whole region has to be in view
+            OctetCursor& cursor = lexgen.fFile->getCursor();
+            const uint8_t* stop = findDSCLine(cursor.begin(), cursor.end(), kind->fEnd);
+            if (!stop)
+                return false;
 
-                    eexecDecrypt(hexDecoded, decrypted);
+            // One region of a kind inside another; leave the outer one to 
+            // be scanned, and cache the inner one when it comes up
+            OctetCursor region(cursor.begin(), stop - cursor.begin());
+            if (region.size() < PSPrologCache::kMinRegionSize)
+                return false;
+
+            if (findDSCLine(region.begin(), region.end(), kind->fBegin))
+                return false;
+
+            uint64_t key = PSPrologCache::keyOf(region);
+            if (fPrologCache->isUncacheable(key))
+                return false;
 
-                    // Optional: trim 512 random bytes from beginning
-                    // if the first 48 lines look like garbage
+            fReplay.clear();
+            fReplayAt = 0;
 
-                    // Push new generator
-                    stack.emplace_back(OctetCursor(decrypted.data(), decrypted.size()));
-                    continue;
+            if (!fPrologCache->lookup(key, region, fReplay)) {
+                if (!isCacheablePrologRegion(region)) {
+                    fPrologCache->markUncacheable(key);
+                    return false;
                 }
 
-                case PSLexType::LBRACE:
-                    return scanProcedure(top, obj);
+                double start = PSPrologCache::nowMs();
 
-                case PSLexType::RBRACE:
-                    return obj.reset();
+                PSObjectGenerator sub(PSMemoryFile::create(region));
+                PSObject obj;
+                while (sub.next(obj) && sub.lexgen.fLastType != PSLexType::Eof)
+                    fReplay.push_back(obj);
 
-                default:
-                    return objectFromLex(lex, obj);
-                }
+                fPrologCache->store(key, region, fReplay, PSPrologCache::nowMs() - start);
             }
 
-            return obj.reset(); // All sources exhausted
+            cursor.fStart = stop;
+
+            return !fReplay.empty();
         }
     };
-    */
-
-
+    
 
 }
 
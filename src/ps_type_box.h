@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+
+namespace waavs {
+    // --------------------
+    // PSHeapBox
+    //
+    // Payloads that do not fit into the 8 bytes of a PSObject (handles,
+    // matrices, paths, string bodies) are placed in a reference counted box.
+    // Copying a PSObject that holds a box is a pointer copy plus a count
+    // increment.  The VM is single threaded, so the count is a plain integer.
+    // Boxes are never mutated in place once shared, except for string
+    // bodies, which are meant to be shared (PostScript strings are 
+    // composite objects).
+    // --------------------
+    struct PSHeapBox {
+        uint32_t fRefCount{ 1 };
+
+        virtual ~PSHeapBox() = default;
+
+        void retain() noexcept { ++fRefCount; }
+        void release() noexcept { if (--fRefCount == 0) delete this; }
+    };
+
+    template <typename T>
+    struct PSBox : public PSHeapBox {
+        T value;
+
+        explicit PSBox(const T& v) : value(v) {}
+        explicit PSBox(T&& v) noexcept : value(std::move(v)) {}
+    };
+}
@@ -5,33 +5,46 @@
 
 namespace waavs {
 
+    // --------------------
+    // PSDictionary
+    //
     // A collection made explicitly to support PSObjects that are
     // accessed by PSName keys.
-    struct PSDictEntry {
-        PSName key;
-        PSObject value;
-
-        bool isEmpty() const noexcept {
-            return !key.isValid();
-        }
-    };
-
+    //
+    // Open addressing with linear probing, over a power of two number of 
+    // slots.  The slot for a key comes from Fibonacci hashing of the hash 
+    // the name was given when it was interned, so there is no division, 
+    // and no hashing of characters.  Deleting shifts the entries that 
+    // follow back into the hole, so there are no tombstones, and probe 
+    // sequences never get longer than they need to be.
+    //
+    // Keys and values are kept in separate arrays.  A probe only walks the
+    // keys, which are just pointers, so a whole run of them fits in a cache
+    // line or two, and the value is only touched once the key is found.
+    // --------------------
     class PSDictionary {
         PSDictionary() = delete;
 
     public:
-        // Create entries, with a minimum initial capacity
+        // Create a dictionary with room for at least 'initialCapacity' 
+        // entries before it needs to grow
         PSDictionary(size_t initialCapacity)
-            : fCapacity(std::max(size_t(4), initialCapacity))
-            , fCount(0)
         {
-            fEntries = new PSDictEntry[fCapacity](); // zero-initialized
+            size_t slots = kMinSlots;
+            while (slots * kMaxLoadNum < initialCapacity * kMaxLoadDen)
+                slots *= 2;
+
+            allocate(slots);
         }
 
         ~PSDictionary() {
-            delete[] fEntries;
+            delete[] fKeys;
+            delete[] fValues;
         }
 
+        PSDictionary(const PSDictionary&) = delete;
+        PSDictionary& operator=(const PSDictionary&) = delete;
+
         static std::shared_ptr<PSDictionary> create(size_t initialSize = 32) {
             auto ptr = std::shared_ptr<PSDictionary>(new PSDictionary(initialSize));
 
@@ -41,26 +54,47 @@ namespace waavs {
         constexpr size_t size() const noexcept { return fCount; }
         constexpr bool empty() const noexcept { return fCount == 0; }   
 
+        // Binding generation
+        // Lookups through a dictionary stack are cached, and each cached
+        // lookup is only good for the generation it was made in.  A 
+        // dictionary that is on a stack bumps the generation whenever 
+        // the set of keys it holds changes, or its entries move.  Replacing 
+        // the value of a key that is already there does not bump it, as the 
+        // value is updated in place, where the cache can see it.
+        static uint64_t bindingGeneration() noexcept { return sBindingGeneration; }
+        static void bumpBindingGeneration() noexcept { ++sBindingGeneration; }
+
+        // Kept up to date by PSDictionaryStack
+        void enterStack() noexcept { ++fStackRefs; }
+        void leaveStack() noexcept { if (fStackRefs > 0) --fStackRefs; }
+        bool isOnStack() const noexcept { return fStackRefs > 0; }
+
         // put
         // Place the value into the table 
         // Perform an update if the key already exists,
         // otherwise insert a new entry.
         bool put(PSName key, const PSObject& value) noexcept 
         {
-            if (loadFactor() > 0.75)
-                grow();
+            if (!key.isValid())
+                return false;
 
             size_t slot;
-            if (!findSlotForUpsertIn(fEntries, fCapacity, key, slot))
-            {
-                return false;
+            if (findKey(key, slot)) {
+                fValues[slot] = value;
+                return true;
             }
 
-            if (fEntries[slot].isEmpty()) {
-                fCount++;
+            // A new key, make sure there is room for it first
+            if ((fCount + 1) * kMaxLoadDen > fCapacity * kMaxLoadNum) {
+                if (!grow())
+                    return false;
+                slot = emptySlotFor(key);
             }
-            fEntries[slot].key = key;
-            fEntries[slot].value = value;
+
+            fKeys[slot] = key;
+            fValues[slot] = value;
+            fCount++;
+            keysChanged();
 
             return true;
         }
@@ -75,25 +109,61 @@ namespace waavs {
             if (!findKey(key, slot))
                 return false;
 
-            outValue = fEntries[slot].value;
+            outValue = fValues[slot];
             
             return true;
         }
 
+        // find
+        // Where the value for the key lives, or nullptr if the key is
+        // not present.  The pointer stays good until the keys change.
+        const PSObject* find(PSName key) const noexcept
+        {
+            size_t slot;
+
+            if (!findKey(key, slot))
+                return nullptr;
+
+            return &fValues[slot];
+        }
+
         // remove
         // Remove the entry for the key, if it exists.
-        // Creates empty slot, and reduces the count.
+        // The entries after it in the same run are shifted back, so
+        // every key can still be reached from its home slot.
         bool remove(PSName key) noexcept
         {
-            size_t slot;
-            if (!findKey(key, slot))
+            size_t hole;
+            if (!findKey(key, hole))
                 return false;
 
-            // clear the slot
-            fEntries[slot].key = PSName();
-            fEntries[slot].value.reset();
+            size_t mask = fCapacity - 1;
+            size_t next = hole;
+
+            while (true) {
+                next = (next + 1) & mask;
+                if (!fKeys[next].isValid())
+                    break;
+
+                // An entry can only move back into the hole if its home
+                // slot is not between the hole and where it is now
+                size_t home = homeSlot(fKeys[next]);
+                bool stays = (hole <= next) 
+                    ? (hole < home && home <= next) 
+                    : (hole < home || home <= next);
+                if (stays)
+                    continue;
+
+                fKeys[hole] = fKeys[next];
+                fValues[hole] = std::move(fValues[next]);
+                hole = next;
+            }
+
+            fKeys[hole] = PSName();
+            fValues[hole].reset();
 
             fCount--;  // adjust count
+            keysChanged();
             return true;
         }
 
@@ -109,10 +179,6 @@ namespace waavs {
             return true;
         }
 
-        // Find the slot of the key.
-        // return true if it's found, and slot == the slot
-        // return false if it's not found, and slot indicates
-        // where it could be placed.
         bool contains(const PSName key) const noexcept
         {
             size_t slot;
@@ -123,10 +189,11 @@ namespace waavs {
         void clear() noexcept
         {
             for (size_t i = 0; i < fCapacity; ++i) {
-                fEntries[i].key = PSName();       // invalidate key
-                fEntries[i].value.reset();        // drop shared_ptrs, destroy objects
+                fKeys[i] = PSName();        // invalidate key
+                fValues[i].reset();         // drop references, destroy objects
             }
             fCount = 0;
+            keysChanged();
         }
 
         // Support for iterating over the entries
@@ -137,8 +204,8 @@ namespace waavs {
         void forEach(Fn&& fn) noexcept 
         {
             for (size_t i = 0; i < fCapacity; ++i) {
-                if (!fEntries[i].isEmpty()) {
-                    if (!fn(fEntries[i].key, fEntries[i].value)) break;
+                if (fKeys[i].isValid()) {
+                    if (!fn(fKeys[i], fValues[i])) break;
                 }
             }
         }
@@ -147,94 +214,139 @@ namespace waavs {
         template <typename Fn>
         void forEachConst(Fn&& fn) const noexcept {
             for (size_t i = 0; i < fCapacity; ++i) {
-                if (!fEntries[i].isEmpty()) {
-                    if (!fn(fEntries[i].key, fEntries[i].value)) break;
+                if (fKeys[i].isValid()) {
+                    if (!fn(fKeys[i], static_cast<const PSObject&>(fValues[i]))) break;
                 }
             }
         }
 
+        // Iteration that can be picked up again later, for walks that 
+        // do not happen within a single call, such as 'forall' running 
+        // from the exec stack.  Finds the first entry at or after 'cursor', 
+        // and leaves the cursor just past it.  Returns false when there 
+        // are no more entries.
+        bool nextEntry(size_t& cursor, PSName& key, PSObject& value) const noexcept
+        {
+            while (cursor < fCapacity) {
+                size_t i = cursor++;
+                if (fKeys[i].isValid()) {
+                    key = fKeys[i];
+                    value = fValues[i];
+                    return true;
+                }
+            }
+            return false;
+        }
+
 
     private:
-        PSDictEntry* fEntries = nullptr;
-        size_t fCapacity = 0;
+        static constexpr size_t kMinSlots = 8;
+
+        // Grow when more than 3/4 of the slots are in use
+        static constexpr size_t kMaxLoadNum = 3;
+        static constexpr size_t kMaxLoadDen = 4;
+
+        PSName* fKeys = nullptr;
+        PSObject* fValues = nullptr;
+        size_t fCapacity = 0;       // number of slots, a power of 2
+        uint32_t fShift = 64;       // 64 - log2(fCapacity)
         size_t fCount = 0;
+        uint32_t fStackRefs = 0;    // number of dictionary stack entries holding this dictionary
 
-        constexpr float loadFactor() const {
-            return static_cast<float>(fCount) / static_cast<float>(fCapacity);
+        static inline uint64_t sBindingGeneration = 1;
+
+        void keysChanged() noexcept {
+            if (isOnStack())
+                bumpBindingGeneration();
         }
 
-        bool grow() noexcept {
-            size_t newCapacity = fCapacity * 2;
+        void setCapacity(size_t slots) noexcept
+        {
+            fCapacity = slots;
 
-            PSDictEntry* newEntries = new (std::nothrow) PSDictEntry[newCapacity]();
-            if (!newEntries) {
+            fShift = 64;
+            for (size_t n = slots; n > 1; n >>= 1)
+                fShift--;
+        }
+
+        void allocate(size_t slots)
+        {
+            fKeys = new PSName[slots]();
+            fValues = new PSObject[slots]();
+            setCapacity(slots);
+        }
+
+        // Fibonacci hashing; multiply by 2^64 / golden ratio, and keep the 
+        // top bits, which depend on all of the bits of the hash
+        size_t homeSlot(const PSName& key) const noexcept {
+            return static_cast<size_t>((key.hash() * 11400714819323198485ull) >> fShift);
+        }
+
+        bool grow() noexcept {
+            PSName* oldKeys = fKeys;
+            PSObject* oldValues = fValues;
+            size_t oldCapacity = fCapacity;
+
+            PSName* newKeys = new (std::nothrow) PSName[oldCapacity * 2]();
+            PSObject* newValues = new (std::nothrow) PSObject[oldCapacity * 2]();
+            if (!newKeys || !newValues) {
+                delete[] newKeys;
+                delete[] newValues;
                 return false; // allocation failed
             }
 
-            size_t newCount = 0;
+            fKeys = newKeys;
+            fValues = newValues;
+            setCapacity(oldCapacity * 2);
 
-            for (size_t i = 0; i < fCapacity; ++i) {
-                if (!fEntries[i].isEmpty()) {
-                    size_t slot;
-                    bool ok = findSlotForUpsertIn(newEntries, newCapacity, fEntries[i].key, slot);
-                    if (!ok) {
-                        delete[] newEntries;
-                        return false; // rehash failed, should never happen if capacity doubled
-                    }
-                    newEntries[slot].key = fEntries[i].key;
-                    newEntries[slot].value = fEntries[i].value;
-                    newCount++;
+            for (size_t i = 0; i < oldCapacity; ++i) {
+                if (oldKeys[i].isValid()) {
+                    size_t slot = emptySlotFor(oldKeys[i]);
+                    fKeys[slot] = oldKeys[i];
+                    fValues[slot] = std::move(oldValues[i]);
                 }
             }
 
-            delete[] fEntries;
-            fEntries = newEntries;
-            fCapacity = newCapacity;
-            fCount = newCount;
+            delete[] oldKeys;
+            delete[] oldValues;
+
+            keysChanged();
 
             return true;
         }
 
 
         // returns true if the key exists, slot is where it is
+        // returns false if it does not, and slot is the empty slot
+        // where it would go.
         bool findKey(PSName key, size_t& slot) const noexcept {
-            size_t hash = reinterpret_cast<size_t>(key.c_str());
-            size_t index = hash % fCapacity;
-            size_t start = index;   // sentinel for wrapping around
+            size_t mask = fCapacity - 1;
+            size_t index = homeSlot(key);
 
-            while (true) {
-                if (fEntries[index].isEmpty()) {
-                    return false; // key cannot be present
-                }
-                if (fEntries[index].key == key) {
+            // The load is kept below 1, so there is always an empty 
+            // slot to stop at
+            while (fKeys[index].isValid()) {
+                if (fKeys[index] == key) {
                     slot = index;
                     return true;
                 }
-                index = (index + 1) % fCapacity;
-                if (index == start) {
-                    return false; // wrapped around, not found
-                }
+                index = (index + 1) & mask;
             }
+
+            slot = index;
+            return false;
         }
 
-        // returns an empty slot for a key to be inserted
-        // returns true if a slot was found (always true unless the table is truly full)
-        static bool findSlotForUpsertIn(PSDictEntry* entries, size_t cap, PSName key, size_t& slot) noexcept
-        {
-            size_t hash = reinterpret_cast<size_t>(key.c_str());
-            size_t index = hash % cap;
-            size_t start = index;
+        // The first empty slot in the probe sequence of a key that
+        // is known not to be in the table
+        size_t emptySlotFor(PSName key) const noexcept {
+            size_t mask = fCapacity - 1;
+            size_t index = homeSlot(key);
 
-            while (true) {
-                if (!entries[index].key.isValid() || entries[index].key == key) {
-                    slot = index;
-                    return true;
-                }
-                index = (index + 1) % cap;
-                if (index == start) {
-                    return false; // table full, should never happen if grow doubled
-                }
-            }
+            while (fKeys[index].isValid())
+                index = (index + 1) & mask;
+
+            return index;
         }
 
     };
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdio>
 #include <memory>
 #include <string>
 #include <cstdint>
+#include <vector>
 
 #include "mappedfile.h"
 #include "ocspan.h"
@@ -32,6 +35,47 @@ namespace waavs {
         virtual bool readBytes(uint8_t* out, size_t count)  { return false; }
         virtual bool flush() { return true; }
 
+        // Writing.  Only an output file, or an encode filter, takes data.
+        virtual bool isWritable() const { return false; }
+        virtual bool writeBytes(const uint8_t*, size_t) { return false; }
+        virtual bool writeByte(uint8_t value) { return writeBytes(&value, 1); }
+
+        // Read up to 'count' bytes, returning how many were read.
+        // Zero means there is no more data.
+        virtual size_t readSome(uint8_t* out, size_t count)
+        {
+            size_t n = 0;
+            while (n < count && readByte(out[n]))
+                ++n;
+            return n;
+        }
+
+        // For files that have a cursor over a window of their data.
+        // Make more data available after the cursor, keeping the bytes 
+        // from the cursor on, though they may move in memory.
+        // Returns false when there is no more data.
+        virtual bool refill() { return false; }
+
+        // Borrow the next run of bytes, up to 'maxCount' of them, without
+        // copying them.  They are good until the file is next read from.
+        // Empty when there is no more data, and always, for a file 
+        // without a cursor, which has to be read with readSome().
+        OctetCursor readChunk(size_t maxCount = SIZE_MAX)
+        {
+            if (!hasCursor())
+                return OctetCursor();
+
+            OctetCursor& cursor = getCursor();
+            if (cursor.empty() && !refill())
+                return OctetCursor();
+
+            size_t n = std::min(maxCount, cursor.size());
+            OctetCursor chunk(cursor.begin(), n);
+            cursor.advance(n);
+
+            return chunk;
+        }
+
         // Positioning
         virtual size_t position() const  { return 0; }
         virtual bool setPosition(size_t pos) {return false;}
@@ -40,6 +84,10 @@ namespace waavs {
         virtual bool isEOF() const { return true; } 
 
         virtual void finalize() {}
+
+        // closefile.  Nothing more is read from the file.  A filter reads 
+        // on to the end of its data, so its source is left after it.
+        virtual void close() { finalize(); }
     };
 
 
@@ -87,6 +135,16 @@ namespace waavs {
             return true;
         }
 
+        size_t readSome(uint8_t* out, size_t count) override {
+            count = std::min(count, fCursor.size());
+            if (count > 0) {
+                std::memcpy(out, fCursor.begin(), count);
+                fCursor.advance(count);
+            }
+
+            return count;
+        }
+
         // Positioning
         size_t position() const override
         {
@@ -110,12 +168,241 @@ namespace waavs {
 
         bool isEOF() const override { return fCursor.empty(); }
 
+        void close() override { fCursor = OctetCursor(fCursor.end(), 0); }
+
         static std::shared_ptr<PSMemoryFile> create(const OctetCursor &dataSrc)
         {
             return std::shared_ptr<PSMemoryFile>(new PSMemoryFile(dataSrc));
         }
     };
 
+    //====================================================
+    // Buffered File
+    //
+    // Gives a cursor to a file that does not have one of its own,
+    // such as a filter, or a pipe.  The data is pulled from the source 
+    // in blocks, into a window, and the cursor walks the window.  When 
+    // the cursor gets to the end, refill() moves what is left to the 
+    // front, and reads the next block after it.  So the scanner can 
+    // run over a source of any size, in bounded memory.  The window 
+    // only grows when a single token is bigger than it is.
+    //====================================================
+    class PSBufferedFile : public PSFile
+    {
+    public:
+        static constexpr size_t kDefaultBlockSize = 64 * 1024;
+
+    private:
+        std::shared_ptr<PSFile> fSource;
+        std::vector<uint8_t> fWindow;
+        size_t fBase = 0;           // position in the source of the start of the window
+        bool fSourceDone = false;
+
+        explicit PSBufferedFile(std::shared_ptr<PSFile> source, size_t blockSize)
+            : fSource(std::move(source))
+            , fWindow(blockSize ? blockSize : kDefaultBlockSize)
+        {
+            fCursor = OctetCursor(fWindow.data(), 0);
+        }
+
+    public:
+        static std::shared_ptr<PSBufferedFile> create(std::shared_ptr<PSFile> source, size_t blockSize = kDefaultBlockSize)
+        {
+            if (!source)
+                return {};
+            return std::shared_ptr<PSBufferedFile>(new PSBufferedFile(std::move(source), blockSize));
+        }
+
+        bool hasCursor() const override { return true; }
+        bool isValid() const override { return fSource && fSource->isValid(); }
+
+        // How big the window has become
+        size_t windowSize() const { return fWindow.size(); }
+
+        bool refill() override
+        {
+            if (fSourceDone)
+                return false;
+
+            // Keep what the cursor has not consumed, at the front
+            size_t offset = fCursor.begin() - fWindow.data();
+            size_t keep = fCursor.size();
+            if (offset > 0) {
+                std::memmove(fWindow.data(), fCursor.begin(), keep);
+                fBase += offset;
+            }
+
+            // A token that fills more than half the window, gets more room,
+            // so scanning it again after each refill stays linear
+            if (keep > fWindow.size() / 2)
+                fWindow.resize(fWindow.size() * 2);
+
+            size_t got = fSource->readSome(fWindow.data() + keep, fWindow.size() - keep);
+            if (got == 0)
+                fSourceDone = true;
+
+            fCursor = OctetCursor(fWindow.data(), keep + got);
+
+            return got > 0;
+        }
+
+        bool readByte(uint8_t& out) override {
+            if (fCursor.empty() && !refill())
+                return false;
+
+            out = *fCursor;
+            ++fCursor;
+
+            return true;
+        }
+
+        bool readBytes(uint8_t* out, size_t count) override {
+            return readSome(out, count) == count;
+        }
+
+        size_t readSome(uint8_t* out, size_t count) override {
+            size_t n = 0;
+            while (n < count) {
+                if (fCursor.empty() && !refill())
+                    break;
+
+                size_t chunk = std::min(count - n, fCursor.size());
+                std::memcpy(out + n, fCursor.begin(), chunk);
+                fCursor.advance(chunk);
+                n += chunk;
+            }
+
+            return n;
+        }
+
+        size_t position() const override
+        {
+            return fBase + (fCursor.begin() - fWindow.data());
+        }
+
+        void rewind() override
+        {
+            fSource->rewind();
+            fBase = 0;
+            fSourceDone = false;
+            fCursor = OctetCursor(fWindow.data(), 0);
+        }
+
+        bool isEOF() const override { return fCursor.empty() && (fSourceDone || fSource->isEOF()); }
+
+        void finalize() override { fSource->finalize(); }
+
+        void close() override
+        {
+            fSource->close();
+            fSourceDone = true;
+            fCursor = OctetCursor(fCursor.end(), 0);
+        }
+    };
+
+    //====================================================
+    // Output File
+    //
+    // A file that is written to; one opened with (w) access, or
+    // %stdout, %stderr.  What is written to a disk file is gathered into
+    // a buffer, and goes out in large blocks, when the buffer fills, on
+    // flushfile, or when the file is closed.  %stdout and %stderr are the
+    // streams print and = write to, so they are written straight through,
+    // and come out in the order they were written.
+    //====================================================
+    class PSOutputFile : public PSFile
+    {
+    public:
+        static constexpr size_t kBufferSize = 64 * 1024;
+
+    private:
+        FILE* fFile = nullptr;
+        bool fOwned = false;            // closed along with this, and buffered; not so for stdout
+        std::vector<uint8_t> fBuffer;
+        size_t fWritten = 0;
+
+        PSOutputFile(FILE* fp, bool owned)
+            : fFile(fp)
+            , fOwned(owned)
+        {
+            if (fOwned)
+                fBuffer.reserve(kBufferSize);
+        }
+
+        bool drain()
+        {
+            if (!fFile)
+                return false;
+
+            bool ok = fBuffer.empty() || std::fwrite(fBuffer.data(), 1, fBuffer.size(), fFile) == fBuffer.size();
+            fBuffer.clear();
+            return ok;
+        }
+
+    public:
+        ~PSOutputFile() { close(); }
+
+        static std::shared_ptr<PSOutputFile> create(const std::string& fname)
+        {
+            FILE* fp = std::fopen(fname.c_str(), "wb");
+            if (!fp)
+                return {};
+            return std::shared_ptr<PSOutputFile>(new PSOutputFile(fp, true));
+        }
+
+        static std::shared_ptr<PSOutputFile> createStdout() { return std::shared_ptr<PSOutputFile>(new PSOutputFile(stdout, false)); }
+        static std::shared_ptr<PSOutputFile> createStderr() { return std::shared_ptr<PSOutputFile>(new PSOutputFile(stderr, false)); }
+
+        bool isValid() const override { return fFile != nullptr; }
+        bool isWritable() const override { return fFile != nullptr; }
+
+        bool writeBytes(const uint8_t* data, size_t count) override
+        {
+            if (!fFile)
+                return false;
+
+            fWritten += count;
+
+            if (!fOwned)
+                return std::fwrite(data, 1, count, fFile) == count;
+
+            if (fBuffer.size() + count <= kBufferSize) {
+                fBuffer.insert(fBuffer.end(), data, data + count);
+                return true;
+            }
+
+            // Too big to gather; what is gathered goes first
+            if (!drain())
+                return false;
+
+            if (count >= kBufferSize)
+                return std::fwrite(data, 1, count, fFile) == count;
+
+            fBuffer.insert(fBuffer.end(), data, data + count);
+            return true;
+        }
+
+        bool flush() override
+        {
+            return drain() && std::fflush(fFile) == 0;
+        }
+
+        size_t position() const override { return fWritten; }
+        bool isEOF() const override { return false; }
+
+        void close() override
+        {
+            if (!fFile)
+                return;
+
+            flush();
+            if (fOwned)
+                std::fclose(fFile);
+            fFile = nullptr;
+        }
+    };
+
+
     //====================================================
     //
     //====================================================
@@ -138,6 +425,8 @@ namespace waavs {
         }
 
     public:
+        // An empty file is still a file, at its end
+        bool isValid() const override { return fMapped && fMapped->isValid(); }
 
         //==================================================
         // Factory constructor
@@ -149,28 +438,25 @@ namespace waavs {
             return std::shared_ptr<PSFile>(new PSDiskFile(std::move(mf)));
         }
 
-        static std::shared_ptr<PSFile> create(const std::string& fname, const std::string& amode)
+        // hints - how the file is going to be read, MAPPED_HINT_xxx
+        static std::shared_ptr<PSFile> create(const std::string& fname, const std::string& amode, uint32_t hints = MAPPED_HINT_NONE)
         {
-            uint32_t desiredAccess = GENERIC_READ;
-            uint32_t shareMode = FILE_SHARE_READ;
-            uint32_t disposition = OPEN_EXISTING;
-
             // Only allow read mode for now
             if (amode != "r")
                 return {};
 
-            std::shared_ptr<MappedFile> mf = MappedFile::create_shared(fname, desiredAccess, shareMode, disposition);
+            std::shared_ptr<MappedFile> mf = MappedFile::create_shared(fname, hints);
 
             return create(std::move(mf));
         }
 
 
-        static std::shared_ptr<PSFile> create(const PSString& filename, const PSString& access)
+        static std::shared_ptr<PSFile> create(const PSString& filename, const PSString& access, uint32_t hints = MAPPED_HINT_NONE)
         {
             std::string fname(reinterpret_cast<const char*>(filename.data()), filename.length());
             std::string amode(reinterpret_cast<const char*>(access.data()), access.length());
 
-            return create(fname, amode);
+            return create(fname, amode, hints);
         }
 
 
@@ -1,8 +1,8 @@
 #pragma once
 
-#include <map>
+#include <cstring>
 #include <memory>
-#include <string>
+#include <vector>
 
 #include "ocspan.h"
 
@@ -21,23 +21,114 @@
 namespace waavs {
 
     struct PSNameTable {
+    public:
+        // Every interned string is preceded by a header, in the same
+        // arena allocation.  Given the pointer to the characters, the 
+        // hash and length are right there, without another lookup.
+        //   [ header ][ chars... ][ '\0' ]
+        struct NameHeader {
+            uint64_t fHash;
+            uint32_t fLength;
+            uint32_t fReserved;
+        };
+
+        static const NameHeader* headerOf(const char* name) noexcept {
+            return reinterpret_cast<const NameHeader*>(name) - 1;
+        }
+
     private:
-        std::map<std::string, const char*> pool;
+        // Open addressing, linear probing.  The slot keeps a copy of the
+        // hash, so a probe only touches the arena when the hashes match.
+        struct Slot {
+            uint64_t fHash;
+            const char* fName;
+        };
+
+        static constexpr size_t kInitialSlots = 1024;           // power of 2
+        static constexpr size_t kArenaBlockSize = 64 * 1024;
+
+        std::vector<Slot> fSlots;
+        size_t fCount = 0;
+
+        // Bump arena the names live in.  Names are never freed, so 
+        // the pointers handed out stay good for the life of the process.
+        std::vector<std::unique_ptr<uint8_t[]>> fBlocks;
+        uint8_t* fArenaCursor = nullptr;
+        size_t fArenaRemaining = 0;
+
+        const char* store(const char* ptr, size_t len, uint64_t hash)
+        {
+            // keep every header 8 byte aligned
+            size_t need = (sizeof(NameHeader) + len + 1 + 7) & ~size_t(7);
+
+            if (need > fArenaRemaining) {
+                size_t blockSize = need > kArenaBlockSize ? need : kArenaBlockSize;
+                fBlocks.emplace_back(new uint8_t[blockSize]);
+                fArenaCursor = fBlocks.back().get();
+                fArenaRemaining = blockSize;
+            }
+
+            NameHeader* header = reinterpret_cast<NameHeader*>(fArenaCursor);
+            header->fHash = hash;
+            header->fLength = static_cast<uint32_t>(len);
+            header->fReserved = 0;
 
-        const char* intern(std::string_view sv) {
-            // Attempt to insert a new entry; try_emplace does nothing if key already exists
-            auto [it, inserted] = pool.try_emplace(std::string(sv), nullptr);
+            char* chars = reinterpret_cast<char*>(header + 1);
+            if (len > 0)
+                std::memcpy(chars, ptr, len);
+            chars[len] = 0;
 
-            if (inserted) {
-                // Assign the stable c_str() from the key (std::string stored in the map)
-                it->second = it->first.c_str();
+            fArenaCursor += need;
+            fArenaRemaining -= need;
+
+            return chars;
+        }
+
+        void grow()
+        {
+            std::vector<Slot> old(fSlots.size() * 2, Slot{ 0, nullptr });
+            old.swap(fSlots);
+
+            size_t mask = fSlots.size() - 1;
+            for (const Slot& slot : old) {
+                if (!slot.fName)
+                    continue;
+
+                size_t i = slot.fHash & mask;
+                while (fSlots[i].fName)
+                    i = (i + 1) & mask;
+                fSlots[i] = slot;
             }
+        }
 
-            return it->second;
+        const char* intern(const char* ptr, size_t len)
+        {
+            uint64_t hash = fnv1a_64(ptr, len);
+
+            // keep the load at no more than half
+            if ((fCount + 1) * 2 > fSlots.size())
+                grow();
+
+            size_t mask = fSlots.size() - 1;
+            size_t i = hash & mask;
+
+            while (fSlots[i].fName) {
+                const char* name = fSlots[i].fName;
+                if (fSlots[i].fHash == hash && headerOf(name)->fLength == len && std::memcmp(name, ptr, len) == 0)
+                    return name;
+
+                i = (i + 1) & mask;
+            }
+
+            const char* name = store(ptr, len, hash);
+            fSlots[i] = Slot{ hash, name };
+            fCount++;
+
+            return name;
         }
 
-        const char* intern(const OctetCursor& span) { return intern(std::string_view(reinterpret_cast<const char*>(span.data()), span.size())); }
-        const char* intern(const char* cstr) { return intern(std::string_view(cstr)); }
+        const char* intern(const OctetCursor& span) { return intern(reinterpret_cast<const char*>(span.data()), span.size()); }
+        const char* intern(const char* cstr) { return intern(cstr, std::strlen(cstr)); }
 
         static PSNameTable* getTable() {
             static std::unique_ptr<PSNameTable> gTable = std::make_unique<PSNameTable>();
@@ -45,13 +136,15 @@ namespace waavs {
         }
 
     public:
+        PSNameTable() : fSlots(kInitialSlots, Slot{ 0, nullptr }) {}
+
         // NOTE::
         // These should only be used by things inside pscore.h
         // there might ba couple of exceptions, like the cvn operator
         // but for the most part, sting interning should be an internal thing
         static const char* INTERN(const OctetCursor& span) { return getTable()->intern(span); }
         static const char* INTERN(const char* cstr) { return getTable()->intern(cstr ? cstr : ""); }
-        static const char* INTERN(const char* ptr, size_t len) { return getTable()->intern(OctetCursor(ptr, len)); }
+        static const char* INTERN(const char* ptr, size_t len) { return getTable()->intern(ptr, len); }
     };
 
     //----------------------
@@ -94,6 +187,10 @@ namespace waavs {
         // null terminated string for convenience
         const char* c_str() const noexcept {return fData;}
 
+        // Both computed once, when the name was interned
+        uint64_t hash() const noexcept { return fData ? PSNameTable::headerOf(fData)->fHash : 0; }
+        size_t length() const noexcept { return fData ? PSNameTable::headerOf(fData)->fLength : 0; }
+
         // a null value is invalid
         bool isValid() const noexcept 
         {
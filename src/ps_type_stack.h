@@ -61,7 +61,7 @@ namespace waavs
         {
             if (_data.empty())
                 return false;
-            out = _data.back();
+            out = std::move(_data.back());
             _data.pop_back();
             return true;
         }
@@ -94,13 +94,27 @@ namespace waavs
         bool copy(size_t n) {
             if (n > _data.size()) 
                 return false;
-            _data.insert(_data.end(), _data.end() - n, _data.end());
+            // Reserve first, then copy by index.  Inserting a range of the
+            // vector into itself is not allowed, and breaks as soon as a
+            // reallocation moves the source elements out from under us.
+            _data.reserve(_data.size() + n);
+            size_t start = _data.size() - n;
+            for (size_t i = 0; i < n; ++i)
+                _data.push_back(_data[start + i]);
             return true;
         }
 
 
         const T& top() const { return _data.back(); }
 
+        // Unchecked access, 0 is the top.  For callers that have 
+        // already checked the size of the stack.
+        T& fromTop(size_t n) { return _data[_data.size() - 1 - n]; }
+        const T& fromTop(size_t n) const { return _data[_data.size() - 1 - n]; }
+
+        // Discard the top 'n' entries, unchecked
+        void drop(size_t n) { _data.erase(_data.end() - n, _data.end()); }
+
         bool top(T& out) const {
             if (_data.empty()) return false;
             out = _data.back();
@@ -184,7 +198,7 @@ namespace waavs
         bool pushFile(const PSFileHandle value) { return push(PSObject::fromFile(value)); }
         bool pushFontFace(const PSFontFaceHandle value) { return push(PSObject::fromFontFace(value)); }
         bool pushFont(const PSFontHandle value) { return push(PSObject::fromFont(value)); }
-        bool pushOperator(PSOperator value) { return push(PSObject::fromOperator(value)); }
+        bool pushOperator(const PSOperator* value) { return push(PSObject::fromOperator(value)); }
         bool pushMark(const PSMark& value) { return push(PSObject::fromMark(value)); }
 
         // Return unboxed values
@@ -299,6 +313,127 @@ namespace waavs
         }
 	};
 
+
+    //=============================================================================
+    // PSExecFrame
+    // 
+    // An entry on the execution stack.  Rather than copying the body of a 
+    // procedure onto the stack, a frame holds on to the procedure, and the 
+    // index of the next element to execute.  Calling a procedure is then a 
+    // single push, no matter how long the procedure is.
+    //
+    // Loops get frames of their own.  A loop frame walks its body just 
+    // like a Proc frame, but when it reaches the end, it steps the loop 
+    // and starts over at the top of the body, rather than being popped.  
+    // The loop state lives in the frame, so 'exit' only has to unwind 
+    // to the nearest loop frame.
+    //=============================================================================
+    enum struct PSExecFrameKind : uint8_t {
+        Object,         // A single object waiting to be executed
+        Proc,           // Walking the body of an executable array
+        Stopped,        // The context established by 'stopped'
+        Repeat,         // 'repeat' loop, fCounter is the number of passes left
+        Loop,           // 'loop', runs until 'exit'
+        For,            // 'for' loop
+        ForAll,         // 'forall' over fContainer, fPosition is the next element
+    };
+
+    static inline bool isLoopFrameKind(PSExecFrameKind kind) noexcept
+    {
+        return kind >= PSExecFrameKind::Repeat;
+    }
+
+    struct PSExecFrame {
+        PSObject fObject;                   // The procedure, or the object to execute
+        const PSArray* fBody = nullptr;     // The procedure's array, kept alive by fObject
+        uint32_t fIndex = 0;                // Next element of fBody to execute
+        PSExecFrameKind fKind = PSExecFrameKind::Object;
+
+        // Loop state
+        bool fIntegers = false;             // for: the control variable is an integer
+        size_t fPosition = 0;               // forall: where the walk of fContainer is
+        int64_t fCounter = 0;               // repeat: passes left, for: integer control variable
+        int64_t fIncrement = 0;
+        double fRealCounter = 0;            // for: real control variable
+        double fRealIncrement = 0;
+        double fLimit = 0;
+        PSObject fContainer;                // forall: array, string, or dictionary
+    };
+
+    //=============================================================================
+    // PSExecStack
+    // 
+    // The execution stack of the VM.  The number of frames is bounded by a
+    // limit, which is what bounds recursion in PostScript programs, rather
+    // than the depth of the C++ stack.
+    //=============================================================================
+    struct PSExecStack : public PSStack<PSExecFrame>
+    {
+    private:
+        size_t fLimit = 100000;
+
+    public:
+        size_t limit() const noexcept { return fLimit; }
+        void setLimit(size_t limit) noexcept { fLimit = limit; }
+        bool isFull() const noexcept { return _data.size() >= fLimit; }
+
+        PSExecFrame& topFrame() { return _data.back(); }
+        void popFrame() { _data.pop_back(); }
+
+        bool pushObject(const PSObject& obj)
+        {
+            if (isFull())
+                return false;
+
+            _data.emplace_back();
+            PSExecFrame& frame = _data.back();
+            frame.fObject = obj;
+            frame.fKind = PSExecFrameKind::Object;
+            return true;
+        }
+
+        bool pushProc(const PSObject& proc, const PSArray* body)
+        {
+            if (isFull())
+                return false;
+
+            _data.emplace_back();
+            PSExecFrame& frame = _data.back();
+            frame.fObject = proc;
+            frame.fBody = body;
+            frame.fIndex = 0;
+            frame.fKind = PSExecFrameKind::Proc;
+            return true;
+        }
+
+        bool pushStopped()
+        {
+            if (isFull())
+                return false;
+
+            _data.emplace_back();
+            _data.back().fKind = PSExecFrameKind::Stopped;
+            return true;
+        }
+
+        // A loop frame, with its state left for the caller to fill in.
+        // The body index starts at the end, so the first thing run() does 
+        // is step the loop, which sets up the first pass.
+        PSExecFrame* pushLoop(PSExecFrameKind kind, const PSObject& proc, const PSArray* body)
+        {
+            if (isFull())
+                return nullptr;
+
+            _data.emplace_back();
+            PSExecFrame& frame = _data.back();
+            frame.fObject = proc;
+            frame.fBody = body;
+            frame.fIndex = static_cast<uint32_t>(body->size());
+            frame.fKind = kind;
+            return &frame;
+        }
+    };
+
     /*
     struct PSExecutionStack : public PSStack<PSObject>
     {
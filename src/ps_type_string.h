@@ -1,128 +1,216 @@
 #pragma once
 
 #include "definitions.h"
+#include "ps_type_box.h"
 
 #include <memory>
+#include <new>
 #include <string>
 #include <vector>
 
 namespace waavs {
+    // --------------------
+    // PSStringBody
+    //
+    //     The bytes of a string, reference counted, and shared by
+    //     every PSString that is a view onto them.  The bytes follow
+    //     the header in the same allocation.
+    // --------------------
+    struct PSStringBody : public PSHeapBox {
+    private:
+        uint32_t fCapacity{ 0 };
+
+        explicit PSStringBody(uint32_t cap) noexcept : fCapacity(cap) {}
+
+    public:
+        uint32_t capacity() const noexcept { return fCapacity; }
+        uint8_t* data() noexcept { return reinterpret_cast<uint8_t*>(this + 1); }
+        const uint8_t* data() const noexcept { return reinterpret_cast<const uint8_t*>(this + 1); }
+
+        // Create a body of 'cap' bytes, all zero, unless the caller
+        // is about to write every one of them anyway
+        static PSStringBody* create(size_t cap, bool zeroFill = true)
+        {
+            void* mem = ::operator new(sizeof(PSStringBody) + cap);
+            PSStringBody* body = new (mem) PSStringBody(static_cast<uint32_t>(cap));
+            if (zeroFill)
+                std::memset(body->data(), 0, cap);
+            return body;
+        }
+
+        // Matches the allocation done in create()
+        static void operator delete(void* p) noexcept { ::operator delete(p); }
+    };
+
     // --------------------
     // PSString
-    // 
+    //
     //     Core type representing a string, with a PS interface
-    //     This is NOT null terminated.  the length tells you 
-    //     the size of the string.  The capacity tells you the size
-    //     of the allocated buffer.
+    //     This is NOT null terminated.  the length tells you
+    //     the size of the string.
+    //
+    //     A PSString is a view (offset, length) onto a shared body.
+    //     Copying a PSString does not copy the bytes, it makes another
+    //     view of the same bytes, which is what PostScript requires.
+    //     'getinterval' returns a view, and a 'put' through any one view
+    //     is visible through all the others.
     // --------------------
     struct PSString {
     private:
-        std::unique_ptr<uint8_t[]> fData;
+        PSStringBody* fBody{ nullptr };
+        uint32_t fOffset{ 0 };
         uint32_t fLength{ 0 };
-        uint32_t fCapacity{ 0 };
+
+        void retain() const noexcept { if (fBody) fBody->retain(); }
+        void release() noexcept { if (fBody) fBody->release(); fBody = nullptr; }
 
     public:
         PSString() = default;
 
-        explicit PSString(size_t cap)
-            : fData(new uint8_t[cap+1]())
-            , fLength(0)
-            , fCapacity(static_cast<uint32_t>(cap+1)) 
+        // A string of 'len' bytes, all zero
+        explicit PSString(size_t len)
+            : fBody(PSStringBody::create(len))
+            , fOffset(0)
+            , fLength(static_cast<uint32_t>(len))
         {
         }
 
         PSString(const uint8_t* src, size_t len)
-            : fData(new uint8_t[len+1])
-            , fLength(static_cast<uint32_t>(len))
-            , fCapacity(static_cast<uint32_t>(len)) {
-            std::memcpy(fData.get(), src, len);
+            : PSString(len)
+        {
+            if (len > 0)
+                std::memcpy(fBody->data(), src, len);
         }
 
-        PSString(const char* cstr) {
-            if (cstr) {
-                size_t len = std::strlen(cstr);
-                fData = std::unique_ptr<uint8_t[]>(new uint8_t[len+1]);
-                std::memcpy(fData.get(), cstr, len);
-                fLength = fCapacity = static_cast<uint32_t>(len);
-            }
+        PSString(const char* cstr)
+            : PSString(reinterpret_cast<const uint8_t*>(cstr), cstr ? std::strlen(cstr) : 0)
+        {
+        }
+
+        // A view onto an existing body; the body gains a reference
+        PSString(PSStringBody* body, uint32_t offset, uint32_t len) noexcept
+            : fBody(body)
+            , fOffset(offset)
+            , fLength(len)
+        {
+            retain();
         }
 
-        // Copy constructor
-        PSString(const PSString& other)
-            : fData(new uint8_t[other.fCapacity+1])
+        // Copy constructor, shares the body
+        PSString(const PSString& other) noexcept
+            : fBody(other.fBody)
+            , fOffset(other.fOffset)
             , fLength(other.fLength)
-            , fCapacity(other.fCapacity) 
         {
-            std::memcpy(fData.get(), other.fData.get(), fLength);
+            retain();
         }
 
-        // Copy assignment
-        PSString& operator=(const PSString& other) {
+        // Copy assignment, shares the body
+        PSString& operator=(const PSString& other) noexcept {
             if (this != &other) {
-                fData.reset(new uint8_t[other.fCapacity+1]);
+                other.retain();
+                release();
+                fBody = other.fBody;
+                fOffset = other.fOffset;
                 fLength = other.fLength;
-                fCapacity = other.fCapacity;
-                std::memcpy(fData.get(), other.fData.get(), fLength);
             }
             return *this;
         }
 
         // Move constructor
-        PSString(PSString&&) noexcept = default;
+        PSString(PSString&& other) noexcept
+            : fBody(other.fBody)
+            , fOffset(other.fOffset)
+            , fLength(other.fLength)
+        {
+            other.fBody = nullptr;
+            other.fOffset = other.fLength = 0;
+        }
 
         // Move assignment
-        PSString& operator=(PSString&&) noexcept = default;
+        PSString& operator=(PSString&& other) noexcept {
+            if (this != &other) {
+                release();
+                fBody = other.fBody;
+                fOffset = other.fOffset;
+                fLength = other.fLength;
+                other.fBody = nullptr;
+                other.fOffset = other.fLength = 0;
+            }
+            return *this;
+        }
+
+        ~PSString() noexcept { release(); }
 
         // Public interface
         size_t length() const noexcept { return fLength; }
-        size_t capacity() const noexcept { return fCapacity; }
-        uint8_t* data() noexcept { return fData.get(); }
-        const uint8_t* data() const noexcept { return fData.get(); }
+        bool empty() const noexcept { return fLength == 0; }
+
+        // A view has no room beyond its length
+        size_t capacity() const noexcept { return fLength; }
+
+        uint8_t* data() noexcept { return fBody ? fBody->data() + fOffset : nullptr; }
+        const uint8_t* data() const noexcept { return fBody ? fBody->data() + fOffset : nullptr; }
+
+        // Access to the shared representation, used by PSObject
+        PSStringBody* body() const noexcept { return fBody; }
+        uint32_t offset() const noexcept { return fOffset; }
+
+        // Is this a view onto the same bytes as 'other'
+        bool sharesBodyWith(const PSString& other) const noexcept { return fBody != nullptr && fBody == other.fBody; }
 
         void reset() noexcept { fLength = 0; }
 
+        // Shrink the view, it can never grow past its current length
         void setLength(uint32_t len) noexcept {
-            fLength = (len <= fCapacity) ? len : fCapacity;
+            if (len < fLength)
+                fLength = len;
         }
 
         std::string toString() const {
-            return std::string(reinterpret_cast<const char*>(fData.get()), fLength);
+            return fLength ? std::string(reinterpret_cast<const char*>(data()), fLength) : std::string();
         }
 
         uint8_t get(uint32_t i) const noexcept {
-            return (i < fLength) ? fData[i] : 0;
+            return (i < fLength) ? data()[i] : 0;
         }
 
         bool get(uint32_t i, uint8_t& out) const noexcept {
             if (i >= fLength) return false;
-            out = fData[i];
+            out = data()[i];
             return true;
         }
 
-        bool put(uint32_t i, uint8_t value) {
-            if (i >= fCapacity) return false;
-            fData[i] = value;
-            if (i >= fLength) fLength = i + 1;
+        // Writes go to the shared body, so every view sees them
+        bool put(uint32_t i, uint8_t value) noexcept {
+            if (i >= fLength) return false;
+            data()[i] = value;
             return true;
         }
 
-        PSString getInterval(uint32_t offset, uint32_t count) const {
+        // A view of part of this string, no bytes are copied
+        PSString getInterval(uint32_t offset, uint32_t count) const noexcept {
             if (offset >= fLength) return PSString();
             if (count > fLength - offset) count = fLength - offset;
-            return PSString(fData.get() + offset, count);
+            return PSString(fBody, fOffset + offset, count);
         }
 
-        bool putInterval(uint32_t offset, const PSString& src) {
-            if (offset >= fCapacity) return false;
+        bool putInterval(uint32_t offset, const PSString& src) noexcept {
+            if (offset > fLength) return false;
             uint32_t count = src.fLength;
-            if (offset + count > fCapacity) count = fCapacity - offset;
-            std::memcpy(fData.get() + offset, src.fData.get(), count);
-            if (offset + count > fLength) fLength = offset + count;
+            if (offset + count > fLength) count = fLength - offset;
+            if (count > 0)
+                std::memmove(data() + offset, src.data(), count);   // the two may overlap
             return true;
         }
 
-        // Search 
-        // Adds to PSString class
+        // Make a string with its own copy of the bytes
+        PSString clone() const {
+            return PSString(data(), fLength);
+        }
+
+        // Search
+        // pre, match, and post are all views onto this string
         inline bool search(const PSString& target, PSString& pre, PSString& match, PSString& post) const {
             if (target.length() == 0 || this->length() < target.length())
                 return false;
@@ -133,10 +221,10 @@ namespace waavs {
             size_t needleLen = target.length();
 
             for (size_t i = 0; i <= haystackLen - needleLen; ++i) {
-                if (std::memcmp(haystack + i, needle, needleLen) == 0) {
+                if (haystack[i] == needle[0] && std::memcmp(haystack + i, needle, needleLen) == 0) {
                     pre = this->getInterval(0, static_cast<uint32_t>(i));
-                    match = target;
-                    post = this->getInterval(static_cast<uint32_t>(i + needleLen), this->length() - (i + needleLen));
+                    match = this->getInterval(static_cast<uint32_t>(i), static_cast<uint32_t>(needleLen));
+                    post = this->getInterval(static_cast<uint32_t>(i + needleLen), static_cast<uint32_t>(haystackLen - (i + needleLen)));
                     return true;
                 }
             }
@@ -157,5 +245,29 @@ namespace waavs {
         static PSString fromCString(const char* s) {
             return s ? PSString(s) : PSString();
         }
+
+        // Build a string by decoding straight into its own storage.
+        // 'maxLen' is an upper bound on the decoded length, and the
+        // decoder, bool(uint8_t* dst, size_t& len), writes the bytes
+        // and says how many there are.  One allocation, no copy.
+        template <typename Decoder>
+        static bool fromDecoder(size_t maxLen, Decoder&& decoder, PSString& out)
+        {
+            if (maxLen == 0) {
+                out = PSString();
+                return true;
+            }
+
+            PSStringBody* body = PSStringBody::create(maxLen, false);
+            size_t len = 0;
+            bool ok = decoder(body->data(), len);
+            if (ok)
+                out = PSString(body, 0, static_cast<uint32_t>(len < maxLen ? len : maxLen));
+            body->release();    // 'out' holds the only reference now
+
+            return ok;
+        }
     };
-}
\ No newline at end of file
+
+    ASSERT_STRUCT_SIZE(PSString, 16);
+}
@@ -7,13 +7,16 @@
 #include <string_view>
 #include <unordered_map>
 #include <iostream>
+#include <iterator>
 
 #include <vector>
 #include <functional>
 #include <memory>
-#include <variant>
+#include <type_traits>
 
+#include "definitions.h"
 #include "ocspan.h"
+#include "ps_type_box.h"
 #include "ps_type_name.h"
 #include "ps_type_string.h"
 #include "ps_type_matrix.h"
@@ -51,7 +54,7 @@ namespace waavs {
 namespace std {
     template<> struct hash<waavs::PSName> {
         size_t operator()(const waavs::PSName& name) const noexcept {
-            return std::hash<const char*>()(name.c_str());
+            return static_cast<size_t>(name.hash());
         }
     };
 }
@@ -71,6 +74,10 @@ namespace waavs
             : fName(PSNameTable::INTERN(name)) {
         }
 
+        PSMark(const PSName& name) noexcept
+            : fName(name) {
+        }
+
         const PSName& name() const noexcept {
             return fName;
         }
@@ -82,23 +89,100 @@ namespace waavs
     // --------------------
     // These definitions are used for builtin operators that are known at compile time
     using PSOperatorFunc = bool(*)(PSVirtualMachine&);
-    using PSOperatorFuncMap = std::unordered_map<PSName, PSOperatorFunc>;
+
+    // --------------------
+    // PSOpcode
+    //
+    // Every interned operator gets a small, dense opcode, which a PSObject 
+    // carries along with the pointer to the operator.  The hottest operators 
+    // have fixed opcodes, known at compile time, so the VM can dispatch them 
+    // with a switch, and run them inline.  All the others are numbered as 
+    // they are interned, starting at FirstDynamic.
+    // --------------------
+    enum struct PSOpcode : uint16_t {
+        None = 0,       // Not an operator, or no fixed opcode asked for
+        Add,
+        Mul,
+        Exch,
+        Dup,
+        Index,
+        Roll,
+        MoveTo,
+        LineTo,
+        FirstDynamic
+    };
+
+    // --------------------
+    // PSOperandSignature
+    //
+    // The operands an operator takes, one character each, written bottom 
+    // to top, the way PLRM lists them.  The characters are the PSObjectType 
+    // codes (see PSObject::typeChar()), and a few classes of type:
+    //   '*'  anything
+    //   'N'  a number, integer or real
+    //   'i'  an integer, or a real with an integral value
+    //   'P'  a procedure (executable array)
+    // So "NN" is two numbers, "aN" an array then a number.
+    // The VM checks the operands against the signature before the operator 
+    // runs, so the operator can use them right where they are on the stack.
+    // An operator with an empty signature checks its own operands.
+    // --------------------
+    struct PSOperandSignature {
+        static constexpr size_t kMaxOperands = 7;
+
+        uint8_t fArity = 0;
+        char fKinds[kMaxOperands] = {};
+
+        PSOperandSignature() = default;
+
+        explicit PSOperandSignature(const char* sig) noexcept {
+            while (sig && *sig && fArity < kMaxOperands)
+                fKinds[fArity++] = *sig++;
+        }
+
+        size_t arity() const noexcept { return fArity; }
+        char kind(size_t i) const noexcept { return fKinds[i]; }
+    };
+
+    // An entry of an operator table.  Most entries are just a function.
+    // Some also give their operand signature, and the ones that the VM 
+    // runs inline also name their fixed opcode.
+    struct PSOperatorDef {
+        PSOperatorFunc fFunc = nullptr;
+        const char* fOperands = nullptr;
+        PSOpcode fOpcode = PSOpcode::None;
+
+        PSOperatorDef(PSOperatorFunc f, const char* operands = nullptr, PSOpcode code = PSOpcode::None) noexcept
+            : fFunc(f)
+            , fOperands(operands)
+            , fOpcode(code) {
+        }
+    };
+
+    using PSOperatorFuncMap = std::unordered_map<PSName, PSOperatorDef>;
 
     struct PSOperator 
     {
     private:
         PSName fName;       // Always interned and stable
         PSOperatorFunc fFunc = nullptr;
+        uint16_t fOpcode = 0;
+        PSOperandSignature fOperands;
 
     public:
         PSOperator() = default;
 
-        constexpr PSOperator(const PSName& opName, PSOperatorFunc f) noexcept
+        PSOperator(const PSName& opName, PSOperatorFunc f, uint16_t opcode = 0, const char* operands = nullptr) noexcept
             : fName(opName)
-            , fFunc(f) {
+            , fFunc(f)
+            , fOpcode(opcode)
+            , fOperands(operands) {
         }
 
         const PSName & name() const noexcept { return fName; }
+        PSOperatorFunc func() const noexcept { return fFunc; }
+        uint16_t opcode() const noexcept { return fOpcode; }
+        const PSOperandSignature& operands() const noexcept { return fOperands; }
 
         bool exec(PSVirtualMachine& vm) const
         {
@@ -111,6 +195,42 @@ namespace waavs
         constexpr bool isValid() const noexcept { return fFunc != nullptr;}
 
     };
+
+    // --------------------
+    // PSOperatorTable
+    //
+    // Operator records are interned, so a PSObject only needs to carry
+    // a pointer to one.  Records are never freed, which keeps those pointers
+    // valid for as long as the process lives, no matter how many 
+    // virtual machines come and go.
+    // --------------------
+    struct PSOperatorTable {
+    private:
+        std::unordered_multimap<const char*, std::unique_ptr<PSOperator>> fOps;
+        uint16_t fNextOpcode = static_cast<uint16_t>(PSOpcode::FirstDynamic);
+
+        const PSOperator* intern(const PSName& name, PSOperatorFunc func, PSOpcode fixed, const char* operands)
+        {
+            auto range = fOps.equal_range(name.c_str());
+            for (auto it = range.first; it != range.second; ++it) {
+                if (it->second->func() == func)
+                    return it->second.get();
+            }
+
+            uint16_t opcode = (fixed != PSOpcode::None) ? static_cast<uint16_t>(fixed) : fNextOpcode++;
+
+            auto it = fOps.emplace(name.c_str(), std::make_unique<PSOperator>(name, func, opcode, operands));
+            return it->second.get();
+        }
+
+        static PSOperatorTable* getTable() {
+            static std::unique_ptr<PSOperatorTable> gTable = std::make_unique<PSOperatorTable>();
+            return gTable.get();
+        }
+
+    public:
+        static const PSOperator* INTERN(const PSName& name, PSOperatorFunc func, PSOpcode fixed = PSOpcode::None, const char* operands = nullptr) { return getTable()->intern(name, func, fixed, operands); }
+    };
 }
 
 namespace waavs {
@@ -153,39 +273,154 @@ namespace waavs {
         // Future bits here (like `CONST`, `PROTECTED`, `FROM_ROM`, etc.)
     };
 
+    // --------------------
+    // PSObject
+    //
+    // A compact, 16 byte tagged value.
+    //   byte 0     type tag
+    //   byte 1     flags
+    //   bytes 2-7  auxiliary; a string keeps its view offset (16 bits)
+    //              and length (32 bits) here, or boxes a view that
+    //              starts further in than 16 bits reach
+    //   bytes 8-15 payload; an int, real, bool, interned name, 
+    //              operator pointer, or a pointer to a PSHeapBox
+    //
+    // Keeping the object this small means four of them fit in a cache line, 
+    // which is what the operand stack, execution stack, and array elements
+    // are made of.
+    // --------------------
     struct PSObject {
+    public:
+        PSObjectType type = PSObjectType::Null;
+
     private:
-        using Variant = std::variant<
-            std::monostate,                     // INVALID
-            int32_t,                            // Int
-            float,                              // Float (single precision)
-            double,                             // Real (double precision)
-            bool,                               // Bool
-            void*,                              // Pointer
-            PSName,                             // Name (interned)
-            PSOperator,                         // Operator
-            PSMatrix,                           // Matrix
-            PSPath,                             // Path
-            PSString,                           // String
-            PSArrayHandle,                      // Array
-            PSDictionaryHandle,                 // Dictionary
-            PSFileHandle,                       // File
-            PSFontFaceHandle,                   // FontFace
-            PSFontHandle,                       // Font
-            PSMark                              // Mark
-        >;
-
-        uint32_t fFlags{ PS_OBJ_FLAG_NONE };
-        Variant fValue;
+        uint8_t fFlags{ PS_OBJ_FLAG_NONE };
+        uint16_t fAux16{ 0 };
+        uint32_t fAux32{ 0 };
+
+        union {
+            int32_t fInt;
+            double fReal;
+            bool fBool;
+            void* fPointer;
+            PSName fName;                   // Name, and the name of a Mark
+            const PSOperator* fOperator;    // Interned, never freed
+            PSHeapBox* fBox;                // Everything else
+            uint64_t fBits;
+        };
+
+        static constexpr bool isBoxedType(PSObjectType t) noexcept
+        {
+            switch (t) {
+            case PSObjectType::String:
+            case PSObjectType::Array:
+            case PSObjectType::Dictionary:
+            case PSObjectType::File:
+            case PSObjectType::Font:
+            case PSObjectType::FontFace:
+            case PSObjectType::Matrix:
+            case PSObjectType::Path:
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        // An empty string has no body, so check the pointer as well
+        bool isBoxed() const noexcept { return isBoxedType(type) && fBox != nullptr; }
+
+        template <typename T>
+        const T& boxValue() const noexcept { return static_cast<PSBox<T>*>(fBox)->value; }
+
+        template <typename T>
+        T& boxValue() noexcept { return static_cast<PSBox<T>*>(fBox)->value; }
+
+        // What a reference accessor hands back when the object is not
+        // of the requested type, rather than dereferencing a bogus box.
+        template <typename T>
+        static T& emptyValue() noexcept { static T sEmpty{}; sEmpty = T{}; return sEmpty; }
+
+        template <typename T>
+        bool resetFromBox(PSObjectType t, T&& v) {
+            reset();
+            type = t;
+            fBox = new PSBox<std::decay_t<T>>(std::forward<T>(v));
+            return true;
+        }
 
     public:
-        PSObjectType type = PSObjectType::Null;
+        PSObject() noexcept : fBits(0) {}
+
+        PSObject(const PSObject& other) noexcept
+            : type(other.type)
+            , fFlags(other.fFlags)
+            , fAux16(other.fAux16)
+            , fAux32(other.fAux32)
+            , fBits(other.fBits)
+        {
+            if (isBoxed())
+                fBox->retain();
+        }
 
+        PSObject(PSObject&& other) noexcept
+            : type(other.type)
+            , fFlags(other.fFlags)
+            , fAux16(other.fAux16)
+            , fAux32(other.fAux32)
+            , fBits(other.fBits)
+        {
+            other.type = PSObjectType::Null;
+            other.fBits = 0;
+        }
 
+        PSObject& operator=(const PSObject& other) noexcept
+        {
+            if (other.isBoxed())
+                other.fBox->retain();
+            if (isBoxed())
+                fBox->release();
+
+            type = other.type;
+            fFlags = other.fFlags;
+            fAux16 = other.fAux16;
+            fAux32 = other.fAux32;
+            fBits = other.fBits;
+
+            return *this;
+        }
+
+        PSObject& operator=(PSObject&& other) noexcept
+        {
+            if (this != &other) {
+                if (isBoxed())
+                    fBox->release();
+
+                type = other.type;
+                fFlags = other.fFlags;
+                fAux16 = other.fAux16;
+                fAux32 = other.fAux32;
+                fBits = other.fBits;
+
+                other.type = PSObjectType::Null;
+                other.fBits = 0;
+            }
+            return *this;
+        }
+
+        ~PSObject() noexcept
+        {
+            if (isBoxed())
+                fBox->release();
+        }
 
         // Reset state
         bool reset() {
-            fValue = std::monostate{};
+            if (isBoxed())
+                fBox->release();
+
+            fBits = 0;
+            fAux16 = 0;
+            fAux32 = 0;
             type = PSObjectType::Null;
             fFlags = PS_OBJ_FLAG_NONE;
             setAccessReadable(true);
@@ -197,59 +432,60 @@ namespace waavs {
 
 
         bool resetFromInt(int32_t v) {
-            reset(); type = PSObjectType::Int; fValue = v; return true;
+            reset(); type = PSObjectType::Int; fInt = v; return true;
         }
         
         bool resetFromReal(double v) {
-            reset(); type = PSObjectType::Real; fValue = v; return true;
+            reset(); type = PSObjectType::Real; fReal = v; return true;
         }
         
         bool resetFromBool(bool v) {
-            reset(); type = PSObjectType::Bool; fValue = v; return true;
+            reset(); type = PSObjectType::Bool; fBool = v; return true;
         }
 
         bool resetFromName(const PSName& n) {
-            reset(); type = PSObjectType::Name; fValue = n; return true;
+            reset(); type = PSObjectType::Name; fName = n; return true;
         }
         
-        bool resetFromString(PSString s) {
-            reset(); type = PSObjectType::String; fValue = s; return true;
-        }
-        
-        bool resetFromArray(PSArrayHandle a) {
-            reset(); type = PSObjectType::Array; fValue = a; return true;
-        }
-        
-        bool resetFromDictionary(PSDictionaryHandle d) {
-            reset(); type = PSObjectType::Dictionary; fValue = d; return true;
-        }
-
-        bool resetFromFile(PSFileHandle f) {
-            reset(); type = PSObjectType::File; fValue = f; return true;
-        }
+        // The string body is held directly, with the view in the aux fields.
+        // A view that starts 64K or more into its body (only possible for
+        // strings longer than PostScript's own 65535 byte limit) does not fit
+        // the 16 bit offset, so the view itself is boxed, still onto the same
+        // body, and the offset says so.
+        static constexpr uint16_t kBoxedStringView = UINT16_MAX;
+
+        bool resetFromString(const PSString& s) {
+            reset();
+            type = PSObjectType::String;
+            fAux32 = static_cast<uint32_t>(s.length());
+            if (s.offset() >= kBoxedStringView) {
+                fBox = new PSBox<PSString>(s);
+                fAux16 = kBoxedStringView;
+                return true;
+            }
 
-        bool resetFromFontFace(PSFontFaceHandle v) {
-            reset(); type = PSObjectType::FontFace; fValue = v; return true;
+            fBox = s.body();
+            if (fBox)
+                fBox->retain();
+            fAux16 = static_cast<uint16_t>(s.offset());
+            return true;
         }
+        bool resetFromArray(PSArrayHandle a) { return resetFromBox(PSObjectType::Array, std::move(a)); }
+        bool resetFromDictionary(PSDictionaryHandle d) { return resetFromBox(PSObjectType::Dictionary, std::move(d)); }
+        bool resetFromFile(PSFileHandle f) { return resetFromBox(PSObjectType::File, std::move(f)); }
+        bool resetFromFontFace(PSFontFaceHandle v) { return resetFromBox(PSObjectType::FontFace, std::move(v)); }
+        bool resetFromFont(PSFontHandle v) { return resetFromBox(PSObjectType::Font, std::move(v)); }
+        bool resetFromMatrix(const PSMatrix& m) { return resetFromBox(PSObjectType::Matrix, m); }
+        bool resetFromPath(const PSPath& p) { return resetFromBox(PSObjectType::Path, p); }
+        bool resetFromPath(PSPath&& p) { return resetFromBox(PSObjectType::Path, std::move(p)); }
 
-        bool resetFromFont(PSFontHandle v) {
-            reset(); type = PSObjectType::Font; fValue = v; return true;
+        // Operators are interned (see PSOperatorTable), so only the pointer is kept
+        bool resetFromOperator(const PSOperator* op) {
+            reset(); type = PSObjectType::Operator; setExecutable(true); fOperator = op; fAux16 = op->opcode(); return true;
         }
 
-        bool resetFromOperator(const PSOperator& f) {
-            reset(); type = PSObjectType::Operator; setExecutable(true); fValue = f; return true;
-        }
-        bool resetFromMatrix(const PSMatrix& m) {
-            reset(); type = PSObjectType::Matrix; fValue = m; return true;
-        }
-        bool resetFromPath(const PSPath& p) {
-            reset(); type = PSObjectType::Path; fValue = p; return true;
-        }
-        bool resetFromPath(PSPath&& p) {
-            reset(); type = PSObjectType::Path; fValue = std::move(p); return true;
-        }
         bool resetFromMark(const PSMark& m) {
-            reset(); type = PSObjectType::Mark; fValue = m; return true;
+            reset(); type = PSObjectType::Mark; fName = m.name(); return true;
         }
 
         bool resetFromSave() { reset(); type = PSObjectType::Save; return true; }
@@ -261,62 +497,48 @@ namespace waavs {
         static PSObject fromBool(bool v) { PSObject o; o.resetFromBool(v); return o; }
         static PSObject fromName(const PSName& n) { PSObject o; o.resetFromName(n); return o; }
         static PSObject fromExecName(const PSName& n) { PSObject o; o.resetFromName(n); o.setExecutable(true); return o; }
-        //static PSObject fromName(const OctetCursor& oc) { PSObject o; o.resetFromName(oc); return o; }
-        static PSObject fromString(PSString s) { PSObject o; o.resetFromString(s); return o; }
-        static PSObject fromArray(PSArrayHandle a) { PSObject o; o.resetFromArray(a); return o; }
-        static PSObject fromDictionary(PSDictionaryHandle d) { PSObject o; o.resetFromDictionary(d); return o; }
-        static PSObject fromFile(PSFileHandle f) { PSObject o; o.resetFromFile(f); return o; }
-        static PSObject fromFontFace(PSFontFaceHandle v) { PSObject o; o.resetFromFontFace(v); return o; }
-        static PSObject fromFont(PSFontHandle v) { PSObject o; o.resetFromFont(v); return o; }
-        static PSObject fromOperator(const PSOperator& f) { PSObject o; o.resetFromOperator(f); return o; }
+        static PSObject fromString(const PSString& s) { PSObject o; o.resetFromString(s); return o; }
+        static PSObject fromArray(PSArrayHandle a) { PSObject o; o.resetFromArray(std::move(a)); return o; }
+        static PSObject fromDictionary(PSDictionaryHandle d) { PSObject o; o.resetFromDictionary(std::move(d)); return o; }
+        static PSObject fromFile(PSFileHandle f) { PSObject o; o.resetFromFile(std::move(f)); return o; }
+        static PSObject fromFontFace(PSFontFaceHandle v) { PSObject o; o.resetFromFontFace(std::move(v)); return o; }
+        static PSObject fromFont(PSFontHandle v) { PSObject o; o.resetFromFont(std::move(v)); return o; }
+        static PSObject fromOperator(const PSOperator* op) { PSObject o; o.resetFromOperator(op); return o; }
         static PSObject fromMatrix(const PSMatrix& m) { PSObject o; o.resetFromMatrix(m); return o; }
         static PSObject fromPath(const PSPath& p) { PSObject o; o.resetFromPath(p); return o; }
-        static PSObject fromPath(PSPath&& p) { PSObject o; o.resetFromPath(p); return o; }
+        static PSObject fromPath(PSPath&& p) { PSObject o; o.resetFromPath(std::move(p)); return o; }
         static PSObject fromMark(const PSMark& m) { PSObject o; o.resetFromMark(m); return o; }
         static PSObject fromSave() { PSObject o; o.resetFromSave(); return o; }
 
-        // Accessors using std::get
-        template<typename T>
-        constexpr bool get(T& out) const {
-            if (const T* ptr = std::get_if<T>(&fValue)) {
-                out = *ptr;
-                return true;
-            }
-            return false;
-        }
-
-        template<typename T>
-        constexpr T as() const {
-            return std::get<T>(fValue);
-        }
-
-        template<typename T>
-        constexpr T* try_as() {
-            return std::get_if<T>(&fValue);
-        }
-
-        // Legacy-style accessors
-        int32_t asInt() const { return (type == PSObjectType::Int) ? as<int32_t>() : static_cast<int32_t>(as<double>()); }
-        double asReal() const { return (type == PSObjectType::Int) ? static_cast<double>(as<int32_t>()) : as<double>(); }
-        bool asBool() const { return as<bool>(); }
-        PSName asName() const { return as<PSName>(); }
-        const char* asNameCStr() const { return as<PSName>().c_str(); }
+        // Accessors
+        // These assume the type has already been checked by the caller
+        int32_t asInt() const { return (type == PSObjectType::Int) ? fInt : static_cast<int32_t>(fReal); }
+        double asReal() const { return (type == PSObjectType::Int) ? static_cast<double>(fInt) : fReal; }
+        bool asBool() const { return fBool; }
+        PSName asName() const { return fName; }
+        const char* asNameCStr() const { return fName.c_str(); }
         
-        const PSString& asString() const { return std::get<PSString>(fValue); }
-        PSString& asMutableString() {
-            return std::get<PSString>(fValue);
-        }
-
-
-        PSArrayHandle asArray() const { return as<PSArrayHandle>(); }
-        PSDictionaryHandle asDictionary() const { return as<PSDictionaryHandle>(); }
-        PSFileHandle asFile() const { return as<PSFileHandle>(); }
-        PSFontFaceHandle asFontFace() const { return as<PSFontFaceHandle>(); }
-        PSFontHandle asFont() const { return as<PSFontHandle>(); }
-        PSOperator asOperator() const { return as<PSOperator>(); }
-        PSMatrix asMatrix() const { return as<PSMatrix>(); }
-        PSPath asPath() const { return as<PSPath>(); }
-        PSMark asMark() const { return as<PSMark>(); }
+        // A view onto the string's shared bytes; writes through it are
+        // seen by every other reference to the same string
+        PSString asString() const {
+            if (!isString())
+                return PSString();
+            if (fAux16 == kBoxedStringView)
+                return boxValue<PSString>();
+            return PSString(static_cast<PSStringBody*>(fBox), fAux16, fAux32);
+        }
+
+        // Handles come back empty if the object is not of the requested type
+        PSArrayHandle asArray() const { return isArray() ? boxValue<PSArrayHandle>() : nullptr; }
+        PSDictionaryHandle asDictionary() const { return isDictionary() ? boxValue<PSDictionaryHandle>() : nullptr; }
+        PSFileHandle asFile() const { return isFile() ? boxValue<PSFileHandle>() : nullptr; }
+        PSFontFaceHandle asFontFace() const { return isFontFace() ? boxValue<PSFontFaceHandle>() : nullptr; }
+        PSFontHandle asFont() const { return isFont() ? boxValue<PSFontHandle>() : nullptr; }
+        const PSOperator& asOperator() const { return *fOperator; }
+        PSOpcode opcode() const { return static_cast<PSOpcode>(fAux16); }   // only meaningful for operators
+        const PSMatrix& asMatrix() const { return isMatrix() ? boxValue<PSMatrix>() : emptyValue<PSMatrix>(); }
+        const PSPath& asPath() const { return isPath() ? boxValue<PSPath>() : emptyValue<PSPath>(); }
+        PSMark asMark() const { return PSMark(fName); }
 
         // Type and flag checks
         // Checking and setting object attributes
@@ -342,7 +564,7 @@ namespace waavs {
         // Checking object type
         inline constexpr bool is(PSObjectType t) const { return (type == t) || (t == PSObjectType::Any); }
         inline bool isNumber() const { return isInt() || isReal(); }
-        inline bool isInt() const {return is(PSObjectType::Int) || (isReal() && (as<double>() == static_cast<int64_t>(as<double>()))); }
+        inline bool isInt() const {return is(PSObjectType::Int) || (isReal() && (fReal == static_cast<int64_t>(fReal))); }
         inline bool isReal() const { return is(PSObjectType::Real); }
         inline bool isBool() const { return is(PSObjectType::Bool); }
         inline bool isName() const { return is(PSObjectType::Name); }
@@ -365,6 +587,8 @@ namespace waavs {
         // Signature helper
         char typeChar() const { return static_cast<char>(type); }
     };
+
+    ASSERT_STRUCT_SIZE(PSObject, 16);
 }
 
 
@@ -459,6 +683,16 @@ namespace waavs {
         static std::shared_ptr<PSArray> create(size_t size = 0, const PSObject& fill = PSObject()) {
             return std::make_shared<PSArray>(size, fill);
         }
+
+        // An array of exactly the 'count' objects at 'objs', which are
+        // moved into it
+        static std::shared_ptr<PSArray> createFrom(PSObject* objs, size_t count) {
+            auto result = std::make_shared<PSArray>();
+            result->elements.reserve(count);
+            result->elements.insert(result->elements.end(),
+                std::make_move_iterator(objs), std::make_move_iterator(objs + count));
+            return result;
+        }
     };
 
 
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <memory>
+#include <unordered_set>
 
 
 #include "pscore.h"
@@ -11,6 +12,7 @@
 #include "ps_type_graphicscontext.h"
 #include "ps_type_file.h"
 #include "ps_scanner.h"
+#include "ps_dsc_index.h"
 #include "ps_print.h"
 
 
@@ -31,11 +33,13 @@ namespace waavs
 		int fLanguageLevel = 2; // Default language level
         std::unique_ptr<PSGraphicsContext> graphicsContext_;
         PSObjectStack operandStack_;
-        PSObjectStack executionStack_;
+        PSExecStack executionStack_;
         PSObjectStack fileStack;
 
 		bool stopRequested = false;
         bool exitRequested = false;
+        bool fAutoBind = false;     // bind procedures as they are def'd
+        std::shared_ptr<PSPrologCache> fPrologCache;    // opt-in, see setPrologCache()
 
         PSDictionaryHandle systemdict;
         PSDictionaryHandle userdict;
@@ -68,6 +72,27 @@ namespace waavs
         // Access to properties and state
         PSDictionaryStack& getDictionaryStack() { return dictionaryStack; }
         const PSDictionaryStack& getDictionaryStack() const { return dictionaryStack; }
+
+        // Auto bind
+        // When on, 'def' binds every procedure it defines, as if the 
+        // document had written 'bind def'.  For documents that never call 
+        // bind themselves.  Off by default, as it changes the meaning of a 
+        // document that redefines an operator after using it in a procedure.
+        bool autoBind() const { return fAutoBind; }
+        void setAutoBind(bool on) { fAutoBind = on; }
+
+        // Prolog cache
+        // When set, the objects scanned from a document's prolog regions
+        // are kept, and the next document with the same prolog gets them
+        // back without scanning.  The cache can be shared by any number
+        // of machines, one after the other.  None by default.
+        const std::shared_ptr<PSPrologCache>& prologCache() const { return fPrologCache; }
+        void setPrologCache(std::shared_ptr<PSPrologCache> cache) { fPrologCache = std::move(cache); }
+
+        // How often executable names were resolved from the lookup cache
+        const PSLookupStats& lookupStats() const { return dictionaryStack.lookupStats(); }
+        void resetLookupStats() { dictionaryStack.resetLookupStats(); }
+
         PSDictionaryHandle getSystemDict() const { return systemdict; }
         PSDictionaryHandle getUserDict() const { return userdict; }
         PSDictionaryHandle setUserDict(PSDictionaryHandle dict)
@@ -123,8 +148,13 @@ namespace waavs
         inline PSObjectStack& opStack() { return operandStack_; }
         inline const PSObjectStack& opStack() const { return operandStack_; }
 
-        inline PSObjectStack& execStack() { return executionStack_; }
-        inline const PSObjectStack& execStack() const { return executionStack_; }
+        inline PSExecStack& execStack() { return executionStack_; }
+        inline const PSExecStack& execStack() const { return executionStack_; }
+
+        // The most frames the execution stack can hold, which
+        // is how deep PostScript procedures can recurse.
+        size_t execStackLimit() const { return executionStack_.limit(); }
+        void setExecStackLimit(size_t limit) { executionStack_.setLimit(limit); }
 
         // Graphics context access
         PSGraphicsContext* graphics() { return graphicsContext_.get(); }
@@ -137,12 +167,10 @@ namespace waavs
 		//======================================================================
         // Mass registration of builtin operators.  This is NOT how user
         // defined operators are registered.
-        bool registerBuiltin(const PSName & name, PSOperatorFunc fn)
+        bool registerBuiltin(const PSName & name, PSOperatorFunc fn, PSOpcode opcode = PSOpcode::None, const char* operands = nullptr)
         {
-            PSOperator op(name, fn);
-
-            // Instead of getting a pointer (now unnecessary), use local copy
-            systemdict->put(name, PSObject::fromOperator(op));
+            // Operator records are interned, so the object only holds a pointer
+            systemdict->put(name, PSObject::fromOperator(PSOperatorTable::INTERN(name, fn, opcode, operands)));
 
             return true;
         }
@@ -151,23 +179,25 @@ namespace waavs
         void registerOps(const PSOperatorFuncMap& ops)
         {
             for (const auto& entry : ops) {
-                registerBuiltin(entry.first, entry.second);
+                registerBuiltin(entry.first, entry.second.fFunc, entry.second.fOpcode, entry.second.fOperands);
             }
         }
 
 
 
-        // request whole program exit
+        // request an exit from the innermost loop
+        // The execution stack is unwound, a frame at a time, by run()
         void exit() { 
             exitRequested = true; 
         }
         bool isExitRequested() const { return exitRequested; }
         void clearExitRequest() { exitRequested = false; }
 
-        // request a stop to the currently executing loop
+        // request a stop to the currently executing context
+        // The execution stack is unwound, a frame at a time, by run(),
+        // until it reaches the innermost 'stopped'
         void stop() 
         { 
-            execStack().clearToMark();  // clear the rest of currently executing procedure
             stopRequested = true; 
         }
         bool isStopRequested() const { return stopRequested; }
@@ -179,14 +209,194 @@ namespace waavs
 
  public:
 
+        // bindProc
+        // Replace the executable names in a procedure that currently resolve 
+        // to operators, with the operators themselves.  Procedures nested 
+        // inside are bound the same way, and made read-only.  Nested procedures 
+        // that are already read-only are left alone, and every array is only 
+        // visited once, so shared and cyclic procedures are fine.  
+        // Uses a work list rather than recursion, so deep nesting can not 
+        // run out of C++ stack.
+        void bindProc(const PSObject& proc)
+        {
+            auto root = proc.asArray();
+            if (!root)
+                return;
+
+            std::vector<PSArray*> work{ root.get() };
+            std::unordered_set<const PSArray*> seen{ root.get() };
+
+            while (!work.empty())
+            {
+                PSArray* arr = work.back();
+                work.pop_back();
+
+                for (auto& elem : arr->elements) {
+                    if (elem.isExecutableName()) {
+                        PSObject resolved;
+                        if (dictionaryStack.load(elem.asName(), resolved) && resolved.isOperator())
+                            elem.resetFromOperator(&resolved.asOperator());
+                    }
+                    else if (elem.isExecutableArray() && elem.isAccessWriteable()) {
+                        auto nested = elem.asArray();
+                        if (nested && seen.insert(nested.get()).second)
+                            work.push_back(nested.get());
+
+                        elem.setAccessWriteable(false);
+                    }
+                }
+            }
+        }
+
+        // execInline
+        // The hottest operators, run right here in the dispatch, rather than
+        // through a function pointer.  Only the common case is handled; when 
+        // the operands are anything else (errors included), this returns false, 
+        // and the operator's own function takes care of it.
+        // When the operator was handled, 'ok' holds its result.
+        bool execInline(PSOpcode opcode, bool& ok)
+        {
+            auto& s = opStack();
+            ok = true;
+
+            switch (opcode) {
+            case PSOpcode::Add:
+            case PSOpcode::Mul: {
+                if (s.size() < 2)
+                    return false;
+
+                PSObject& a = s.fromTop(1);
+                const PSObject& b = s.fromTop(0);
+
+                if (a.type == PSObjectType::Int && b.type == PSObjectType::Int) {
+                    int64_t r = (opcode == PSOpcode::Add) 
+                        ? int64_t(a.asInt()) + int64_t(b.asInt()) 
+                        : int64_t(a.asInt()) * int64_t(b.asInt());
+
+                    // an integer result that does not fit becomes a real
+                    if (r >= INT32_MIN && r <= INT32_MAX)
+                        a.resetFromInt(static_cast<int32_t>(r));
+                    else
+                        a.resetFromReal(static_cast<double>(r));
+                }
+                else if ((a.type == PSObjectType::Int || a.type == PSObjectType::Real) && 
+                         (b.type == PSObjectType::Int || b.type == PSObjectType::Real)) {
+                    double r = (opcode == PSOpcode::Add) ? a.asReal() + b.asReal() : a.asReal() * b.asReal();
+                    a.resetFromReal(r);
+                }
+                else {
+                    return false;
+                }
+
+                s.drop(1);
+                return true;
+            }
+
+            case PSOpcode::Exch:
+                return s.exch();
+
+            case PSOpcode::Dup:
+                return s.dup();
+
+            case PSOpcode::Index: {
+                if (s.empty() || s.fromTop(0).type != PSObjectType::Int)
+                    return false;
+
+                int32_t n = s.fromTop(0).asInt();
+                if (n < 0 || size_t(n) + 1 >= s.size())
+                    return false;
+
+                s.fromTop(0) = s.fromTop(size_t(n) + 1);
+                return true;
+            }
+
+            case PSOpcode::Roll: {
+                if (s.size() < 2 || s.fromTop(0).type != PSObjectType::Int || s.fromTop(1).type != PSObjectType::Int)
+                    return false;
+
+                int32_t shift = s.fromTop(0).asInt();
+                int32_t count = s.fromTop(1).asInt();
+                if (count <= 0 || size_t(count) + 2 > s.size())
+                    return false;
+
+                s.drop(2);
+                return s.roll(count, shift);
+            }
+
+            case PSOpcode::MoveTo:
+            case PSOpcode::LineTo: {
+                if (s.size() < 2 || !s.fromTop(0).isNumber() || !s.fromTop(1).isNumber())
+                    return false;
+
+                double y = s.fromTop(0).asReal();
+                double x = s.fromTop(1).asReal();
+                s.drop(2);
+
+                auto& path = graphics()->currentPath();
+                auto& ctm = graphics()->getCTM();
+
+                if (opcode == PSOpcode::LineTo) {
+                    ok = path.lineto(ctm, x, y);
+                }
+                else if (!path.moveto(ctm, x, y)) {
+                    ok = error("op_moveto: path.moveto() error");
+                }
+                return true;
+            }
+
+            default:
+                return false;
+            }
+        }
+
+        static bool operandMatches(char kind, const PSObject& obj) noexcept
+        {
+            switch (kind) {
+            case '*': return true;
+            case 'N': return obj.type == PSObjectType::Int || obj.type == PSObjectType::Real;
+            case 'i': return obj.isInt();
+            case 'P': return obj.isExecutableArray();
+            default:  return obj.typeChar() == kind;
+            }
+        }
+
+        // checkOperands
+        // Check the operands of an operator against its signature, once, 
+        // before it runs.  On an error, the operands are left on the stack, 
+        // and the error is reported the same way for every operator.
+        bool checkOperands(const PSOperator& op)
+        {
+            const PSOperandSignature& sig = op.operands();
+            size_t n = sig.arity();
+            if (n == 0)
+                return true;
+
+            auto& s = opStack();
+            if (s.size() < n)
+                return error("stackunderflow", op.name().c_str());
+
+            for (size_t i = 0; i < n; ++i) {
+                if (!operandMatches(sig.kind(i), s.fromTop(n - 1 - i)))
+                    return error("typecheck", op.name().c_str());
+            }
+
+            return true;
+        }
+
         bool execOperator(const PSObject& obj)
         {
-            auto op = obj.asOperator();
+            bool ok;
+
+            if (!execInline(obj.opcode(), ok)) {
+                const PSOperator& op = obj.asOperator();
 
-            //printf("DBG: execOperator - executing operator: %s\n", op.name.c_str());
+                //printf("DBG: execOperator - executing operator: %s\n", op.name.c_str());
 
-            if (!op.exec(*this))
-                return error("execOperator: op.exec() failed; ", op.name().c_str());
+                ok = checkOperands(op) && op.exec(*this);
+            }
+
+            if (!ok)
+                return error("execOperator: op.exec() failed; ", obj.asOperator().name().c_str());
 
             return true;
         }
@@ -224,10 +434,10 @@ namespace waavs
                 return execOperator(resolved);
             }
 
-            // 3. Name resolves to a procedure?  auto-exec
+            // 3. Name resolves to a procedure?  
+            // push a frame for it, and let run() get to it
             if (resolved.isArray() && resolved.isExecutable()) {
-                //execProc(resolved);
-                return runProc(resolved);
+                return pushProc(resolved);
             }
 
             // 4. Otherwise, it's a literal value, push to operand stack
@@ -263,7 +473,6 @@ namespace waavs
                 case PSObjectType::Mark:
                 case PSObjectType::Null:
                 case PSObjectType::Save:
-                case PSObjectType::File:
                 case PSObjectType::Font:
                 case PSObjectType::FontFace:
                 case PSObjectType::Array:
@@ -275,6 +484,15 @@ namespace waavs
                     return execOperator(obj);
                 }
 
+                case PSObjectType::File: {
+                    // An executable file is read, and run, to its end
+                    if (obj.isExecutable())
+                        return interpret(obj.asFile());
+
+                    opStack().push(obj);
+                    return true;
+                }
+
                 case PSObjectType::Name: {
                     return execName(obj); // Execute the name directly
                 }
@@ -283,77 +501,320 @@ namespace waavs
 
             return true;
         }
- 
+
+        // An element of a procedure body.  Executable arrays found inside 
+        // a procedure are not executed, they are pushed, so that operators 
+        // like 'if' can pick them up as operands.
+        bool execProcElement(const PSObject& obj)
+        {
+            if (!obj.isExecutable() || obj.isArray())
+                return opStack().push(obj);
+
+            if (obj.isName() || obj.isOperator() || obj.isFile())
+                return execObject(obj);
+
+            return error("run(): typecheck, unknown executable type");
+        }
+
+        // pushProc
+        // Schedule a procedure for execution.  This only pushes a frame; the 
+        // procedure runs when control gets back to run().  Operators such as 
+        // 'exec' and 'if' use this, so they never recurse on the C++ stack.
+        bool pushProc(const PSObject& proc)
+        {
+            if (!proc.isArray())
+                return error("pushProc: typecheck, NOT ARRAY");
+
+            auto arr = proc.asArray();
+            if (!arr || arr->size() == 0)
+                return true;
+
+            if (!execStack().pushProc(proc, arr.get())) {
+                stop();
+                return error("execstackoverflow");
+            }
+
+            return true;
+        }
+
+        // Schedule a single object for execution
+        bool pushExec(const PSObject& obj)
+        {
+            if (!execStack().pushObject(obj)) {
+                stop();
+                return error("execstackoverflow");
+            }
+
+            return true;
+        }
+
+        // Establish a 'stopped' context, which run() will land 
+        // on when the exec stack is unwound by 'stop'
+        bool pushStopped()
+        {
+            if (!execStack().pushStopped()) {
+                stop();
+                return error("execstackoverflow");
+            }
+
+            return true;
+        }
+
+        // pushLoop
+        // Establish a loop frame for one of the looping operators.  The
+        // caller fills in the loop state of the returned frame.  Returns 
+        // nullptr if there was no room on the exec stack.
+        PSExecFrame* pushLoop(PSExecFrameKind kind, const PSObject& proc)
+        {
+            auto arr = proc.asArray();
+            if (!arr) {
+                error("pushLoop: typecheck, NOT ARRAY");
+                return nullptr;
+            }
+
+            PSExecFrame* frame = execStack().pushLoop(kind, proc, arr.get());
+            if (!frame) {
+                stop();
+                error("execstackoverflow");
+            }
+
+            return frame;
+        }
+
+        // stepLoop
+        // A loop frame has come to the end of its body.  Set up the next
+        // pass, pushing the control variable(s), if any, and start the body 
+        // over.  Returns false when the loop is finished.
+        bool stepLoop(PSExecFrame& frame)
+        {
+            auto& ostk = opStack();
+
+            switch (frame.fKind) {
+            case PSExecFrameKind::Loop:
+                break;
+
+            case PSExecFrameKind::Repeat:
+                if (frame.fCounter <= 0)
+                    return false;
+                frame.fCounter--;
+                break;
+
+            case PSExecFrameKind::For:
+                if (frame.fIntegers) {
+                    int64_t i = frame.fCounter;
+                    if (i < INT32_MIN || i > INT32_MAX)
+                        return false;
+                    if (!((frame.fIncrement > 0 && i <= frame.fLimit) || (frame.fIncrement < 0 && i >= frame.fLimit)))
+                        return false;
+                    ostk.pushInt(static_cast<int32_t>(i));
+                    frame.fCounter += frame.fIncrement;
+                }
+                else {
+                    double i = frame.fRealCounter;
+                    if (!((frame.fRealIncrement > 0 && i <= frame.fLimit) || (frame.fRealIncrement < 0 && i >= frame.fLimit)))
+                        return false;
+                    ostk.pushReal(i);
+                    frame.fRealCounter += frame.fRealIncrement;
+                }
+                break;
+
+            case PSExecFrameKind::ForAll: {
+                const PSObject& container = frame.fContainer;
+
+                switch (container.type) {
+                case PSObjectType::Array: {
+                    auto arr = container.asArray();
+                    if (!arr || frame.fPosition >= arr->size())
+                        return false;
+                    ostk.push(arr->elements[frame.fPosition++]);
+                    break;
+                }
+
+                case PSObjectType::String: {
+                    PSString str = container.asString();
+                    if (frame.fPosition >= str.length())
+                        return false;
+                    ostk.pushInt(str.get(static_cast<uint32_t>(frame.fPosition++)));
+                    break;
+                }
+
+                case PSObjectType::Dictionary: {
+                    auto dict = container.asDictionary();
+                    PSName key;
+                    PSObject value;
+                    if (!dict || !dict->nextEntry(frame.fPosition, key, value))
+                        return false;
+                    ostk.pushLiteralName(key);
+                    ostk.push(value);
+                    break;
+                }
+
+                default:
+                    return false;
+                }
+                break;
+            }
+
+            default:
+                return false;
+            }
+
+            frame.fIndex = 0;
+            return true;
+        }
+
+        // unwind
+        // Respond to a stop or exit request, by popping whole frames off
+        // the exec stack, down to no lower than baseDepth.  
+        // A stop lands on the innermost 'stopped' frame, an exit on the
+        // innermost loop frame.  
+        // Returns true if the request was satisfied along the way, false if
+        // it was left for whoever called run() to deal with.
+        bool unwind(size_t baseDepth)
+        {
+            auto& estk = execStack();
+
+            while (estk.size() > baseDepth)
+            {
+                PSExecFrame& frame = estk.topFrame();
+
+                if (isStopRequested()) {
+                    if (frame.fKind == PSExecFrameKind::Stopped) {
+                        estk.popFrame();
+                        clearStopRequest();
+                        return opStack().pushBool(true);
+                    }
+                }
+                else if (isExitRequested()) {
+                    if (isLoopFrameKind(frame.fKind)) {
+                        estk.popFrame();
+                        clearExitRequest();
+                        return true;
+                    }
+
+                    // An exit can not escape from a 'stopped' context,
+                    // it turns into an error, which stops instead
+                    if (frame.fKind == PSExecFrameKind::Stopped) {
+                        clearExitRequest();
+                        stop();
+                        error("invalidexit");
+                        continue;
+                    }
+                }
+
+                estk.popFrame();
+            }
+
+            return false;
+        }
+
         // run
         // 
-        // Run items off the execution stack until it is empty or an exit/stop request is made.
-        // As these can be nested, we will also return after hitting a procedure end marker.
+        // The dispatch loop.  Executes frames off the execution stack until
+        // it drops back to baseDepth.  A procedure call pushes a frame and 
+        // comes back around this loop, it does not recurse.  stop and exit
+        // requests unwind frames, down to baseDepth at most.
         //
-        bool run()
+        bool run(size_t baseDepth = 0)
         {
-            while (!execStack().empty()) 
+            auto& estk = execStack();
+
+            while (estk.size() > baseDepth) 
             {
-                if (isExitRequested())
-                    break;
-                if (isStopRequested())
+                if (isStopRequested() || isExitRequested()) {
+                    if (unwind(baseDepth))
+                        continue;
                     break;
+                }
 
-                PSObject obj;
-                if (!execStack().pop(obj))
-                    return error("run(): stackunderflow");
-                //writeObjectDeep(obj); printf("\n");
-
-                // Handle marker for proc end
-                if (obj.isMark()) {
-                    // If it's a mark, pop the stack to the mark
-                    //execStack().clearToMark();
-                    break; // Successfully cleared to mark
+                PSExecFrame& frame = estk.topFrame();
+
+                switch (frame.fKind) {
+                case PSExecFrameKind::Repeat:
+                case PSExecFrameKind::Loop:
+                case PSExecFrameKind::For:
+                case PSExecFrameKind::ForAll: {
+                    // The loop frame stays put while its body runs, and
+                    // is only popped once the loop is finished
+                    if (frame.fIndex >= frame.fBody->size()) {
+                        if (!stepLoop(frame))
+                            estk.popFrame();
+                        break;
+                    }
+
+                    PSObject obj = frame.fBody->elements[frame.fIndex++];
+                    execProcElement(obj);
+                    break;
                 }
 
+                case PSExecFrameKind::Proc: {
+                    size_t count = frame.fBody->size();
+                    if (frame.fIndex >= count) {
+                        estk.popFrame();
+                        break;
+                    }
 
+                    PSObject obj = frame.fBody->elements[frame.fIndex++];
 
-                // executable names, procedures, operators
-                if (obj.isExecutable()) {
-                    if (obj.isArray())
-                        opStack().push(obj);
-                    else if (obj.isName() || obj.isOperator())
-                    {
+                    // The frame is finished before its last element runs,
+                    // so a procedure that ends by calling another, does not
+                    // grow the exec stack
+                    if (frame.fIndex >= count)
+                        estk.popFrame();
+
+                    execProcElement(obj);
+                    break;
+                }
+
+                case PSExecFrameKind::Object: {
+                    PSObject obj = std::move(frame.fObject);
+                    estk.popFrame();
+
+                    // A procedure scheduled by itself is executed, not pushed
+                    if (obj.isExecutableArray())
+                        pushProc(obj);
+                    else if (obj.isExecutable())
                         execObject(obj);
-                    }
                     else
-                        return error("run(): typecheck, unknown executable type");
-                } else
-                    opStack().push(obj); // Otherwise, push it back to the operand stack
-
-                if (isExitRequested())
+                        opStack().push(obj);
                     break;
-                if (isStopRequested())
+                }
+
+                case PSExecFrameKind::Stopped:
+                    // Fell off the end of a 'stopped' procedure, without a stop
+                    estk.popFrame();
+                    opStack().pushBool(false);
                     break;
+                }
             }
 
             return true;
         }
 
-        bool runProc(PSObject& proc)
+        // runProc
+        // Run a procedure to completion, before returning.  This is for native
+        // code that needs the results of a procedure right away (image data 
+        // sources, pathforall, and the like).  Operators that only need the 
+        // procedure to run next should use pushProc() instead.
+        bool runProc(const PSObject& proc)
         {
-            // If the procedure is not executable, return an error
-            //if (!proc.isArray() || !proc.isExecutable())
-            //    return error("runProc: typecheck, NOT ARRAY or NOT EXECUTABLE");
-            if (!proc.isArray())
-                return error("runProc: typecheck, NOT ARRAY");
+            size_t base = execStack().size();
 
-            // Push the endProc frame marker onto the execution stack
-            execStack().mark();
+            if (!pushProc(proc))
+                return false;
 
-            // push elements in reverse order
-            auto arr = proc.asArray();
-            for (auto it = arr->elements.rbegin(); it != arr->elements.rend(); ++it)
-            {
-                execStack().push(*it);
-            }
+            return run(base);
+        }
+
+        // Execute a single object to completion, before returning
+        bool runObject(const PSObject& obj)
+        {
+            size_t base = execStack().size();
 
+            if (!pushExec(obj))
+                return false;
 
-            return run(); // Run the procedure
+            return run(base);
         }
 
         // This is a shim.  Mainly it needs to convert systemNamed objects
@@ -402,14 +863,14 @@ namespace waavs
 
                 if (obj.isExecutable())
                 {
-                    if (obj.isArray())
+                    if (obj.isArray() && !objGen.isImmediate())
                     {
                         if (!opStack().push(obj))
                             return error("interpreter: stack overflow while pushing executable array");
                     }
                     else {
-                        execStack().push(obj); // Push executable objects onto the execution stack
-                        if (!run())
+                        // Run executable objects to completion
+                        if (!runObject(obj))
                             return error("interpreter: run failed on executable object");
                     }
                 }
@@ -438,18 +899,21 @@ namespace waavs
             if (!file || !file->isValid())
                 return error("interpretFile: invalid file handle");
 
-            pushCurrentFile(file);
+            // A file without a cursor (a filter, a pipe) is read through 
+            // a window, and that is what 'currentfile' will give back, so 
+            // reads from it pick up where the scanner left off
+            PSFileHandle src = file->hasCursor() ? file : PSBufferedFile::create(file);
 
-            // Use the file's cursor as the input stream
-            if (!file->hasCursor())
-                return error("interpretFile: file does not have a cursor");
+            pushCurrentFile(src);
 
-            //OctetCursor cursor;
-            //file->getCursor(cursor);
+            PSObjectGenerator objGen(src);
+            objGen.setPrologCache(fPrologCache.get());
+            bool ok = interpret(objGen);
 
-            PSObjectGenerator objGen(file);
+            PSFileHandle lastOne;
+            popCurrentFile(lastOne);
 
-            return interpret(objGen);
+            return ok;
         }
 
         bool interpret(OctetCursor& input)
@@ -467,6 +931,24 @@ namespace waavs
             return interpret(cursor);
         }
 
+        // interpretPage
+        // Run one page of a DSC conforming document, by running the 
+        // document's header (prolog and setup), and then the page, 
+        // without the pages ahead of it.  'page' counts from 0, in the
+        // order the pages are in the document.
+        bool interpretPage(const PSDSCIndex& index, size_t page)
+        {
+            if (page >= index.pageCount())
+                return error("interpretPage: no such page");
+
+            OctetCursor header = index.header();
+            if (!interpret(header))
+                return false;
+
+            OctetCursor body = index.page(page);
+            return interpret(body);
+        }
+
 		//=======================================================================
         // ERROR handling
 		//=======================================================================
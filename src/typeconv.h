@@ -1,6 +1,9 @@
 #pragma once
 
 
+#include <cstdlib>
+#include <string>
+
 #include "ocspan.h"
 #include "ps_charcats.h"
 
@@ -64,109 +67,195 @@ namespace waavs {
         return true;
     }
 
-    // Assumption:  We're sitting at beginning of a number, all whitespace handling
-    // has already occured.
-    static bool inline readNumber(OctetCursor& s, double& value, bool &isInteger) noexcept
+    // The powers of ten that a double holds exactly
+    static constexpr double kExactPowersOfTen[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    // Value of a digit in a radix number, 0-9 then a-z (or A-Z) for 10-35.
+    // Anything else gives 36, which is too big for any base.
+    static INLINE uint32_t radixDigitValue(uint8_t c) noexcept
     {
-        const unsigned char* startAt = s.begin();
-        const unsigned char* endAt = s.end();
+        if (c >= '0' && c <= '9') return c - '0';
+        c |= 0x20;      // lower case
+        if (c >= 'a' && c <= 'z') return c - 'a' + 10;
+        return 36;
+    }
 
-        bool isNegative = false;
-        double res = 0.0;
+    // readRadixNumber
+    // The part after the '#' of a radix number, base#digits.  The digits 
+    // are an unsigned number, and the result is the integer with the same 
+    // 32-bit two's complement representation, so 16#FFFFFFFF is -1.  
+    // A value too big for 32 bits becomes a real.
+    static inline bool readRadixNumber(OctetCursor& s, uint64_t base, double& value, bool& isInteger) noexcept
+    {
+        const unsigned char* p = s.begin();
+        const unsigned char* end = s.end();
 
-        // integer part
-        uint64_t intPart = 0;
+        if (base < 2 || base > 36 || p >= end)
+            return false;
 
-        // fractional part
-        uint64_t fracPart = 0;
-        uint64_t fracBase = 1;
+        uint64_t v = 0;
+        bool tooBig = false;
+        double big = 0.0;
+        for (; p < end; ++p) {
+            uint32_t d = radixDigitValue(*p);
+            if (d >= base)
+                break;
+
+            v = v * base + d;
+            big = big * double(base) + d;
+            tooBig |= (v > 0xFFFFFFFFull);
+        }
 
+        if (p == s.begin())
+            return false;
 
-        bool hasIntPart = false;
-        bool hasFracPart = false;
+        s.fStart = p;
 
-        // Parse optional sign
-        if (*startAt == '+') {
-            startAt++;
+        if (tooBig) {
+            isInteger = false;
+            value = big;
         }
-        else if (*startAt == '-') {
-            isNegative = true;
-            startAt++;
+        else {
+            isInteger = true;
+            value = static_cast<double>(static_cast<int32_t>(static_cast<uint32_t>(v)));
         }
 
-        // The beginning can either be a digit, or a decimal point
-        // Parse integer part
-        unsigned char c = *startAt;
-        if (PSCharClass::isDigit(c))
-        {
-            hasIntPart = true;
-            s.fStart = startAt;
-            read_u64(s, intPart);
-            startAt = s.fStart;
-            res = static_cast<double>(intPart);
-            isInteger = true;
-        } else if (c!= '.') {
-            // if the first thing we see is not a digit, or a decimal, 
-            // then we're not parsing a number, so just return false, 
-            // although we might have already consumed the '+' or '-' sign
+        return true;
+    }
+
+    // readNumber
+    // Read a number, at the beginning of 's', which the lexer has already
+    // picked out as a number token.  All whitespace handling has already 
+    // occured.
+    //   integers   123  -98  +17
+    //   reals      -.002  34.5  -3.62  123.6e10  1E-5  1.0  -1.  0.0
+    //   radix      8#1777  16#FFFE  2#1000
+    //
+    // An integer that does not fit in 32 bits is a real, as the Red Book 
+    // says.  Reals are correctly rounded.  Nearly every real in a real 
+    // document has few enough digits, and a small enough exponent, that 
+    // the significand and the power of ten are both exact doubles, and 
+    // then one multiply or divide gives the correctly rounded result 
+    // (Clinger's fast path, as in fast_float).  The rest go to strtod.
+    static bool inline readNumber(OctetCursor& s, double& value, bool &isInteger) noexcept
+    {
+        const unsigned char* startAt = s.begin();
+        const unsigned char* endAt = s.end();
+        const unsigned char* p = startAt;
+
+        if (p >= endAt)
             return false;
+
+        // Parse optional sign
+        bool isNegative = (*p == '-');
+        bool hasSign = isNegative || (*p == '+');
+        if (hasSign)
+            p++;
+
+        // Integer part, and then the fraction, go into one significand
+        uint64_t mantissa = 0;
+        const unsigned char* digitsAt = p;
+        while (p < endAt && *p == '0')
+            p++;
+        const unsigned char* significantAt = p;
+        while (p < endAt && PSCharClass::isDigit(*p)) {
+            mantissa = (mantissa * 10) + (uint64_t)(*p - '0');
+            p++;
         }
+        size_t intDigits = p - digitsAt;
+        size_t significantDigits = p - significantAt;
 
-        // Check to see if there's a fractional part to be parsed
-        if ((startAt < endAt) && (*startAt == '.'))
-        {
-            isInteger = false;
-            hasFracPart = true;
-            startAt++; // move past '.'
+        // base#digits
+        if (p < endAt && *p == '#') {
+            if (hasSign || intDigits == 0 || intDigits > 2)
+                return false;
 
-            fracBase = 1;
+            s.fStart = p + 1;
+            return readRadixNumber(s, mantissa, value, isInteger);
+        }
 
-            // Add the fraction portion without calling out to powd
-            while ((startAt < endAt) && PSCharClass::isDigit(*startAt)) {
-                fracPart = fracPart * 10 + static_cast<uint64_t>(*startAt - '0');
-                fracBase *= 10;
-                startAt++;
+        // The common case, a plain integer.  It is an integer object as
+        // long as it fits; with ten digits or less, not counting leading
+        // zeros, it can not have wrapped
+        if (intDigits > 0 && (p == endAt || (*p != '.' && *p != 'e' && *p != 'E'))) {
+            uint64_t limit = isNegative ? 0x80000000ull : 0x7FFFFFFFull;
+            if (significantDigits <= 10 && mantissa <= limit) {
+                s.fStart = p;
+                isInteger = true;
+                value = isNegative ? -double(mantissa) : double(mantissa);
+                return true;
             }
-            res += (static_cast<double>(fracPart) / static_cast<double>(fracBase));
+        }
 
+        size_t fracDigits = 0;
+        if (p < endAt && *p == '.') {
+            p++; // move past '.'
 
-            // Parse optional exponent
-            // mostly we don't see this, so we won't bother trying
-            // to optimize it beyond using powd
-            if ((startAt < endAt) && (((*startAt == 'e') || (*startAt == 'E')) && PSCharClass::isDigit(startAt[1])))
-            {
-                // exponent parts
-                uint64_t expPart = 0;
-                double expSign = 1.0;
+            const unsigned char* fracAt = p;
+            while (p < endAt && PSCharClass::isDigit(*p)) {
+                mantissa = (mantissa * 10) + (uint64_t)(*p - '0');
+                p++;
+            }
+            fracDigits = p - fracAt;
+        }
 
-                startAt++; // skip 'E'
-                if (*startAt == '+') {
-                    startAt++;
-                }
-                else if (*startAt == '-') {
-                    expSign = -1.0;
-                    startAt++;
-                }
+        // If we don't have an integer or fractional
+        // part, then just return false
+        if (intDigits + fracDigits == 0)
+            return false;
 
+        int64_t exponent = -int64_t(fracDigits);
 
-                if (PSCharClass::isDigit(*startAt)) {
-                    s.fStart = startAt;
-                    read_u64(s, expPart);
-                    startAt = s.fStart;
-                    res = res * std::pow(10, double(expSign * double(expPart)));
+        // Parse optional exponent, only if there are digits after it
+        if (p < endAt && (*p == 'e' || *p == 'E')) {
+            const unsigned char* e = p + 1;
+            bool expNegative = false;
+            if (e < endAt && (*e == '+' || *e == '-')) {
+                expNegative = (*e == '-');
+                e++;
+            }
+
+            if (e < endAt && PSCharClass::isDigit(*e)) {
+                int64_t expPart = 0;
+                while (e < endAt && PSCharClass::isDigit(*e)) {
+                    if (expPart < 100000)
+                        expPart = (expPart * 10) + (*e - '0');
+                    e++;
                 }
+                exponent += expNegative ? -expPart : expPart;
+                p = e;
             }
         }
 
-        // If we don't have an integer or fractional
-        // part, then just return false
-        if (!hasIntPart && !hasFracPart)
-            return false;
+        s.fStart = p;
+        isInteger = false;
 
-        s.fStart = startAt;
+        // Clinger's fast path.  19 digits always fit the significand.
+        if (intDigits + fracDigits <= 19 && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+            double d = static_cast<double>(mantissa);
+            d = (exponent < 0) ? d / kExactPowersOfTen[-exponent] : d * kExactPowersOfTen[exponent];
+            value = isNegative ? -d : d;
+            return true;
+        }
 
-        value = (!isNegative) ? res : -res;
+        // Too many digits, or too big an exponent, strtod gets it right
+        size_t len = p - startAt;
+        char buff[64];
+        std::string longer;
+        const char* text = buff;
+        if (len < sizeof(buff)) {
+            std::memcpy(buff, startAt, len);
+            buff[len] = 0;
+        }
+        else {
+            longer.assign(reinterpret_cast<const char*>(startAt), len);
+            text = longer.c_str();
+        }
 
+        value = std::strtod(text, nullptr);
         return true;
     }
 }
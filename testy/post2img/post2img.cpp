@@ -2,6 +2,7 @@
 #include <filesystem>
 #include <memory>
 #include <cstdio>
+#include <cstdlib>
 #include <string>
 
 #include "mappedfile.h"
@@ -35,7 +36,7 @@ size_t loadFontsInDirectory(PSVirtualMachine* vm, const char* dirpath) {
 }
 
 // Utility to wrap input and run interpreter
-static bool runFile(const char *filename, const char *outfilename) 
+static bool runFile(const char *filename, const char *outfilename, std::shared_ptr<PSPrologCache> prologCache, int pageNumber) 
 {
 	auto vm = PSVMFactory::createVM();
 
@@ -44,13 +45,16 @@ static bool runFile(const char *filename, const char *outfilename)
 		return false;
 	}
 
+	vm->setPrologCache(prologCache);
+
 	auto ctx = std::make_unique<waavs::Blend2DGraphicsContext>(1700, 2200);	// US Letter size in points (8.5 x 11 inches, 200dpi)
 	ctx->initGraphics();
 	vm->setGraphicsContext(std::move(ctx));
 	loadFontsInDirectory(vm.get(), "c:/windows/fonts");
 
-	// Run the interpreter
-	auto mapped = MappedFile::create_shared(filename);
+	// Run the interpreter.  The whole job is read front to back, a single
+	// page is read after the index has found it
+	auto mapped = MappedFile::create_shared(filename, pageNumber > 0 ? MAPPED_HINT_NONE : MAPPED_HINT_SEQUENTIAL);
 
 	// if the mapped file does not exist, return
 	if (mapped == nullptr)
@@ -66,7 +70,34 @@ static bool runFile(const char *filename, const char *outfilename)
 		return false;
     }
 
-	vm->interpret(file);
+	// A single page, from a document that keeps its pages apart, runs 
+	// after the prolog and setup, without the pages ahead of it
+	PSDSCIndex dscIndex;
+	if (pageNumber > 0 && buildDSCIndex(OctetCursor(mapped->data(), mapped->size()), dscIndex) && dscIndex.hasPages())
+	{
+		size_t page = dscIndex.findPage(pageNumber);
+		if (page == PSDSCIndex::npos && size_t(pageNumber) <= dscIndex.pageCount())
+			page = pageNumber - 1;
+
+		if (page == PSDSCIndex::npos) {
+			printf("No page %d in %s, which has %zu pages\n", pageNumber, filename, dscIndex.pageCount());
+			return false;
+		}
+
+		vm->interpretPage(dscIndex, page);
+	}
+	else {
+		if (pageNumber > 0)
+			printf("%s does not conform to the DSC, running all of it\n", filename);
+
+		vm->interpret(file);
+	}
+
+	if (prologCache) {
+		const PSPrologCacheStats& st = prologCache->stats();
+		printf("prolog cache: %zu replayed (%zu bytes), %zu scanned, saved %.3f ms\n",
+			st.fHits, st.fBytesReplayed, st.fMisses, st.fSavedMs);
+	}
 
 	// If we want, we can save output here
 	static_cast<waavs::Blend2DGraphicsContext*>(vm->graphics())->getImage().writeToFile(outfilename);
@@ -94,9 +125,27 @@ std::string defaultOutputFilename(const std::string& inputFilename) {
 int main(int argc, char** argv)
 {
 
+	// -prologcache <dir> keeps scanned prologs in 'dir', for the next run
+	// -page <n> renders only page n
+	std::shared_ptr<PSPrologCache> prologCache;
+	int pageNumber = 0;
+	while (argc > 2 && argv[1][0] == '-')
+	{
+		std::string option = argv[1];
+		if (option == "-prologcache")
+			prologCache = PSPrologCache::create(argv[2]);
+		else if (option == "-page")
+			pageNumber = atoi(argv[2]);
+		else
+			break;
+
+		argc -= 2;
+		argv += 2;
+	}
+
 	if (argc < 2)
 	{
-		printf("Usage: post2img <postscript file>  [output file]\n");
+		printf("Usage: post2img [-prologcache <dir>] [-page <n>] <postscript file>  [output file]\n");
 		return 1;
 	}
 
@@ -105,7 +154,7 @@ int main(int argc, char** argv)
 
 	auto outfilename = defaultOutputFilename(filename);
 
-	runFile(filename, outfilename.c_str());
+	runFile(filename, outfilename.c_str(), prologCache, pageNumber);
 
 	return 0;
 }
@@ -0,0 +1,57 @@
+// ps2bin
+//
+// Convert an ASCII PostScript program into its binary token encoding
+// (PLRM 3.14).  The result runs on any interpreter that reads binary
+// tokens, this one included, and its numbers need no text parsing.
+//
+//   ps2bin input.ps output.bps
+//
+
+#include "mappedfile.h"
+#include "ps_binary_writer.h"
+
+#include <cstdio>
+#include <vector>
+
+using namespace waavs;
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        printf("Usage: ps2bin <input.ps> <output>\n");
+        return 1;
+    }
+
+    auto mf = MappedFile::create_shared(argv[1]);
+    if (!mf) {
+        printf("could not open: %s\n", argv[1]);
+        return 1;
+    }
+
+    std::vector<uint8_t> out;
+    out.reserve(mf->size());
+
+    if (!encodeBinaryTokens(OctetCursor(mf->data(), mf->size()), out)) {
+        printf("could not encode: %s\n", argv[1]);
+        return 1;
+    }
+
+    FILE* fp = fopen(argv[2], "wb");
+    if (!fp) {
+        printf("could not create: %s\n", argv[2]);
+        return 1;
+    }
+
+    size_t written = fwrite(out.data(), 1, out.size(), fp);
+    fclose(fp);
+
+    if (written != out.size()) {
+        printf("could not write: %s\n", argv[2]);
+        return 1;
+    }
+
+    printf("%s: %zu bytes -> %s: %zu bytes (%.1f%%)\n", argv[1], static_cast<size_t>(mf->size()),
+        argv[2], out.size(), mf->size() ? out.size() * 100.0 / mf->size() : 0.0);
+
+    return 0;
+}
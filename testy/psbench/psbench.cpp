@@ -0,0 +1,1393 @@
+// psbench
+//
+// Micro benchmarks for the core data structures of the interpreter.
+// Each benchmark prints what it measured, so numbers from before and
+// after a change to the core can be compared side by side.
+//
+
+#include "pscore.h"
+#include "ps_binary_writer.h"
+#include "ps_charscan.h"
+#include "ps_hexdecode.h"
+#include "ps_lex_tokenizer.h"
+#include "ps_type_stack.h"
+#include "psvmfactory.h"
+#include "mappedfile.h"
+#include "stopwatch.h"
+#include "typeconv.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <new>
+#include <string>
+#include <variant>
+#include <vector>
+
+using namespace waavs;
+
+static constexpr size_t kStackDepth = 1000;
+static constexpr size_t kIterations = 20000;
+
+// Something the optimizer can not see through
+static volatile int64_t gSink = 0;
+
+// Every allocation the program makes is counted, so a benchmark can
+// report how many allocations the thing it measures costs
+static size_t gAllocations = 0;
+
+void* operator new(size_t size)
+{
+    ++gAllocations;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+//============================================================
+// LegacyObject
+//
+// The layout PSObject had before it became a 16 byte tagged value.
+// Everything lived inline in a std::variant, so the object was
+// as large as its largest alternative (PSPath), and copying a
+// string copied its bytes.
+//============================================================
+struct LegacyObject {
+    using Variant = std::variant<
+        std::monostate,
+        int32_t,
+        float,
+        double,
+        bool,
+        void*,
+        PSName,
+        PSOperator,
+        PSMatrix,
+        PSPath,
+        PSString,
+        PSArrayHandle,
+        PSDictionaryHandle,
+        PSFileHandle,
+        PSFontFaceHandle,
+        PSFontHandle,
+        PSMark
+    >;
+
+    uint32_t fFlags{ 0 };
+    Variant fValue;
+    PSObjectType type = PSObjectType::Null;
+
+    static LegacyObject fromInt(int32_t v) { LegacyObject o; o.type = PSObjectType::Int; o.fValue = v; return o; }
+    static LegacyObject fromReal(double v) { LegacyObject o; o.type = PSObjectType::Real; o.fValue = v; return o; }
+    static LegacyObject fromName(const PSName& n) { LegacyObject o; o.type = PSObjectType::Name; o.fValue = n; return o; }
+    static LegacyObject fromString(const PSString& s) { LegacyObject o; o.type = PSObjectType::String; o.fValue = s; return o; }
+
+    int32_t asInt() const { return std::get<int32_t>(fValue); }
+};
+
+//============================================================
+// The same stack operations, over both object representations
+//============================================================
+template <typename Obj, typename Stack>
+static double benchPushPop(Stack& s, const Obj* samples, size_t nSamples)
+{
+    StopWatch sw;
+    for (size_t iter = 0; iter < kIterations; ++iter) {
+        for (size_t i = 0; i < kStackDepth; ++i)
+            s.push_back(samples[i % nSamples]);
+
+        Obj out;
+        while (!s.empty()) {
+            out = std::move(s.back());
+            s.pop_back();
+        }
+    }
+    return sw.millis();
+}
+
+template <typename Obj, typename Stack>
+static double benchCopy(Stack& s, const Obj* samples, size_t nSamples)
+{
+    // 'n copy' style duplication of the top of the stack
+    StopWatch sw;
+    for (size_t iter = 0; iter < kIterations; ++iter) {
+        for (size_t i = 0; i < kStackDepth / 2; ++i)
+            s.push_back(samples[i % nSamples]);
+
+        s.reserve(kStackDepth);
+        size_t start = s.size() - (kStackDepth / 2);
+        for (size_t i = 0; i < kStackDepth / 2; ++i)
+            s.push_back(s[start + i]);
+
+        gSink = gSink + static_cast<int64_t>(s.size());
+        s.clear();
+    }
+    return sw.millis();
+}
+
+static void reportLine(const char* what, double legacyMs, double compactMs)
+{
+    double ops = double(kIterations) * double(kStackDepth);
+    printf("  %-22s legacy: %8.2f ms (%6.2f ns/op)   compact: %8.2f ms (%6.2f ns/op)   speedup: %.2fx\n",
+        what,
+        legacyMs, legacyMs * 1.0e6 / ops,
+        compactMs, compactMs * 1.0e6 / ops,
+        compactMs > 0 ? legacyMs / compactMs : 0.0);
+}
+
+static void bench_object_stack()
+{
+    printf("== PSObject stack push/pop/copy ==\n");
+    printf("  sizeof(LegacyObject) = %zu, per 64 byte cache line: %.2f\n", sizeof(LegacyObject), 64.0 / sizeof(LegacyObject));
+    printf("  sizeof(PSObject)     = %zu, per 64 byte cache line: %.2f\n", sizeof(PSObject), 64.0 / sizeof(PSObject));
+
+    PSName nameA("moveto");
+    PSName nameB("lineto");
+    PSString str = PSString::fromCString("a string on the stack");
+
+    // The typical mix on the operand stack; mostly numbers, some names
+    LegacyObject legacy[] = {
+        LegacyObject::fromInt(1), LegacyObject::fromReal(2.5), LegacyObject::fromName(nameA),
+        LegacyObject::fromInt(7), LegacyObject::fromReal(0.25), LegacyObject::fromName(nameB),
+        LegacyObject::fromInt(42), LegacyObject::fromString(str)
+    };
+    PSObject compact[] = {
+        PSObject::fromInt(1), PSObject::fromReal(2.5), PSObject::fromName(nameA),
+        PSObject::fromInt(7), PSObject::fromReal(0.25), PSObject::fromName(nameB),
+        PSObject::fromInt(42), PSObject::fromString(str)
+    };
+    const size_t nSamples = sizeof(compact) / sizeof(compact[0]);
+
+    std::vector<LegacyObject> legacyStack;
+    std::vector<PSObject> compactStack;
+    legacyStack.reserve(kStackDepth);
+    compactStack.reserve(kStackDepth);
+
+    // numbers only, no strings
+    double l1 = benchPushPop(legacyStack, legacy, nSamples - 1);
+    double c1 = benchPushPop(compactStack, compact, nSamples - 1);
+    reportLine("push/pop (numbers)", l1, c1);
+
+    double l2 = benchPushPop(legacyStack, legacy, nSamples);
+    double c2 = benchPushPop(compactStack, compact, nSamples);
+    reportLine("push/pop (with string)", l2, c2);
+
+    double l3 = benchCopy(legacyStack, legacy, nSamples);
+    double c3 = benchCopy(compactStack, compact, nSamples);
+    reportLine("copy", l3, c3);
+
+    // And through the stack the VM actually uses
+    PSObjectStack ostk;
+    StopWatch sw;
+    for (size_t iter = 0; iter < kIterations; ++iter) {
+        for (size_t i = 0; i < kStackDepth; ++i)
+            ostk.push(compact[i % nSamples]);
+        PSObject out;
+        while (ostk.pop(out))
+            ;
+    }
+    double ms = sw.millis();
+    printf("  PSObjectStack push/pop: %8.2f ms (%6.2f ns/op)\n", ms, ms * 1.0e6 / (double(kIterations) * double(kStackDepth)));
+}
+
+//============================================================
+// LegacyNameTable
+//
+// How names were interned before the hashed table; a std::map 
+// keyed by std::string, which builds a temporary string for
+// every lookup, whether the name is new or not.
+//============================================================
+struct LegacyNameTable {
+    std::map<std::string, const char*> pool;
+
+    const char* intern(const char* ptr, size_t len) {
+        auto [it, inserted] = pool.try_emplace(std::string(ptr, len), nullptr);
+        if (inserted)
+            it->second = it->first.c_str();
+        return it->second;
+    }
+};
+
+static void bench_name_intern()
+{
+    printf("== Name interning ==\n");
+
+    // The mix the scanner sees; a few hundred distinct names,
+    // most of them seen many times over
+    std::vector<std::string> words;
+    const char* common[] = { "moveto", "lineto", "curveto", "closepath", "stroke", "fill",
+        "gsave", "grestore", "def", "dup", "exch", "pop", "index", "roll", "add", "mul",
+        "translate", "scale", "rotate", "setrgbcolor", "setlinewidth", "show", "findfont" };
+    for (const char* w : common)
+        words.push_back(w);
+    for (int i = 0; i < 400; ++i)
+        words.push_back("UserName" + std::to_string(i));
+
+    const size_t kLookups = 2000000;
+
+    LegacyNameTable legacy;
+    StopWatch sw;
+    for (size_t i = 0; i < kLookups; ++i) {
+        const std::string& w = words[(i * 7) % words.size()];
+        gSink = gSink + (reinterpret_cast<intptr_t>(legacy.intern(w.data(), w.size())) & 1);
+    }
+    double legacyMs = sw.millis();
+
+    sw.reset();
+    for (size_t i = 0; i < kLookups; ++i) {
+        const std::string& w = words[(i * 7) % words.size()];
+        gSink = gSink + (reinterpret_cast<intptr_t>(PSNameTable::INTERN(w.data(), w.size())) & 1);
+    }
+    double hashedMs = sw.millis();
+
+    printf("  intern x%zu  std::map: %8.2f ms (%6.2f ns/op)   hashed: %8.2f ms (%6.2f ns/op)   speedup: %.2fx\n",
+        kLookups,
+        legacyMs, legacyMs * 1.0e6 / kLookups,
+        hashedMs, hashedMs * 1.0e6 / kLookups,
+        hashedMs > 0 ? legacyMs / hashedMs : 0.0);
+}
+
+//============================================================
+// PSDictionary
+// put, get, and remove, at the sizes dictionaries actually have;
+// small ones for procedures and fonts, up to systemdict sized.
+//============================================================
+static void bench_dictionary()
+{
+    printf("== PSDictionary put/get/remove ==\n");
+
+    const size_t sizes[] = { 32, 128, 512, 2000 };
+    const size_t kOpsPerSize = 2000000;
+
+    for (size_t n : sizes) {
+        std::vector<PSName> keys;
+        std::vector<PSName> missing;
+        for (size_t i = 0; i < n; ++i) {
+            keys.push_back(PSName(("key" + std::to_string(i)).c_str()));
+            missing.push_back(PSName(("absent" + std::to_string(i)).c_str()));
+        }
+
+        size_t rounds = kOpsPerSize / n;
+        PSObject value = PSObject::fromInt(1);
+        double putMs = 0, getMs = 0, missMs = 0, removeMs = 0;
+
+        for (size_t r = 0; r < rounds; ++r) {
+            // start from the default size, so growing is part of the cost
+            auto dict = PSDictionary::create();
+
+            StopWatch sw;
+            for (size_t i = 0; i < n; ++i)
+                dict->put(keys[i], value);
+            putMs += sw.millis();
+
+            PSObject out;
+            sw.reset();
+            for (size_t i = 0; i < n; ++i)
+                gSink = gSink + dict->get(keys[i], out);
+            getMs += sw.millis();
+
+            sw.reset();
+            for (size_t i = 0; i < n; ++i)
+                gSink = gSink + dict->get(missing[i], out);
+            missMs += sw.millis();
+
+            sw.reset();
+            for (size_t i = 0; i < n; ++i)
+                gSink = gSink + dict->remove(keys[i]);
+            removeMs += sw.millis();
+        }
+
+        double ops = double(rounds) * double(n);
+        printf("  %5zu entries  put: %6.2f ns   get: %6.2f ns   get (absent): %6.2f ns   remove: %6.2f ns\n",
+            n, putMs * 1.0e6 / ops, getMs * 1.0e6 / ops, missMs * 1.0e6 / ops, removeMs * 1.0e6 / ops);
+    }
+}
+
+//============================================================
+// Running PostScript
+// A VM with a graphics context that draws nothing, so the time
+// is spent in the interpreter itself.
+//============================================================
+struct NullGraphicsContext : public PSGraphicsContext {
+    bool stroke() override { currentPath().reset(); return true; }
+    bool fill() override { currentPath().reset(); return true; }
+    bool eofill() override { currentPath().reset(); return true; }
+    bool image(PSImage&, PSFileHandle) override { return true; }
+    bool showText(const PSMatrix&, const PSString&) override { return true; }
+    void showPage() override {}
+};
+
+static std::unique_ptr<PSVirtualMachine> createBenchVM(bool autoBind = false)
+{
+    auto vm = PSVMFactory::createVM();
+    vm->setGraphicsContext(std::make_unique<NullGraphicsContext>());
+    vm->graphics()->initGraphics();
+    vm->setAutoBind(autoBind);
+    return vm;
+}
+
+static double timeInterpret(const OctetCursor& src, int runs, bool autoBind = false)
+{
+    StopWatch sw;
+    for (int i = 0; i < runs; ++i) {
+        auto vm = createBenchVM(autoBind);
+        OctetCursor oc = src;
+        vm->interpret(oc);
+    }
+    return sw.millis() / runs;
+}
+
+// String operators that PostScript defines in terms of shared storage.
+// getinterval, search, and forall hand out views of the original string,
+// and readstring fills and returns a substring of its operand.
+static void bench_string_ops()
+{
+    printf("== String operators ==\n");
+
+    // A 1K string literal, so the scanner hands it over fully formed
+    std::string text = "/big (";
+    for (int i = 0; i < 1024; ++i)
+        text += static_cast<char>('a' + (i % 26));
+    text += R"||() def
+/hits 0 def
+2000 {
+    0 64 960 { big exch 64 getinterval pop } for
+    big (xyz) search { pop pop pop /hits hits 1 add def } { pop } ifelse
+    big 0 256 getinterval { pop } forall
+} repeat
+)||";
+
+    OctetCursor src(text.data(), text.size());
+    printf("  getinterval/search/forall: %8.2f ms\n", timeInterpret(src, 3));
+}
+
+// The looping operators, with bodies small enough that the cost of
+// setting up each pass is what gets measured
+static void bench_loops()
+{
+    printf("== Loops ==\n");
+
+    const char* forLoop = "0 1 1 500 { 1 1 500 { add } for } for pop";
+    const char* repeatLoop = "0 250000 { 1 add } repeat pop";
+    const char* loopExit = "0 { 1 add dup 250000 ge { exit } if } loop pop";
+    const char* forallLoop = "/a 1000 array def 250 { a { pop } forall } repeat";
+
+    OctetCursor src1(forLoop, strlen(forLoop));
+    OctetCursor src2(repeatLoop, strlen(repeatLoop));
+    OctetCursor src3(loopExit, strlen(loopExit));
+    OctetCursor src4(forallLoop, strlen(forallLoop));
+
+    printf("  nested for 500x500:        %8.2f ms\n", timeInterpret(src1, 5));
+    printf("  repeat 250000:             %8.2f ms\n", timeInterpret(src2, 5));
+    printf("  loop/exit 250000:          %8.2f ms\n", timeInterpret(src3, 5));
+    printf("  forall 250 x 1000:         %8.2f ms\n", timeInterpret(src4, 5));
+}
+
+// Executable names that are looked up over and over, through a few
+// dictionaries, with the occasional def in between
+static void bench_name_lookup()
+{
+    printf("== Name lookup ==\n");
+
+    const char* text = R"||(
+/a 1 def /b 2 def /c 3 def
+/f { a b add c mul pop } def
+5 dict begin
+/g { f f a pop } def
+0 1 50000 { pop g /a a def } for
+end
+)||";
+
+    OctetCursor src(text, strlen(text));
+    printf("  cached lookups:            %8.2f ms\n", timeInterpret(src, 5));
+
+    auto vm = createBenchVM();
+    OctetCursor oc = src;
+    vm->resetLookupStats();
+    vm->interpret(oc);
+
+    const PSLookupStats& stats = vm->lookupStats();
+    printf("  lookups: %llu  hits: %llu  hit rate: %.2f%%\n",
+        static_cast<unsigned long long>(stats.lookups()),
+        static_cast<unsigned long long>(stats.fHits),
+        stats.hitRate() * 100.0);
+}
+
+// A procedure with loops and conditionals nested inside, the way 
+// prologs are written, run as written, then with auto bind on, so
+// the nested bodies are bound as well
+static void bench_bind()
+{
+    printf("== Bind ==\n");
+
+    const char* text = R"||(
+/step { dup dup mul exch 2 mul add } def
+/work {
+    0 1 100 {
+        0 1 100 {
+            1 index add step 2 mod 0 eq { 1 } { 2 } ifelse pop
+        } for
+        pop
+    } for
+} def
+20 { work } repeat
+)||";
+
+    OctetCursor src(text, strlen(text));
+    double plain = timeInterpret(src, 3, false);
+    double bound = timeInterpret(src, 3, true);
+    printf("  as written: %8.2f ms   auto bind: %8.2f ms   speedup: %.2fx\n", plain, bound, bound > 0 ? plain / bound : 0.0);
+}
+
+// Operators that take their operands through a signature; the VM checks
+// them once, and the operators work on them where they are on the stack
+static void bench_operands()
+{
+    printf("== Operand checking ==\n");
+
+    const char* mathText = "0 1 1 200000 { 3 sub 2 div 1.5 max neg abs cvi 7 mod pop } for pop";
+    const char* pathText = "1 1 100000 { dup 10 moveto 20 lineto 1 2 3 4 5 6 curveto 0 0 5 0 90 arc } for newpath";
+    const char* condText = "0 1 200000 { 2 mod 0 eq { 1 } { 2 } ifelse pop } for";
+
+    OctetCursor src1(mathText, strlen(mathText));
+    OctetCursor src2(pathText, strlen(pathText));
+    OctetCursor src3(condText, strlen(condText));
+
+    printf("  math 200000:               %8.2f ms\n", timeInterpret(src1, 5));
+    printf("  path 100000:               %8.2f ms\n", timeInterpret(src2, 5));
+    printf("  ifelse 200000:             %8.2f ms\n", timeInterpret(src3, 5));
+}
+
+// The same program scanned straight from memory, and through the window
+// that files without a cursor of their own are read with
+static void bench_streaming_lexer()
+{
+    printf("== Streaming lexer ==\n");
+
+    std::string text;
+    for (int i = 0; i < 40000; ++i)
+        text += "/name 123 4.5e6 (a string \\(with\\) escapes) <48656C6C6F> { 1 2 add pop } pop pop pop pop pop\n";
+
+    OctetCursor src(text.data(), text.size());
+    double mb = text.size() / (1024.0 * 1024.0);
+
+    StopWatch sw;
+    {
+        auto vm = createBenchVM();
+        OctetCursor oc = src;
+        vm->interpret(oc);
+    }
+    double direct = sw.millis();
+
+    size_t windowSize = 0;
+    sw.reset();
+    {
+        auto vm = createBenchVM();
+        auto window = PSBufferedFile::create(PSMemoryFile::create(src));
+        vm->interpret(window);
+        windowSize = window->windowSize();
+    }
+    double windowed = sw.millis();
+
+    printf("  %.1f MB direct:   %8.2f ms  (%.1f MB/s)\n", mb, direct, direct > 0 ? mb * 1000.0 / direct : 0.0);
+    printf("  %.1f MB windowed: %8.2f ms  (%.1f MB/s)  window: %zu bytes\n", mb, windowed, windowed > 0 ? mb * 1000.0 / windowed : 0.0, windowSize);
+}
+
+// Only the lexer, over the whole of a document, best of 'runs'.  This
+// is where the character class kernels (ps_charscan.h) show up.
+static void bench_lexer(const char* filename, int runs)
+{
+    auto mf = MappedFile::create_shared(filename);
+    if (!mf) {
+        printf("  could not open: %s\n", filename);
+        return;
+    }
+
+    OctetCursor src(mf->data(), mf->size());
+    double best = 0;
+    size_t tokens = 0;
+
+    for (int i = 0; i < runs; ++i) {
+        auto file = PSMemoryFile::create(src);
+        PSLexeme lex;
+        size_t count = 0;
+
+        StopWatch sw;
+        while (nextPSLexeme(file, lex))
+            ++count;
+        double ms = sw.millis();
+
+        if (i == 0 || ms < best)
+            best = ms;
+        tokens = count;
+    }
+
+    double mb = src.size() / (1024.0 * 1024.0);
+    printf("  %-40s %8.2f MB/s  (%zu tokens, %.2f ms)\n", filename, best > 0 ? mb * 1000.0 / best : 0.0, tokens, best);
+}
+
+// readNumber against strtod, over the number tokens of a document.
+// Both get the same tokens, strtod needs them NUL terminated, and
+// any real where the two differ in even the last bit is counted.
+static void benchNumberTokens(const char* label, const OctetCursor& src, int runs)
+{
+    std::vector<std::string> numbers;
+    {
+        auto file = PSMemoryFile::create(src);
+        PSLexeme lex;
+        while (nextPSLexeme(file, lex)) {
+            if (lex.type == PSLexType::Number && std::memchr(lex.span.data(), '#', lex.span.size()) == nullptr)
+                numbers.emplace_back(reinterpret_cast<const char*>(lex.span.data()), lex.span.size());
+        }
+    }
+
+    if (numbers.empty()) {
+        printf("  %-40s no numbers\n", label);
+        return;
+    }
+
+    size_t mismatches = 0;
+    for (const std::string& n : numbers) {
+        OctetCursor oc(n.data(), n.size());
+        double value = 0;
+        bool isInteger = false;
+        readNumber(oc, value, isInteger);
+        double expected = std::strtod(n.c_str(), nullptr);
+        if (!isInteger && std::memcmp(&value, &expected, sizeof(double)) != 0)
+            ++mismatches;
+    }
+
+    double bestOurs = 0;
+    double bestStrtod = 0;
+    for (int i = 0; i < runs; ++i) {
+        double sum = 0;
+        StopWatch sw;
+        for (const std::string& n : numbers) {
+            OctetCursor oc(n.data(), n.size());
+            double value = 0;
+            bool isInteger = false;
+            readNumber(oc, value, isInteger);
+            sum += value;
+        }
+        double ours = sw.millis();
+
+        sw.reset();
+        for (const std::string& n : numbers)
+            sum += std::strtod(n.c_str(), nullptr);
+        double theirs = sw.millis();
+
+        gSink = gSink + (static_cast<int64_t>(sum) & 1);
+        if (i == 0 || ours < bestOurs) bestOurs = ours;
+        if (i == 0 || theirs < bestStrtod) bestStrtod = theirs;
+    }
+
+    double count = static_cast<double>(numbers.size());
+    printf("  %-40s %7zu numbers  readNumber: %6.2f ns  strtod: %6.2f ns  mismatches: %zu\n",
+        label, numbers.size(), bestOurs * 1.0e6 / count, bestStrtod * 1.0e6 / count, mismatches);
+}
+
+static void bench_numbers()
+{
+    printf("== Number parsing ==\n");
+
+    // Coordinates the way drawing programs write them, plus the
+    // awkward ones; long fractions, exponents, and out of range
+    std::string text;
+    for (int i = 0; i < 20000; ++i) {
+        text += std::to_string(i % 612) + " " + std::to_string((i * 37) % 792) + "." + std::to_string(i % 1000) + " ";
+        text += "-0." + std::to_string(i % 97) + " " + std::to_string(i) + "e-" + std::to_string(i % 30) + " ";
+        text += "0.1234567890123456789" + std::to_string(i % 10) + " 2147483648 1.7976931348623157e308\n";
+    }
+
+    benchNumberTokens("(generated)", OctetCursor(text.data(), text.size()), 10);
+}
+
+static void bench_numbers(const char* filename, int runs)
+{
+    auto mf = MappedFile::create_shared(filename);
+    if (!mf) {
+        printf("  could not open: %s\n", filename);
+        return;
+    }
+
+    benchNumberTokens(filename, OctetCursor(mf->data(), mf->size()), runs);
+}
+
+// String literals, decoded the way the scanner used to, into a vector
+// and then copied into a PSString, against decoding straight into the
+// storage of the final string.
+static void benchStringLiterals(const char* label, const OctetCursor& src, int runs)
+{
+    std::vector<OctetCursor> literals;
+    {
+        auto file = PSMemoryFile::create(src);
+        PSLexeme lex;
+        while (nextPSLexeme(file, lex)) {
+            if (lex.type == PSLexType::String)
+                literals.push_back(lex.span);
+        }
+    }
+
+    if (literals.empty()) {
+        printf("  %-40s no string literals\n", label);
+        return;
+    }
+
+    double bestLegacy = 0;
+    double bestDirect = 0;
+    size_t legacyAllocs = 0;
+    size_t directAllocs = 0;
+
+    for (int i = 0; i < runs; ++i) {
+        size_t allocs = gAllocations;
+        StopWatch sw;
+        for (const OctetCursor& lit : literals) {
+            std::vector<uint8_t> decoded;
+            spanToString(lit, decoded);
+            PSString str = PSString::fromVector(decoded);
+            gSink = gSink + str.length();
+        }
+        double legacy = sw.millis();
+        legacyAllocs = gAllocations - allocs;
+
+        allocs = gAllocations;
+        sw.reset();
+        for (const OctetCursor& lit : literals) {
+            PSObject obj;
+            PSLexeme lex{ PSLexType::String, lit };
+            objectFromLex(lex, obj);
+            gSink = gSink + obj.asString().length();
+        }
+        double direct = sw.millis();
+        directAllocs = gAllocations - allocs;
+
+        if (i == 0 || legacy < bestLegacy) bestLegacy = legacy;
+        if (i == 0 || direct < bestDirect) bestDirect = direct;
+    }
+
+    double count = static_cast<double>(literals.size());
+    printf("  %-40s %7zu literals  vector: %6.2f ns (%.2f allocs)  direct: %6.2f ns (%.2f allocs)\n",
+        label, literals.size(),
+        bestLegacy * 1.0e6 / count, legacyAllocs / count,
+        bestDirect * 1.0e6 / count, directAllocs / count);
+}
+
+static void bench_string_literals()
+{
+    printf("== String literals ==\n");
+
+    std::string text;
+    for (int i = 0; i < 20000; ++i) {
+        text += "(Helvetica-Bold) (The quick brown fox jumps over the lazy dog) ";
+        text += "(Page \\(" + std::to_string(i) + "\\) of many\\n) () (\\251 Copyright)\n";
+    }
+
+    benchStringLiterals("(generated)", OctetCursor(text.data(), text.size()), 10);
+}
+
+static void bench_string_literals(const char* filename, int runs)
+{
+    auto mf = MappedFile::create_shared(filename);
+    if (!mf) {
+        printf("  could not open: %s\n", filename);
+        return;
+    }
+
+    benchStringLiterals(filename, OctetCursor(mf->data(), mf->size()), runs);
+}
+
+// Scanning a program into objects, as text and as binary tokens
+// (see ps_binary_writer.h), best of 'runs'
+static double timeScan(const OctetCursor& src, int runs, size_t& objects)
+{
+    double best = 0;
+    for (int i = 0; i < runs; ++i) {
+        PSObjectGenerator gen(PSMemoryFile::create(src));
+        PSObject obj;
+        size_t count = 0;
+
+        StopWatch sw;
+        while (gen.next(obj))
+            ++count;
+        double ms = sw.millis();
+
+        if (i == 0 || ms < best)
+            best = ms;
+        objects = count;
+    }
+
+    return best;
+}
+
+static void benchBinaryTokens(const char* label, const OctetCursor& src, int runs)
+{
+    std::vector<uint8_t> binary;
+    encodeBinaryTokens(src, binary);
+    OctetCursor bin(binary.data(), binary.size());
+
+    size_t textObjects = 0;
+    size_t binObjects = 0;
+    double textMs = timeScan(src, runs, textObjects);
+    double binMs = timeScan(bin, runs, binObjects);
+
+    printf("  %-40s %7zu -> %7zu bytes  text: %7.3f ms  binary: %7.3f ms  speedup: %.2fx  (%zu/%zu objects)\n",
+        label, src.size(), binary.size(), textMs, binMs, binMs > 0 ? textMs / binMs : 0.0, textObjects, binObjects);
+}
+
+static void bench_binary_tokens()
+{
+    printf("== Binary tokens ==\n");
+
+    // Path data, the bulk of what a spooler sends
+    std::string text;
+    for (int i = 0; i < 20000; ++i) {
+        text += std::to_string(i % 612) + "." + std::to_string(i % 100) + " " + std::to_string((i * 37) % 792) + " moveto ";
+        text += std::to_string((i * 13) % 612) + " " + std::to_string((i * 7) % 792) + ".25 lineto\n";
+    }
+    text += "stroke\n";
+
+    benchBinaryTokens("(generated)", OctetCursor(text.data(), text.size()), 10);
+}
+
+static void bench_binary_tokens(const char* filename, int runs)
+{
+    auto mf = MappedFile::create_shared(filename);
+    if (!mf) {
+        printf("  could not open: %s\n", filename);
+        return;
+    }
+
+    benchBinaryTokens(filename, OctetCursor(mf->data(), mf->size()), runs);
+}
+
+// Prolog cache (see ps_prolog_cache.h)
+// The same job run again and again, as a print server would, with no 
+// cache, and with one that each job after the first replays its prolog from
+static double timeJobs(const OctetCursor& src, int runs, const std::shared_ptr<PSPrologCache>& cache)
+{
+    double best = 0;
+    for (int i = 0; i < runs; ++i) {
+        auto vm = createBenchVM();
+        vm->setPrologCache(cache);
+        OctetCursor oc = src;
+
+        StopWatch sw;
+        vm->interpret(oc);
+        double ms = sw.millis();
+
+        if (i == 0 || ms < best)
+            best = ms;
+    }
+
+    return best;
+}
+
+static void benchPrologCache(const char* label, const OctetCursor& src, int runs)
+{
+    auto cache = PSPrologCache::create();
+    double plainMs = timeJobs(src, runs, nullptr);
+    timeJobs(src, 1, cache);
+    cache->resetStats();
+    double cachedMs = timeJobs(src, runs, cache);
+
+    const PSPrologCacheStats& st = cache->stats();
+    printf("  %-40s no cache: %7.3f ms  cached: %7.3f ms  regions: %zu (%zu bytes) saved: %.3f ms/job\n",
+        label, plainMs, cachedMs, runs ? st.fHits / runs : 0, runs ? st.fBytesReplayed / runs : 0, 
+        runs ? st.fSavedMs / runs : 0.0);
+}
+
+static void bench_prolog_cache()
+{
+    printf("== Prolog cache ==\n");
+
+    // A driver style prolog, a dictionary of small procedures, and a 
+    // page that uses a few of them
+    std::string text = "%!PS-Adobe-3.0\n%%EndComments\n%%BeginProlog\n/DrvDict 1000 dict def DrvDict begin\n";
+    for (int i = 0; i < 800; ++i) {
+        text += "/p" + std::to_string(i) + " { 2 copy moveto " + std::to_string(i % 72) + ".5 0 rlineto ";
+        text += "0 " + std::to_string(i % 17) + " rlineto closepath gsave 0." + std::to_string(i % 10) + " setgray fill grestore } bind def\n";
+    }
+    text += "end\n%%EndProlog\n%%Page: 1 1\nDrvDict begin 10 10 p1 20 20 p2 showpage end\n%%EOF\n";
+
+    benchPrologCache("(generated)", OctetCursor(text.data(), text.size()), 20);
+}
+
+static void bench_prolog_cache(const char* filename, int runs)
+{
+    auto mf = MappedFile::create_shared(filename);
+    if (!mf) {
+        printf("  could not open: %s\n", filename);
+        return;
+    }
+
+    benchPrologCache(filename, OctetCursor(mf->data(), mf->size()), runs);
+}
+
+// Procedure bodies
+// A procedure used to be an empty array that grew as its elements were 
+// scanned.  Now the elements are gathered in scratch space, and the 
+// array is made once, at its final size.  The old way is kept here to 
+// compare against.
+static bool legacyNextObject(PSLexemeGenerator& lexgen, PSObject& obj)
+{
+    PSLexeme lex;
+    while (lexgen.next(lex)) {
+        switch (lex.type) {
+        case PSLexType::Whitespace:
+        case PSLexType::Comment:
+        case PSLexType::DSCComment:
+            continue;
+
+        case PSLexType::LBRACE: {
+            auto arr = PSArray::create();
+            PSObject element;
+            while (legacyNextObject(lexgen, element) && !element.isNull())
+                arr->append(element);
+            obj.resetFromArray(arr);
+            obj.setExecutable(true);
+            return true;
+        }
+
+        case PSLexType::RBRACE:
+        case PSLexType::Eof:
+            return obj.reset();
+
+        default:
+            return objectFromLex(lex, obj);
+        }
+    }
+
+    return false;
+}
+
+// The bytes held by the arrays of an object, and those inside them
+static size_t retainedArrayBytes(const PSObject& obj)
+{
+    if (!obj.isArray())
+        return 0;
+
+    auto arr = obj.asArray();
+    size_t bytes = sizeof(PSArray) + arr->elements.capacity() * sizeof(PSObject);
+    for (const PSObject& element : arr->elements)
+        bytes += retainedArrayBytes(element);
+    return bytes;
+}
+
+struct ProcedureScan {
+    double ms{ 0 };
+    size_t allocations{ 0 };
+    size_t retained{ 0 };
+    size_t procedures{ 0 };
+};
+
+template <typename NextFn>
+static ProcedureScan timeProcedureScan(const OctetCursor& src, int runs, NextFn nextObject)
+{
+    ProcedureScan best;
+    for (int i = 0; i < runs; ++i) {
+        ProcedureScan scan;
+        std::vector<PSObject> objects;
+        objects.reserve(src.size() / 4);
+
+        PSLexemeGenerator lexgen(PSMemoryFile::create(src));
+        size_t allocs = gAllocations;
+        StopWatch sw;
+        PSObject obj;
+        while (nextObject(lexgen, obj) && !(obj.isNull() && lexgen.fLastType == PSLexType::Eof))
+            objects.push_back(obj);
+        scan.ms = sw.millis();
+        scan.allocations = gAllocations - allocs;
+
+        for (const PSObject& o : objects) {
+            if (o.isArray()) {
+                scan.procedures++;
+                scan.retained += retainedArrayBytes(o);
+            }
+        }
+
+        if (i == 0 || scan.ms < best.ms)
+            best = scan;
+    }
+
+    return best;
+}
+
+static void benchProcedures(const char* label, const OctetCursor& src, int runs)
+{
+    ProcedureScan legacy = timeProcedureScan(src, runs, legacyNextObject);
+    ProcedureScan direct = timeProcedureScan(src, runs, [](PSLexemeGenerator& lexgen, PSObject& obj) {
+        return nextPSObject(lexgen, obj);
+    });
+
+    printf("  %-40s growing: %7.3f ms %8zu allocs %9zu bytes  sized: %7.3f ms %8zu allocs %9zu bytes  (%zu top level procedures)\n",
+        label, legacy.ms, legacy.allocations, legacy.retained, direct.ms, direct.allocations, direct.retained, direct.procedures);
+}
+
+static void bench_procedures()
+{
+    printf("== Procedure bodies ==\n");
+
+    // Many small procedures, as in a large prolog
+    std::string text;
+    for (int i = 0; i < 5000; ++i) {
+        text += "/p" + std::to_string(i) + " { exch dup " + std::to_string(i) + " add { pop } if ";
+        text += "gsave currentpoint translate 0 0 moveto " + std::to_string(i % 50) + " 0 rlineto stroke grestore } bind def\n";
+    }
+
+    benchProcedures("(generated)", OctetCursor(text.data(), text.size()), 10);
+}
+
+static void bench_procedures(const char* filename, int runs)
+{
+    auto mf = MappedFile::create_shared(filename);
+    if (!mf) {
+        printf("  could not open: %s\n", filename);
+        return;
+    }
+
+    benchProcedures(filename, OctetCursor(mf->data(), mf->size()), runs);
+}
+
+// DSC index (see ps_dsc_index.h)
+// Finding the pages of a document, and running one late page on its own,
+// against running the whole document to get to it
+static void benchDSCIndex(const char* label, const OctetCursor& src, int runs)
+{
+    PSDSCIndex index;
+    double best = 0;
+    for (int i = 0; i < runs; ++i) {
+        StopWatch sw;
+        buildDSCIndex(src, index);
+        double ms = sw.millis();
+        if (i == 0 || ms < best)
+            best = ms;
+    }
+
+    printf("  %-40s index: %7.3f ms (%8.2f MB/s)  pages: %zu", label, best, 
+        best > 0 ? src.size() / (best * 1000.0) : 0.0, index.pageCount());
+
+    if (!index.hasPages()) {
+        printf("  (no DSC pages)\n");
+        return;
+    }
+
+    size_t page = (index.pageCount() * 3) / 4;
+
+    StopWatch whole;
+    {
+        auto vm = createBenchVM();
+        OctetCursor oc = src;
+        vm->interpret(oc);
+    }
+    double wholeMs = whole.millis();
+
+    StopWatch single;
+    {
+        auto vm = createBenchVM();
+        vm->interpretPage(index, page);
+    }
+    double pageMs = single.millis();
+
+    printf("  all pages: %8.2f ms  page %zu alone: %7.3f ms\n", wholeMs, page + 1, pageMs);
+}
+
+static void bench_dsc_index()
+{
+    printf("== DSC index ==\n");
+
+    // A 400 page job, each page a few hundred path operations
+    std::string text = "%!PS-Adobe-3.0\n%%BoundingBox: 0 0 612 792\n%%Pages: 400\n%%EndComments\n";
+    text += "%%BeginProlog\n/bx { newpath moveto 10 0 rlineto 0 10 rlineto closepath fill } bind def\n%%EndProlog\n";
+    text += "%%BeginSetup\n%%EndSetup\n";
+    for (int pg = 1; pg <= 400; ++pg) {
+        text += "%%Page: " + std::to_string(pg) + " " + std::to_string(pg) + "\n";
+        for (int i = 0; i < 200; ++i)
+            text += std::to_string((i * 13 + pg) % 600) + " " + std::to_string((i * 7) % 780) + " bx\n";
+        text += "showpage\n";
+    }
+    text += "%%Trailer\n%%EOF\n";
+
+    benchDSCIndex("(generated)", OctetCursor(text.data(), text.size()), 10);
+}
+
+static void bench_dsc_index(const char* filename, int runs)
+{
+    auto mf = MappedFile::create_shared(filename);
+    if (!mf) {
+        printf("  could not open: %s\n", filename);
+        return;
+    }
+
+    benchDSCIndex(filename, OctetCursor(mf->data(), mf->size()), runs);
+}
+
+// Hex data as images in EPS files have it, decoded a byte at a time the
+// way the scanner used to, against the kernel in ps_hexdecode.h, and
+// through the ASCIIHexDecode filter and readhexstring, which both use it
+static void legacyHexDecode(OctetCursor src, std::vector<uint8_t>& out)
+{
+    out.clear();
+    while (!src.empty()) {
+        skipWhile(src, PS_WHITESPACE);
+        if (src.empty()) break;
+
+        uint8_t hiChar = *src;
+        ++src;
+        skipWhile(src, PS_WHITESPACE);
+        uint8_t loChar = src.empty() ? '0' : *src;
+        ++src;
+
+        uint8_t hi, lo;
+        if (!hexToNibble(hiChar, hi) || !hexToNibble(loChar, lo))
+            return;
+        out.push_back((hi << 4) | lo);
+    }
+}
+
+static void benchHexDecode(const char* label, const std::string& text, int runs)
+{
+    OctetCursor src(text.data(), text.size());
+    std::vector<uint8_t> out((text.size() + 1) / 2);
+    double bestLegacy = 0;
+    double bestKernel = 0;
+    double bestFilter = 0;
+    double bestReadHex = 0;
+    size_t bytes = 0;
+
+    for (int i = 0; i < runs; ++i) {
+        StopWatch sw;
+        std::vector<uint8_t> legacy;
+        legacyHexDecode(src, legacy);
+        double legacyMs = sw.millis();
+
+        sw.reset();
+        PSHexDecoder decoder;
+        OctetCursor oc = src;
+        bytes = decoder.decode(oc, out.data(), out.size());
+        double kernelMs = sw.millis();
+
+        if (legacy.size() != bytes || std::memcmp(legacy.data(), out.data(), bytes) != 0)
+            printf("  %s: decoders differ\n", label);
+
+        sw.reset();
+        ASCIIHexDecodeFilter filter(PSMemoryFile::create(src));
+        size_t filtered = filter.readSome(out.data(), out.size());
+        double filterMs = sw.millis();
+        gSink = gSink + filtered;
+
+        auto vm = createBenchVM();
+        vm->opStack().push(PSObject::fromFile(PSMemoryFile::create(src)));
+        vm->opStack().push(PSObject::fromString(PSString(bytes)));
+        sw.reset();
+        op_readhexstring(*vm);
+        double readHexMs = sw.millis();
+
+        if (i == 0 || legacyMs < bestLegacy) bestLegacy = legacyMs;
+        if (i == 0 || kernelMs < bestKernel) bestKernel = kernelMs;
+        if (i == 0 || filterMs < bestFilter) bestFilter = filterMs;
+        if (i == 0 || readHexMs < bestReadHex) bestReadHex = readHexMs;
+    }
+
+    double mb = text.size() / (1024.0 * 1024.0);
+    auto rate = [mb](double ms) { return ms > 0 ? mb * 1000.0 / ms : 0.0; };
+    printf("  %-24s %.1f MB  byte at a time: %8.1f MB/s  kernel: %8.1f MB/s  filter: %8.1f MB/s  readhexstring: %8.1f MB/s\n",
+        label, mb, rate(bestLegacy), rate(bestKernel), rate(bestFilter), rate(bestReadHex));
+}
+
+static void bench_hex_decode()
+{
+    printf("== Hex decoding (%s) ==\n", charScanKernel());
+
+    static const char digits[] = "0123456789ABCDEF";
+    std::string clean;
+    std::string lines;
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < 8 * 1024 * 1024; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        char c = digits[seed >> 28];
+        clean += c;
+        lines += c;
+        if (i % 64 == 63)
+            lines += '\n';
+    }
+
+    benchHexDecode("(clean)", clean, 5);
+    benchHexDecode("(64 digit lines)", lines, 5);
+}
+
+// Mapping a document and lexing all of it, with each of the hints that
+// MappedFile takes.  The file is in the page cache after the first run, so
+// this shows what faulting the pages in costs, not reading the disk.
+static void bench_mapped_file(const char* filename, int runs)
+{
+    static const struct { const char* name; uint32_t hints; } kHints[] = {
+        { "none", MAPPED_HINT_NONE },
+        { "sequential", MAPPED_HINT_SEQUENTIAL },
+        { "sequential+populate", MAPPED_HINT_SEQUENTIAL | MAPPED_HINT_POPULATE },
+        { "random", MAPPED_HINT_RANDOM },
+    };
+
+    printf("  %s\n", filename);
+    for (const auto& h : kHints) {
+        double best = 0;
+        size_t tokens = 0;
+        size_t size = 0;
+
+        for (int i = 0; i < runs; ++i) {
+            StopWatch sw;
+            auto mf = MappedFile::create_shared(filename, h.hints);
+            if (!mf) {
+                printf("    could not open\n");
+                return;
+            }
+
+            auto file = PSDiskFile::create(mf);
+            PSLexeme lex;
+            size_t count = 0;
+            while (nextPSLexeme(file, lex))
+                ++count;
+            double ms = sw.millis();
+
+            if (i == 0 || ms < best)
+                best = ms;
+            tokens = count;
+            size = mf->size();
+        }
+
+        double mb = size / (1024.0 * 1024.0);
+        printf("    %-22s %8.3f ms  (%8.2f MB/s, %zu tokens)\n", h.name, best, best > 0 ? mb * 1000.0 / best : 0.0, tokens);
+    }
+}
+
+// Image data as it comes in a job, run length encoded, then ASCII85,
+// read back through the two filters a byte at a time, a block at a time
+// (readSome), and borrowed a chunk at a time (readChunk)
+
+// 4 MB of a gray image; flat runs, and noisy stretches
+static std::string benchPixels()
+{
+    std::string pixels;
+    uint32_t seed = 777;
+    while (pixels.size() < 4 * 1024 * 1024) {
+        seed = seed * 1664525u + 1013904223u;
+        if (seed & 0x100)
+            pixels.append(64 + (seed >> 26), static_cast<char>(seed >> 24));
+        else
+            for (int i = 0; i < 48; ++i) {
+                seed = seed * 1664525u + 1013904223u;
+                pixels += static_cast<char>(seed >> 24);
+            }
+    }
+    return pixels;
+}
+
+// Where an encode filter writes to, in memory
+struct BenchSink : public PSFile
+{
+    std::string fData;
+
+    bool isValid() const override { return true; }
+    bool isWritable() const override { return true; }
+    bool writeBytes(const uint8_t* data, size_t count) override
+    {
+        fData.append(reinterpret_cast<const char*>(data), count);
+        return true;
+    }
+};
+
+// Write 'data' through an encode filter, in 64K writes
+template <typename Filter, typename... Args>
+static std::string encodeThrough(const std::string& data, Args... args)
+{
+    auto sink = std::make_shared<BenchSink>();
+    sink->fData.reserve(data.size() + data.size() / 2);
+    Filter filter(sink, args...);
+    for (size_t i = 0; i < data.size(); i += 65536)
+        filter.writeBytes(reinterpret_cast<const uint8_t*>(data.data()) + i, std::min<size_t>(65536, data.size() - i));
+    filter.close();
+    return std::move(sink->fData);
+}
+
+static void bench_filter_chain()
+{
+    printf("== Filter chain (ASCII85Decode, RunLengthDecode) ==\n");
+
+    std::string pixels = benchPixels();
+    std::string encoded = encodeThrough<ASCII85EncodeFilter>(encodeThrough<RunLengthEncodeFilter>(pixels, size_t(0)));
+    OctetCursor src(encoded.data(), encoded.size());
+
+    auto chain = [&src]() {
+        return std::make_shared<RunLengthDecodeFilter>(std::make_shared<ASCII85DecodeFilter>(PSMemoryFile::create(src)));
+    };
+
+    std::vector<uint8_t> out(pixels.size());
+    double bestByte = 0, bestSome = 0, bestChunk = 0;
+    size_t byByte = 0, bySome = 0, byChunk = 0;
+
+    for (int i = 0; i < 5; ++i) {
+        auto f = chain();
+        StopWatch sw;
+        size_t n = 0;
+        uint8_t b;
+        while (f->readByte(b))
+            out[n++] = b;
+        double byteMs = sw.millis();
+        byByte = n;
+
+        f = chain();
+        sw.reset();
+        bySome = f->readSome(out.data(), out.size());
+        double someMs = sw.millis();
+
+        f = chain();
+        sw.reset();
+        n = 0;
+        for (OctetCursor chunk = f->readChunk(); !chunk.empty(); chunk = f->readChunk())
+            n += chunk.size();
+        double chunkMs = sw.millis();
+        byChunk = n;
+
+        if (i == 0 || byteMs < bestByte) bestByte = byteMs;
+        if (i == 0 || someMs < bestSome) bestSome = someMs;
+        if (i == 0 || chunkMs < bestChunk) bestChunk = chunkMs;
+    }
+
+    if (byByte != pixels.size() || bySome != pixels.size() || byChunk != pixels.size() ||
+        std::memcmp(out.data(), pixels.data(), pixels.size()) != 0)
+        printf("  decoded data does not match\n");
+
+    double mb = pixels.size() / (1024.0 * 1024.0);
+    auto rate = [mb](double ms) { return ms > 0 ? mb * 1000.0 / ms : 0.0; };
+    printf("  %.1f MB decoded  readByte: %8.1f MB/s  readSome: %8.1f MB/s  readChunk: %8.1f MB/s\n",
+        mb, rate(bestByte), rate(bestSome), rate(bestChunk));
+}
+
+// The image written back out through each encode filter, and read back
+// through the decode filter that undoes it
+template <typename Encode, typename Decode, typename... Args>
+static void benchEncode(const char* label, const std::string& pixels, Args... args)
+{
+    std::string encoded;
+    double bestEncode = 0, bestDecode = 0;
+    bool same = true;
+
+    for (int i = 0; i < 3; ++i) {
+        StopWatch sw;
+        encoded = encodeThrough<Encode>(pixels, args...);
+        double encodeMs = sw.millis();
+
+        std::string decoded;
+        decoded.reserve(pixels.size());
+        Decode decoder(PSMemoryFile::create(OctetCursor(encoded.data(), encoded.size())));
+        sw.reset();
+        for (OctetCursor chunk = decoder.readChunk(); !chunk.empty(); chunk = decoder.readChunk())
+            decoded.append(reinterpret_cast<const char*>(chunk.begin()), chunk.size());
+        double decodeMs = sw.millis();
+        same = same && decoded == pixels;
+
+        if (i == 0 || encodeMs < bestEncode) bestEncode = encodeMs;
+        if (i == 0 || decodeMs < bestDecode) bestDecode = decodeMs;
+    }
+
+    double mb = pixels.size() / (1024.0 * 1024.0);
+    auto rate = [mb](double ms) { return ms > 0 ? mb * 1000.0 / ms : 0.0; };
+    printf("  %-16s %5.1f MB -> %5.1f MB  encode: %8.1f MB/s  decode: %8.1f MB/s%s\n",
+        label, mb, encoded.size() / (1024.0 * 1024.0), rate(bestEncode), rate(bestDecode),
+        same ? "" : "  (decoded data does not match)");
+}
+
+static void bench_encode_filters()
+{
+    printf("== Encode filters ==\n");
+
+    std::string pixels = benchPixels();
+    benchEncode<ASCIIHexEncodeFilter, ASCIIHexDecodeFilter>("ASCIIHexEncode", pixels);
+    benchEncode<ASCII85EncodeFilter, ASCII85DecodeFilter>("ASCII85Encode", pixels);
+    benchEncode<RunLengthEncodeFilter, RunLengthDecodeFilter>("RunLengthEncode", pixels, size_t(0));
+    benchEncode<FlateEncodeFilter, FlateDecodeFilter>("FlateEncode", pixels);
+}
+
+// Whole documents named on the command line
+static void bench_document(const char* filename, int runs)
+{
+    auto mf = MappedFile::create_shared(filename);
+    if (!mf) {
+        printf("  could not open: %s\n", filename);
+        return;
+    }
+
+    OctetCursor src(mf->data(), mf->size());
+    printf("  %-40s %8.2f ms/run (%d runs)", filename, timeInterpret(src, runs), runs);
+
+    auto vm = createBenchVM();
+    vm->interpret(src);
+    printf("  lookup hit rate: %.2f%%\n", vm->lookupStats().hitRate() * 100.0);
+}
+
+int main(int argc, char** argv)
+{
+    bench_object_stack();
+    bench_name_intern();
+    bench_dictionary();
+    bench_string_ops();
+    bench_loops();
+    bench_name_lookup();
+    bench_bind();
+    bench_operands();
+    bench_streaming_lexer();
+    bench_numbers();
+    bench_string_literals();
+    bench_binary_tokens();
+    bench_prolog_cache();
+    bench_dsc_index();
+    bench_procedures();
+    bench_hex_decode();
+    bench_filter_chain();
+    bench_encode_filters();
+
+    if (argc > 1) {
+        printf("== Lexer (%s) ==\n", charScanKernel());
+        for (int i = 1; i < argc; ++i)
+            bench_lexer(argv[i], 10);
+
+        printf("== Number parsing ==\n");
+        for (int i = 1; i < argc; ++i)
+            bench_numbers(argv[i], 10);
+
+        printf("== String literals ==\n");
+        for (int i = 1; i < argc; ++i)
+            bench_string_literals(argv[i], 10);
+
+        printf("== Binary tokens ==\n");
+        for (int i = 1; i < argc; ++i)
+            bench_binary_tokens(argv[i], 10);
+
+        printf("== Prolog cache ==\n");
+        for (int i = 1; i < argc; ++i)
+            bench_prolog_cache(argv[i], 10);
+
+        printf("== DSC index ==\n");
+        for (int i = 1; i < argc; ++i)
+            bench_dsc_index(argv[i], 10);
+
+        printf("== Procedure bodies ==\n");
+        for (int i = 1; i < argc; ++i)
+            bench_procedures(argv[i], 10);
+
+        printf("== Mapped files ==\n");
+        for (int i = 1; i < argc; ++i)
+            bench_mapped_file(argv[i], 10);
+
+        printf("== Documents ==\n");
+        for (int i = 1; i < argc; ++i)
+            bench_document(argv[i], 20);
+    }
+
+    printf("sink: %lld\n", static_cast<long long>(gSink));
+
+    return 0;
+}
@@ -1,6 +1,8 @@
 #include "ps_interpreter.h"
 #include "psvmfactory.h"
 #include "b2dcontext.h"
+#include "ps_binary_writer.h"
+#include "ps_hexdecode.h"
 
 #include <memory>
 #include <cstdio>
@@ -78,7 +80,17 @@ grestore
 )||";
 
     runPostscript(numeric_s1); 
+}
 
+// Radix numbers, integers too big for 32 bits, and exponents
+static void test_number_syntax() {
+    printf("== Number syntax ==\n");
+    runPostscript("16#FFFE = 8#777 = 2#1000 = 36#ZZ =");          // expect: 65534, 511, 8, 1295
+    runPostscript("16#FFFFFFFF = 2147483647 = 2147483648 =");     // expect: -1, 2147483647, 2.14748e+09 (a real)
+    runPostscript("00000000012 type = 000000000002147483647 type = -00000000002147483648 = 0000000002147483648 type =");
+                                                                  // expect: /integertype, /integertype, -2147483648, /realtype
+    runPostscript("1e5 = 1.5e-3 = 1E+2 = -.5 = 123.6e10 =");       // expect: 100000, 0.0015, 100, -0.5, 1.236e+12
+    runPostscript("/16#FG { (not a number) = } def 16#FG");       // expect: not a number
 }
 
 static void test_arithmetic_ops() {
@@ -294,11 +306,229 @@ minidict begin
 }
 
 
+// Substrings share storage with the string they came from, even past
+// the first 64K of a string longer than PostScript's own limit
+static void test_string_aliasing()
+{
+    printf("\n== String Aliasing ==\n");
+    runPostscript(R"||(/s 70000 string def
+/sub s 69990 5 getinterval def
+sub 0 65 put
+sub 1 (BC) putinterval
+s 69990 3 getinterval =
+/far s 65536 10 getinterval def
+far 2 3 getinterval 0 (xyz) putinterval
+s 65538 3 getinterval =
+sub 3 2 getinterval 0 68 put
+s 69993 get =
+)||");  // expect: ABC xyz 68
+}
+
 static void test_exec()
 {
     runPostscript("{ 1 2 add } exec =");
 }
 
+// The rest of the program comes through a filter on currentfile, 
+// and the interpreter carries on after the end of the filtered data
+static void test_filtered_currentfile()
+{
+    runPostscript(R"||(currentfile /ASCII85Decode filter cvx exec
+-tm1.Ci:G.Ec5e;@5p+n+?^i%+>P'JA7QfG+>7s^1b^%_AS*'0+F##GF_i0`~>
+(after the filter) =
+)||");
+}
+
+// Binary tokens, sent through ASCII85 so they survive as text.  The
+// decoded program is
+//   5 7 add =                      integers and a system name, 12
+//   [2 3 add] =                    a binary object sequence, run as it is read, 5;
+//                                  'add' is system name 1, with a length of 0xffff
+//   [1 2 3] ==                     a homogeneous number array
+//   2.5 =                          a fixed point number, 5 with a scale of 1
+//   (hello) =                      a string
+//   FontDirectory                  system name 199, past the table, undefined
+static void test_binary_tokens()
+{
+    printf("\n== Binary Tokens ==\n");
+    runPostscript(R"||(currentfile /ASCII85Decode filter cvx exec
+L]rS>OoZ[g$@i3Y*!$$>z!W`9$z"+pURrr<$!!?aN4Pop&/!!*'$!!=?,4UR#H!!!!&+?^'l"__I
+`Ci:FZ$BiF~>
+)||");
+}
+
+// Numbers written as binary tokens, and read back.  A real with an
+// integral value stays a real, and an integer too big for 32 bits is
+// already a real, so it is not written as a 32 bit integer.
+static void test_binary_writer()
+{
+    printf("\n== Binary Writer ==\n");
+
+    std::vector<uint8_t> binary;
+    encodeBinaryTokens(OctetCursor("2.0 type = 2.0 = 3000000000 type = 3000000000 = 7 type = -40000 ="), binary);
+
+    std::string program = "currentfile /ASCIIHexDecode filter cvx exec\n";
+    std::vector<uint8_t> hex(binary.size() * 2);
+    encodeHex(binary.data(), binary.size(), hex.data());
+    program.append(hex.begin(), hex.end());
+    program += ">\n";
+
+    runPostscript(program.c_str());  // expect: /realtype 2 /realtype 3e+09 /integertype -40000
+}
+
+// Run page 3 of a DSC document on its own.  The prolog and setup run
+// first, the pages ahead of it do not, so 'pages' is 1, not 3.
+static void test_dsc_page()
+{
+    static const char* doc = R"||(%!PS-Adobe-3.0
+%%Pages: 4
+%%EndComments
+%%BeginProlog
+/pages 0 def
+%%EndProlog
+%%BeginSetup
+/banner (setup ran) def
+%%EndSetup
+%%Page: 1 1
+/pages pages 1 add def (page 1) =
+%%Page: 2 2
+/pages pages 1 add def (page 2) =
+%%Page: 3 3
+/pages pages 1 add def (page 3) = banner = pages =
+%%Page: 4 4
+/pages pages 1 add def (page 4) =
+%%Trailer
+%%EOF
+)||";
+
+    printf("\n== DSC Page ==\n");
+
+    PSDSCIndex index;
+    buildDSCIndex(OctetCursor(doc), index);
+    printf("pages: %zu, declared: %d\n", index.pageCount(), index.fDeclaredPages);
+
+    auto vm = PSVMFactory::createVM();
+    auto ctx = std::make_unique<waavs::Blend2DGraphicsContext>(640, 480);
+    vm->setGraphicsContext(std::move(ctx));
+    vm->interpretPage(index, index.findPage(3));  // expect: (page 3) (setup ran) 1
+}
+
+// %%Page: lines inside data sections are data, not pages; counted in
+// bytes, counted in lines, and with no count, up to the end comment
+static void test_dsc_data()
+{
+    static const char* doc = R"||(%!PS-Adobe-3.0
+%%Pages: 1
+%%EndComments
+%%Page: 1 1
+(page 1) =
+%%BeginData: 12 ASCII Bytes
+%%Page: 2 2
+%%EndData
+%%BeginData: 2 ASCII Lines
+%%Page: 3 3
+%%Page: 4 4
+%%EndData
+%%BeginBinary: (unknown)
+%%Page: 5 5
+%%EndBinary
+%%Trailer
+%%EOF
+)||";
+
+    printf("\n== DSC Data ==\n");
+
+    PSDSCIndex index;
+    buildDSCIndex(OctetCursor(doc), index);
+    printf("pages: %zu, declared: %d, trailer: %s\n", index.pageCount(), index.fDeclaredPages,
+        index.trailer().empty() ? "no" : "yes");    // expect: pages: 1, declared: 1, trailer: yes
+}
+
+// An eexec section, in hex, that closes itself.  What follows the
+// cipher text runs as ordinary program text again.
+static void test_eexec()
+{
+    printf("\n== eexec ==\n");
+    runPostscript(R"||(currentfile eexec
+D9D66F63773B03AFF123FDE3EA9E76EFF9A764536FEF63F5FA2DF205BCD71FD2
+186668062EC74A9498F67C793910A2A8
+0000000000000000000000000000000000000000000000000000000000000000
+0000000000000000000000000000000000000000000000000000000000000000
+cleartomark
+(after eexec) =
+)||");  // expect: (inside eexec) (after eexec)
+}
+
+// Hex data, as a literal, through readhexstring, which skips anything
+// that is not a digit, and through the ASCIIHexDecode filter
+static void test_hex_data()
+{
+    printf("\n== Hex data ==\n");
+    runPostscript(R"||(<48656C6C6F 20 776f726C64> =
+<41 4 2> =
+currentfile 9 string readhexstring
+48 65 6c6c6f -- 2121
+2121
+pop =
+currentfile /ASCIIHexDecode filter 100 string readstring
+48656C6C6F2C20
+66696C7465 7>
+pop =
+/s (XXXXXXXXXXXXXXXXXXXX) def
+currentfile /ASCII85Decode filter s readhexstring
+1bggB1c$sF1c7*J1cHO"+<VdL+<U~>
+pop pop s ==
+)||");  // expect: (Hello world) (AB) (Hello!!!!) (Hello, filtep)
+            //         (ABCDEFGXXXXXXXXXXXXX), a short read leaves the rest of the string alone
+}
+
+// A chain of filters, read a block at a time, and a filter closed
+// part way through, which reads on to its end of data
+static void test_filters()
+{
+    printf("\n== Filters ==\n");
+    runPostscript(R"||(currentfile /ASCII85Decode filter /RunLengthDecode filter 100 string readstring
+!dK!:r,I5~>
+pop =
+{ currentfile /ASCII85Decode filter dup 5 string readstring pop = closefile } exec
+87cURD_*#CBl%m&EcV~>
+(after closefile) =
+currentfile /ASCII85Decode filter /FlateDecode filter 100 string readstring
+Gb"@rc,n)Z;/j]M/4nAjnA+*6!W^+P$OQ~>
+pop =
+currentfile /ASCII85Decode filter << /Predictor 12 /Columns 4 >> /FlateDecode filter 100 string readstring
+Gar8_FE2P5@UNSO"98\]!=f~>
+pop =
+currentfile /ASCII85Decode filter /LZWDecode filter 100 string readstring
+J.#a]+q+m5+=7k]n;($tY5n~>
+pop =
+currentfile /ASCII85Decode filter << /EarlyChange 0 >> /LZWDecode filter 100 string readstring
+J/&CO+t5XM:+);L:e3Dq$O;@#5Q~>
+pop =
+)||");  // expect: (xyzqqqqq) (Hello) (after closefile) (Hello, Flate. Hello, Flate. Hello!) (ABCDABCE)
+            //         (-----A---B LZW LZW LZW) (TOBEORNOTTOBEORTOBEORNOT)
+}
+
+// Writing to %stdout, directly, and through encode filters; closing a
+// filter writes its end of data marker and leaves the target open
+static void test_encode_filters()
+{
+    printf("\n== Encode Filters ==\n");
+    runPostscript(R"||(/out (%stdout) (w) file def
+out (Hi) writehexstring out (\n) writestring
+out /ASCIIHexEncode filter dup (Hello) writestring closefile out (\n) writestring
+out /ASCII85Encode filter dup (Hello, world) writestring closefile out (\n) writestring
+/hex out /ASCIIHexEncode filter def
+hex 0 /RunLengthEncode filter dup (aaaaaabc) writestring closefile hex closefile out (\n) writestring
+out (first\n) writestring (second\n) print
+out flushfile
+)||");  // expect: 4869
+            //         48656c6c6f>
+            //         87cURD_*#TDfTZ)~>
+            //         fb6101626380>
+            //         first, then second; %stdout is the stream print writes to
+}
+
 static void test_operator_def()
 {
     printf("\n== Operator Definition ==\n");
@@ -702,6 +932,16 @@ static void test_core()
     test_repeat();
     test_nested();
     test_exec();
+    test_string_aliasing();
+    test_filtered_currentfile();
+    test_binary_tokens();
+    test_binary_writer();
+    test_dsc_page();
+    test_dsc_data();
+    test_eexec();
+    test_hex_data();
+    test_filters();
+    test_encode_filters();
     //test_op_stopped();
     test_operator_def();
     //test_op_dict();
@@ -709,6 +949,7 @@ static void test_core()
     //test_unimplemented_op();
     //test_dictionary_inline();
     //test_numeric();
+    test_number_syntax();
     //test_resources();
     //test_encodings();
     //test_encodings2();
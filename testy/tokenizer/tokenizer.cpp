@@ -29,7 +29,6 @@ std::unordered_map<PSLexType, const char*> lexTypeNames = {
 	{PSLexType::Comment, "Comment"},
 	{PSLexType::DSCComment, "DSCComment"},
 	{PSLexType::Delimiter, "Delimiter"},
-    {PSLexType::EexecSwitch, "EexecSwitch"},
 	{PSLexType::Eof, "Eof"}
 };
 
@@ -49,33 +48,7 @@ static void test_lexgen(OctetCursor s)
 	PSLexeme lexeme;
 	while(gen.next(lexeme)) 
 	{
-		switch (lexeme.type)
-		{
-			case PSLexType::EexecSwitch: {
-				printf("EexecSwitch encountered, decrypting...\n");
-				std::vector<uint8_t> hexstring;
-                std::vector<uint8_t> decrypted;
-				if (spanToHexString(lexeme.span, hexstring)) {
-					eexecDecrypt(hexstring, decrypted);
-					// print out the decrypted data
-                    printf("Decrypted Eexec data: \n");
-					for (size_t i = 0; i < decrypted.size(); ++i) {
-						printf("%c", decrypted[i]);
-						//if ((i + 1) % 80 == 0) {
-						//	printf("\n");
-						//}
-					}
-				} else {
-					printf("Failed to decode hex string in EexecSwitch.\n");
-				}
-				printf("\n");
-				break;
-            }
-
-			default:
-				printLexeme(lexeme);
-			break;
-		}
+		printLexeme(lexeme);
 	}
 }
 